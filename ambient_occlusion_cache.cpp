@@ -0,0 +1,169 @@
+#include "ambient_occlusion_cache.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+AmbientOcclusionCache::AmbientOcclusionCache() {
+    glCreateTextures(GL_TEXTURE_2D, 1, &atlas_texture);
+    glTextureStorage2D(atlas_texture, 1, GL_RG8, atlas_size, atlas_size);
+    TextureUtils::set_texture_2d_parameters(atlas_texture, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_LINEAR, GL_LINEAR);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &ground_texture);
+    glTextureStorage2D(ground_texture, 1, GL_RG8, ground_size, ground_size);
+    TextureUtils::set_texture_2d_parameters(ground_texture, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_LINEAR, GL_LINEAR);
+
+    glCreateBuffers(1, &jobs_buffer);
+    glNamedBufferStorage(jobs_buffer, sizeof(uint32_t) * max_jobs, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+    queued_blocks.assign(ground_blocks_per_row * ground_blocks_per_row, false);
+}
+
+AmbientOcclusionCache::~AmbientOcclusionCache() {
+    glDeleteTextures(1, &atlas_texture);
+    glDeleteTextures(1, &ground_texture);
+    glDeleteBuffers(1, &jobs_buffer);
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void AmbientOcclusionCache::reset(const glm::vec4* spheres, int static_count, int tracked_count, float range) {
+    this->range = range;
+    cached_spheres.assign(spheres, spheres + std::min(static_count, capacity));
+    this->tracked_count = std::min(tracked_count, static_cast<int>(cached_spheres.size()));
+    invalidate_all();
+}
+
+void AmbientOcclusionCache::update(const glm::vec4* spheres, float range) {
+    if (range != this->range) {
+        this->range = range;
+        invalidate_all();
+        return;
+    }
+
+    for (int i = 0; i < tracked_count; i++) {
+        if (spheres[i] == cached_spheres[i]) continue;
+
+        // Both the points near the old position (no longer occluded) and near the new one (newly occluded) change.
+        const glm::vec4 old_sphere = cached_spheres[i];
+        const glm::vec4 new_sphere = spheres[i];
+        cached_spheres[i] = new_sphere;
+        const glm::vec3 old_extent = glm::vec3(old_sphere.w + range);
+        const glm::vec3 new_extent = glm::vec3(new_sphere.w + range);
+        const glm::vec3 region_min = glm::min(glm::vec3(old_sphere) - old_extent, glm::vec3(new_sphere) - new_extent);
+        const glm::vec3 region_max = glm::max(glm::vec3(old_sphere) + old_extent, glm::vec3(new_sphere) + new_extent);
+        invalidate_region(region_min, region_max);
+    }
+}
+
+void AmbientOcclusionCache::bake(GpuProgram& program, UploadRing& upload_ring, int max_count) {
+    const int count = std::min({max_count, max_jobs, static_cast<int>(pending.size())});
+    if (count <= 0) {
+        return;
+    }
+
+    std::vector<uint32_t> jobs(pending.begin(), pending.begin() + count);
+    pending.erase(pending.begin(), pending.begin() + count);
+    for (const uint32_t job : jobs) {
+        if (job & ground_job) {
+            queued_blocks[job & ~ground_job] = false;
+        } else {
+            queued_spheres[job] = false;
+        }
+    }
+    upload_ring.upload(jobs_buffer, 0, sizeof(uint32_t) * count, jobs.data());
+
+    program.use();
+    program.uniform("occlusion_range", range);
+    program.uniform("sample_count", sample_count);
+    program.uniform("atlas_tiles_per_row", tiles_per_row);
+    program.uniform("ground_tiles_per_row", ground_blocks_per_row);
+    program.uniform("ground_extent", ground_extent);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, jobs_buffer);
+    glBindImageTexture(0, atlas_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG8);
+    glBindImageTexture(1, ground_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG8);
+    glDispatchCompute(count, 1, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    version++;
+}
+
+void AmbientOcclusionCache::bind(GLuint atlas_unit, GLuint ground_unit) const {
+    glBindTextureUnit(atlas_unit, atlas_texture);
+    glBindTextureUnit(ground_unit, ground_texture);
+}
+
+void AmbientOcclusionCache::invalidate_all() {
+    glClearTexImage(atlas_texture, 0, GL_RG, GL_UNSIGNED_BYTE, nullptr);
+    glClearTexImage(ground_texture, 0, GL_RG, GL_UNSIGNED_BYTE, nullptr);
+    version++;
+
+    // The snowman comes first, the ground blocks close to it follow before the distant ones.
+    pending.clear();
+    queued_spheres.assign(cached_spheres.size(), true);
+    for (int i = 0; i < static_cast<int>(cached_spheres.size()); i++) {
+        pending.push_back(static_cast<uint32_t>(i));
+    }
+    std::vector<int> blocks(queued_blocks.size());
+    std::iota(blocks.begin(), blocks.end(), 0);
+    const auto center_distance = [](int block) {
+        const float x = static_cast<float>(block % ground_blocks_per_row) + 0.5f - 0.5f * ground_blocks_per_row;
+        const float y = static_cast<float>(block / ground_blocks_per_row) + 0.5f - 0.5f * ground_blocks_per_row;
+        return x * x + y * y;
+    };
+    std::stable_sort(blocks.begin(), blocks.end(), [&](int a, int b) { return center_distance(a) < center_distance(b); });
+    queued_blocks.assign(queued_blocks.size(), true);
+    for (const int block : blocks) {
+        pending.push_back(ground_job | static_cast<uint32_t>(block));
+    }
+}
+
+void AmbientOcclusionCache::invalidate_region(const glm::vec3& region_min, const glm::vec3& region_max) {
+    for (int i = 0; i < static_cast<int>(cached_spheres.size()); i++) {
+        const glm::vec4 sphere = cached_spheres[i];
+        bool overlaps = true;
+        for (int axis = 0; axis < 3; axis++) {
+            overlaps = overlaps && sphere[axis] - sphere.w <= region_max[axis] && sphere[axis] + sphere.w >= region_min[axis];
+        }
+        if (overlaps) {
+            invalidate_sphere(i);
+        }
+    }
+
+    // The ground only changes if the region reaches down to it.
+    if (region_min.y > 0.0f) {
+        return;
+    }
+    const auto block_coordinate = [](float position) {
+        const float block_extent = 2.0f * ground_extent / ground_blocks_per_row;
+        return std::clamp(static_cast<int>(std::floor((position + ground_extent) / block_extent)), 0, ground_blocks_per_row - 1);
+    };
+    for (int y = block_coordinate(region_min.z); y <= block_coordinate(region_max.z); y++) {
+        for (int x = block_coordinate(region_min.x); x <= block_coordinate(region_max.x); x++) {
+            invalidate_block(y * ground_blocks_per_row + x);
+        }
+    }
+}
+
+void AmbientOcclusionCache::invalidate_sphere(int sphere) {
+    const int x = sphere % tiles_per_row * tile_size, y = sphere / tiles_per_row * tile_size;
+    glClearTexSubImage(atlas_texture, 0, x, y, 0, tile_size, tile_size, 1, GL_RG, GL_UNSIGNED_BYTE, nullptr);
+    version++;
+    if (!queued_spheres[sphere]) {
+        queued_spheres[sphere] = true;
+        pending.push_back(static_cast<uint32_t>(sphere));
+    }
+}
+
+void AmbientOcclusionCache::invalidate_block(int block) {
+    const int x = block % ground_blocks_per_row * tile_size, y = block / ground_blocks_per_row * tile_size;
+    glClearTexSubImage(ground_texture, 0, x, y, 0, tile_size, tile_size, 1, GL_RG, GL_UNSIGNED_BYTE, nullptr);
+    version++;
+    if (!queued_blocks[block]) {
+        queued_blocks[block] = true;
+        pending.push_back(ground_job | static_cast<uint32_t>(block));
+    }
+}
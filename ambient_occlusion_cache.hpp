@@ -0,0 +1,135 @@
+#pragma once
+#include "gpu_program.hpp"
+#include "upload_ring.hpp"
+#include <cstdint>
+#include <deque>
+#include <glm/glm.hpp>
+#include <vector>
+
+/**
+ * The ambient occlusion of the static geometry baked into textures, so shading a point costs a single lookup.
+ *
+ * Every static sphere has a tile of {@link tile_size} x {@link tile_size} texels in the atlas, indexed by the
+ * octahedral mapping of the surface normal. The ground plane has its own texture covering [-ground_extent,
+ * ground_extent] in x and z, split into blocks of the same size. The red channel holds the unoccluded fraction of the
+ * hemisphere, the green channel marks the baked texels, so the shaders can fall back to sampling until a tile is ready.
+ *
+ * The occlusion is limited to a range, so a moved sphere only invalidates the tiles and blocks within the range of its
+ * old and new position. The invalidated tiles are queued and baked a few per frame with ambient_occlusion_bake.comp.
+ * Only the first {@link tracked_count} static spheres (the snowman) are checked for changes, the others are expected to
+ * stay in place until the next {@link reset}.
+ */
+class AmbientOcclusionCache {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The width and height of a tile (in texels), a work group of the bake shader bakes one tile. */
+    static constexpr int tile_size = 16;
+    /** The width and height of the atlas of the spheres (in texels). */
+    static constexpr int atlas_size = 1024;
+    /** The number of tiles in a row of the atlas. */
+    static constexpr int tiles_per_row = atlas_size / tile_size;
+    /** The number of spheres with a tile, the spheres after them are not cached. */
+    static constexpr int capacity = tiles_per_row * tiles_per_row;
+    /** The width and height of the ground texture (in texels). */
+    static constexpr int ground_size = 512;
+    /** The number of blocks in a row of the ground texture. */
+    static constexpr int ground_blocks_per_row = ground_size / tile_size;
+    /** The half of the size of the ground plane, see RayPlaneIntersection in the shaders. */
+    static constexpr float ground_extent = 40.0f;
+    /** The bit marking the jobs baking a block of the ground instead of a sphere. */
+    static constexpr uint32_t ground_job = 0x80000000u;
+    /** The number of hemisphere samples per texel. */
+    static constexpr int sample_count = 256;
+    /** The maximum number of tiles baked by a single {@link bake}. */
+    static constexpr int max_jobs = 1024;
+
+  private:
+    /** The RG8 atlas with a tile per cached sphere. */
+    GLuint atlas_texture = 0;
+    /** The RG8 texture of the ground plane. */
+    GLuint ground_texture = 0;
+    /** The buffer with the jobs of the current bake. */
+    GLuint jobs_buffer = 0;
+
+    /** The cached spheres as they were when their tiles were invalidated last. */
+    std::vector<glm::vec4> cached_spheres;
+    /** The number of the spheres at the beginning of {@link cached_spheres} that are checked for changes. */
+    int tracked_count = 0;
+    /** The range of the occlusion the tiles are baked with. */
+    float range = 0.0f;
+
+    /** The tiles waiting for the bake, the jobs in the format of the bake shader. */
+    std::deque<uint32_t> pending;
+    /** The flags determining which sphere tiles are in {@link pending}. */
+    std::vector<bool> queued_spheres;
+    /** The flags determining which ground blocks are in {@link pending}. */
+    std::vector<bool> queued_blocks;
+
+    /** The counter incremented whenever the content of the textures changes. */
+    int version = 0;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    /** Creates the textures and the job buffer. */
+    AmbientOcclusionCache();
+
+    /** Releases the textures and the job buffer. */
+    ~AmbientOcclusionCache();
+
+    AmbientOcclusionCache(const AmbientOcclusionCache&) = delete;
+    AmbientOcclusionCache& operator=(const AmbientOcclusionCache&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Discards the whole cache and queues all the tiles, e.g., when a new scene is uploaded.
+     *
+     * @param 	spheres		  	The spheres of the scene, the static ones first.
+     * @param 	static_count  	The number of static spheres.
+     * @param 	tracked_count 	The number of spheres at the beginning that may change, see {@link update}.
+     * @param 	range		  	The distance up to which the spheres occlude.
+     */
+    void reset(const glm::vec4* spheres, int static_count, int tracked_count, float range);
+
+    /**
+     * Invalidates the tiles affected by the tracked spheres that have changed since the last call, or the whole cache
+     * if the range has changed.
+     */
+    void update(const glm::vec4* spheres, float range);
+
+    /**
+     * Bakes up to max_count pending tiles.
+     *
+     * The caller binds the spheres and the BVH (the SSBOs 4, 6, and 7), the sample sequences (units 2 and 3), and sets
+     * bvh_static_root and bvh_static_end of the program.
+     */
+    void bake(GpuProgram& program, UploadRing& upload_ring, int max_count);
+
+    /** Binds the atlas and the ground texture to the given texture units. */
+    void bind(GLuint atlas_unit, GLuint ground_unit) const;
+
+    /** @return The number of tiles waiting for the bake. */
+    int get_pending_count() const { return static_cast<int>(pending.size()); }
+
+    /** @return The counter incremented whenever the cached values change. */
+    int get_version() const { return version; }
+
+  private:
+    /** Clears both textures and queues every tile, the ground blocks from the center outwards. */
+    void invalidate_all();
+
+    /** Clears and queues the tiles and blocks whose occlusion may depend on the given box. */
+    void invalidate_region(const glm::vec3& region_min, const glm::vec3& region_max);
+
+    /** Clears and queues the tile of the sphere. */
+    void invalidate_sphere(int sphere);
+
+    /** Clears and queues the block of the ground. */
+    void invalidate_block(int block);
+};
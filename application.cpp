@@ -1,39 +1,130 @@
 #include "application.hpp"
-#include "model_ubo.hpp"
+#include "command_line.hpp"
+#include "program_binary_cache.hpp"
 #include "utils.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iomanip>
+#include <iterator>
+#include <limits>
 #include <random>
+#include <sstream>
 
 Application::Application(int initial_width, int initial_height, std::vector<std::string> arguments)
     : PV227Application(initial_width, initial_height, arguments) {
+    // The cache has to be configured before the first compilation, the other options are applied once the scene exists.
+    if (!CommandLine::has_flag(arguments, "--no-shader-cache")) {
+        const std::filesystem::path default_directory = std::filesystem::temp_directory_path() / "pv227_shader_cache";
+        ProgramBinaryCache::set_directory(CommandLine::get_string(arguments, "--shader-cache", default_directory.string()));
+    }
+    if (!CommandLine::has_flag(arguments, "--no-asset-cache")) {
+        const std::filesystem::path default_directory = std::filesystem::temp_directory_path() / "pv227_asset_cache";
+        asset_loader.set_cache_directory(CommandLine::get_string(arguments, "--asset-cache", default_directory.string()));
+    }
     Application::compile_shaders();
     prepare_cameras();
     prepare_materials();
     prepare_textures();
     prepare_snowman();
+    prepare_sphere_meshes();
     prepare_lights();
     prepare_particles();
     prepare_scene();
     prepare_framebuffers();
+    prepare_wavefront_queues();
+    apply_arguments(arguments);
 }
 
-Application::~Application() {}
+Application::~Application() {
+    if (write_profile_at_exit) {
+        gpu_profiler.write_csv(profile_csv_path);
+    }
+    if (capture) {
+        if (capture->save(capture_path)) {
+            std::cout << "The session of " << capture->frames.size() << " frames was recorded into " << capture_path << "." << std::endl;
+        } else {
+            std::cerr << "Could not write the session into " << capture_path << "." << std::endl;
+        }
+    }
+    glDeleteTextures(1, &cpu_color_texture);
+    glDeleteTextures(1, &cpu_depth_texture);
+    glDeleteFramebuffers(1, &accumulation_framebuffer);
+    glDeleteTextures(1, &accumulation_color_texture);
+    glDeleteTextures(1, &accumulation_unshadowed_texture);
+    glDeleteTextures(1, &accumulation_visibility_texture);
+    glDeleteTextures(1, &accumulation_depth_texture);
+    glDeleteFramebuffers(1, &visibility_framebuffer);
+    glDeleteTextures(1, &visibility_sphere_texture);
+    glDeleteTextures(1, &visibility_depth_texture);
+    glDeleteBuffers(1, &scene_spheres_buffer);
+    glDeleteBuffers(1, &scene_materials_buffer);
+    glDeleteBuffers(1, &bvh_nodes_buffer);
+    glDeleteBuffers(1, &bvh_indices_buffer);
+    glDeleteVertexArrays(1, &sphere_mesh_vao);
+    glDeleteBuffers(1, &sphere_mesh_vertices);
+    glDeleteBuffers(1, &sphere_mesh_indices);
+    glDeleteBuffers(1, &sphere_draw_commands_template);
+    glDeleteBuffers(1, &sphere_draw_commands);
+    glDeleteBuffers(1, &visible_spheres_buffer);
+    glDeleteBuffers(1, &camera_buffer);
+    glDeleteBuffers(1, &lights_buffer);
+    glDeleteBuffers(1, &particle_ssbo);
+    glDeleteBuffers(1, &visible_particles_buffer);
+    glDeleteBuffers(1, &particle_draw_buffer);
+    glDeleteBuffers(2, wavefront_ray_queues);
+    glDeleteBuffers(1, &wavefront_shadow_queue);
+    glDeleteBuffers(1, &wavefront_pixels_buffer);
+    glDeleteTextures(1, &particle_tex);
+}
 
 // ----------------------------------------------------------------------------
 // Shaderes
 // ----------------------------------------------------------------------------
 void Application::compile_shaders() {
+    const auto start = std::chrono::steady_clock::now();
     default_unlit_program = ShaderProgram(lecture_shaders_path / "object.vert", lecture_shaders_path / "unlit.frag");
     default_lit_program = ShaderProgram(lecture_shaders_path / "object.vert", lecture_shaders_path / "lit.frag");
 
-	ray_tracing_program = ShaderProgram(lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "ray_tracing.frag");
+    // All the programs are started first so the driver can compile them in parallel, or restores them from the cache.
+	ray_tracing_program = GpuProgram({lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "ray_tracing.frag"});
+
+    instanced_sphere_program = GpuProgram({lecture_shaders_path / "instanced_sphere.vert", lecture_shaders_path / "instanced_sphere.frag"});
+    sphere_visibility_program = GpuProgram({lecture_shaders_path / "sphere_impostor.vert", lecture_shaders_path / "sphere_visibility.frag"});
+    sphere_cull_program = GpuProgram({lecture_shaders_path / "sphere_cull.comp"});
 
-    particle_program = ShaderProgram();
-    particle_program.add_vertex_shader(lecture_shaders_path / "particle_textured.vert");
-    particle_program.add_fragment_shader(lecture_shaders_path / "particle_textured.frag");
-    particle_program.add_geometry_shader(lecture_shaders_path / "particle_textured.geom");
-    particle_program.link();
+    particle_program = GpuProgram({lecture_shaders_path / "particle_textured.vert", lecture_shaders_path / "particle_textured.frag"});
+    particle_seed_program = GpuProgram({lecture_shaders_path / "particle_seed.comp"});
+    particle_simulation_program = GpuProgram({lecture_shaders_path / "particle_simulate.comp"});
+    particle_compaction_program = GpuProgram({lecture_shaders_path / "particle_compact.comp"});
 
-    std::cout << "Shaders are reloaded." << std::endl;
+    display_texture_program = GpuProgram({lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "display_texture.frag"});
+    upscale_program = GpuProgram({lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "upscale_ray_tracing.frag"});
+
+    wavefront_program = GpuProgram({lecture_shaders_path / "wavefront_ray_tracing.comp"});
+    wavefront_resolve_program = GpuProgram({lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "wavefront_resolve.frag"});
+
+    ambient_occlusion_bake_program = GpuProgram({lecture_shaders_path / "ambient_occlusion_bake.comp"});
+
+    denoise_temporal_program = GpuProgram({lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "denoise_temporal.frag"});
+    denoise_atrous_program = GpuProgram({lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "denoise_atrous.frag"});
+    denoise_composite_program = GpuProgram({lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "denoise_composite.frag"});
+
+    // Waits for the links, reports the errors, and stores the new binaries.
+    for (GpuProgram* program : {&ray_tracing_program, &instanced_sphere_program, &sphere_cull_program, &particle_program, &particle_seed_program,
+                                &particle_simulation_program, &particle_compaction_program, &display_texture_program, &upscale_program,
+                                &wavefront_program, &wavefront_resolve_program, &ambient_occlusion_bake_program, &denoise_temporal_program,
+                                &denoise_atrous_program, &denoise_composite_program}) {
+        program->is_valid();
+    }
+
+    // The specialized variants are built again from the reloaded sources when they are needed.
+    ray_tracing_variants.reset({lecture_shaders_path / "full_screen_quad.vert", lecture_shaders_path / "ray_tracing.frag"});
+
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Shaders are reloaded in " << elapsed.count() << " ms (" << ProgramBinaryCache::get_hit_count() << " cached binaries loaded, "
+              << ProgramBinaryCache::get_miss_count() << " compiled, " << ProgramBinaryCache::get_rejected_count() << " rejected so far)." << std::endl;
 }
 
 // ----------------------------------------------------------------------------
@@ -43,9 +134,12 @@ void Application::prepare_cameras() {
     // Sets the default camera position.
     camera.set_eye_position(glm::radians(-45.f), glm::radians(20.f), 25.f);
     // Computes the projection matrix.
-    camera_ubo.set_projection(
-        glm::perspective(glm::radians(45.f), static_cast<float>(this->width) / static_cast<float>(this->height), 1.0f, 1000.0f));
-    camera_ubo.update_opengl_data();
+    projection_matrix = glm::perspective(glm::radians(45.f), static_cast<float>(this->width) / static_cast<float>(this->height), 1.0f, 1000.0f);
+    camera_data.projection = projection_matrix;
+    camera_data.projection_inv = glm::inverse(projection_matrix);
+
+    glCreateBuffers(1, &camera_buffer);
+    glNamedBufferStorage(camera_buffer, sizeof(CameraBufferData), &camera_data, GL_DYNAMIC_STORAGE_BIT);
 }
 
 void Application::prepare_materials() {
@@ -67,14 +161,27 @@ void Application::prepare_materials() {
 }
 
 void Application::prepare_textures() {
-    particle_tex = TextureUtils::load_texture_2d(lecture_textures_path / "snow.jpg");
+    // The particles are invisible until the texture streams in, the first frames do not wait for it.
+    const uint8_t placeholder = 0;
+    glCreateTextures(GL_TEXTURE_2D, 1, &particle_tex);
+    glTextureStorage2D(particle_tex, 1, GL_R8, 1, 1);
+    glTextureSubImage2D(particle_tex, 0, 0, 0, 1, 1, GL_RED, GL_UNSIGNED_BYTE, &placeholder);
+
     // Particles are really small, use mipmaps for them.
-    TextureUtils::set_texture_2d_parameters(particle_tex, GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+    asset_loader.load_texture_2d(lecture_textures_path / "snow.jpg", GL_REPEAT, GL_REPEAT, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, [this](GLuint texture) {
+        glDeleteTextures(1, &particle_tex);
+        particle_tex = texture;
+    });
 }
 
 void Application::prepare_lights() {
     phong_lights_ubo = PhongLightsUBO(3, GL_UNIFORM_BUFFER);
     phong_lights_ubo.set_global_ambient(glm::vec3(0.2f));
+
+    lights_data.global_ambient_color = glm::vec3(0.2f);
+    lights_data.lights_count = light_count;
+    glCreateBuffers(1, &lights_buffer);
+    glNamedBufferStorage(lights_buffer, sizeof(LightsBufferData), &lights_data, GL_DYNAMIC_STORAGE_BIT);
 }
 
 void Application::prepare_snowman() {
@@ -94,64 +201,379 @@ void Application::prepare_snowman() {
     snowman.spheres[9] = glm::vec4(0.0f, 3.1f, 0.9f, 0.1f);
 }
 
+void Application::prepare_sphere_meshes() {
+    // Generates UV spheres with decreasing detail, all stored in one vertex and one index buffer.
+    const int slices[sphere_lod_count] = {32, 12};
+    const int stacks[sphere_lod_count] = {16, 6};
+
+    std::vector<glm::vec3> vertices;
+    std::vector<GLuint> indices;
+    DrawElementsIndirectCommand commands[sphere_command_count];
+    for (int lod = 0; lod < sphere_lod_count; lod++) {
+        commands[lod] = {0, 0, static_cast<GLuint>(indices.size()), static_cast<GLint>(vertices.size()), 0};
+
+        for (int stack = 0; stack <= stacks[lod]; stack++) {
+            const float theta = glm::pi<float>() * static_cast<float>(stack) / static_cast<float>(stacks[lod]);
+            for (int slice = 0; slice <= slices[lod]; slice++) {
+                const float phi = 2.0f * glm::pi<float>() * static_cast<float>(slice) / static_cast<float>(slices[lod]);
+                vertices.push_back(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+            }
+        }
+        for (int stack = 0; stack < stacks[lod]; stack++) {
+            for (int slice = 0; slice < slices[lod]; slice++) {
+                const GLuint first = stack * (slices[lod] + 1) + slice;
+                const GLuint second = first + slices[lod] + 1;
+                indices.insert(indices.end(), {first, first + 1, second, second, first + 1, second + 1});
+            }
+        }
+        commands[lod].count = static_cast<GLuint>(indices.size()) - commands[lod].first_index;
+    }
+
+    // The impostor is a quad, its corners are moved in front of the sphere by sphere_impostor.vert.
+    commands[sphere_impostor_command] = {6, 0, static_cast<GLuint>(indices.size()), static_cast<GLint>(vertices.size()), 0};
+    vertices.insert(vertices.end(), {glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f)});
+    indices.insert(indices.end(), {0, 1, 2, 2, 1, 3});
+
+    glCreateBuffers(1, &sphere_mesh_vertices);
+    glNamedBufferStorage(sphere_mesh_vertices, sizeof(glm::vec3) * vertices.size(), vertices.data(), 0);
+    glCreateBuffers(1, &sphere_mesh_indices);
+    glNamedBufferStorage(sphere_mesh_indices, sizeof(GLuint) * indices.size(), indices.data(), 0);
+
+    // The sphere indices come from the visible list bound to the second binding in raster_snowman.
+    glCreateVertexArrays(1, &sphere_mesh_vao);
+    glVertexArrayVertexBuffer(sphere_mesh_vao, 0, sphere_mesh_vertices, 0, sizeof(glm::vec3));
+    glVertexArrayElementBuffer(sphere_mesh_vao, sphere_mesh_indices);
+    glEnableVertexArrayAttrib(sphere_mesh_vao, 0);
+    glVertexArrayAttribFormat(sphere_mesh_vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(sphere_mesh_vao, 0, 0);
+    glEnableVertexArrayAttrib(sphere_mesh_vao, 1);
+    glVertexArrayAttribIFormat(sphere_mesh_vao, 1, 1, GL_UNSIGNED_INT, 0);
+    glVertexArrayAttribBinding(sphere_mesh_vao, 1, 1);
+    glVertexArrayBindingDivisor(sphere_mesh_vao, 1, 1);
+
+    glCreateBuffers(1, &sphere_draw_commands_template);
+    glNamedBufferStorage(sphere_draw_commands_template, sizeof(commands), commands, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &sphere_draw_commands);
+    glNamedBufferStorage(sphere_draw_commands, sizeof(commands), commands, 0);
+}
+
 void Application::prepare_particles() {
-    // Initialize random number generators
-    std::random_device rd;
-    std::mt19937 gen(rd());
-	std::uniform_int_distribution<> int_dist(0, 2);  // Random light id
-    std::uniform_real_distribution<> real_dist(0.0f, 5000.0f);  // Random delay in ms
+    // The buffer is allocated once for the maximum count and never touched by the CPU, the particles are seeded on the GPU.
+    glCreateBuffers(1, &particle_ssbo);
+    glNamedBufferStorage(particle_ssbo, sizeof(Particle) * max_particle_count, nullptr, 0);
+
+    // Creates the buffers for the compaction and the indirect draw.
+    glCreateBuffers(1, &visible_particles_buffer);
+    glNamedBufferStorage(visible_particles_buffer, sizeof(GLuint) * max_particle_count, nullptr, 0);
+
+    // A quad (a triangle strip of four vertices) per visible particle.
+    const DrawArraysIndirectCommand draw_command = {4, 0, 0, 0};
+    glCreateBuffers(1, &particle_draw_buffer);
+    glNamedBufferStorage(particle_draw_buffer, sizeof(DrawArraysIndirectCommand), &draw_command, GL_DYNAMIC_STORAGE_BIT);
+
+    update_particle_buffer();
+}
+
+void Application::update_particle_buffer() {
+    // Only the newly activated range is initialized, the running particles are kept.
+    if (desired_snow_count > seeded_particle_count) {
+        const int count = desired_snow_count - seeded_particle_count;
+
+        particle_seed_program.use();
+        particle_seed_program.uniform("first_particle", seeded_particle_count);
+        particle_seed_program.uniform("particle_count", count);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_ssbo);
+        glDispatchCompute((count + 255) / 256, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    seeded_particle_count = desired_snow_count;
+}
+
+void Application::apply_arguments(const std::vector<std::string>& arguments) {
+    use_ray_tracing = use_ray_tracing || CommandLine::has_flag(arguments, "--ray-tracing");
+    use_cpu_ray_tracing = use_cpu_ray_tracing || CommandLine::has_flag(arguments, "--cpu-ray-tracing");
+    reflections = glm::clamp(CommandLine::get_int(arguments, "--reflections", reflections), 1, 100);
+    shadow_samples = glm::clamp(CommandLine::get_int(arguments, "--shadow-samples", shadow_samples), 1, 128);
+    corrective_use_ambient_occlusion = corrective_use_ambient_occlusion && !CommandLine::has_flag(arguments, "--no-ao");
+    ambient_occlusion_samples = glm::clamp(CommandLine::get_int(arguments, "--ao-samples", ambient_occlusion_samples), 4, 64);
+    show_particles = show_particles && !CommandLine::has_flag(arguments, "--no-particles");
+    particle_size = CommandLine::get_float(arguments, "--particle-size", particle_size);
+    sphere_light_radius = CommandLine::get_float(arguments, "--light-radius", sphere_light_radius);
+    light_sphere_speed = CommandLine::get_float(arguments, "--light-speed", light_sphere_speed);
+    use_accumulation = use_accumulation && !CommandLine::has_flag(arguments, "--no-accumulation");
+    accumulation_target_samples = glm::clamp(CommandLine::get_int(arguments, "--accumulation-samples", accumulation_target_samples), 1, 4096);
+    use_wavefront_ray_tracing = use_wavefront_ray_tracing || CommandLine::has_flag(arguments, "--wavefront");
+    use_shader_variants = use_shader_variants && !CommandLine::has_flag(arguments, "--no-shader-variants");
+    use_sample_sequences = use_sample_sequences && !CommandLine::has_flag(arguments, "--hash-sampling");
+    use_analytic_visibility = use_analytic_visibility || CommandLine::has_flag(arguments, "--analytic-visibility");
+    use_hybrid_rendering = use_hybrid_rendering || CommandLine::has_flag(arguments, "--hybrid");
+    use_ambient_occlusion_cache = use_ambient_occlusion_cache && !CommandLine::has_flag(arguments, "--no-ao-cache");
+    use_denoiser = use_denoiser || CommandLine::has_flag(arguments, "--denoise");
+    render_scale = glm::clamp(CommandLine::get_float(arguments, "--render-scale", render_scale), min_render_scale, 1.0f);
+    if (CommandLine::has_flag(arguments, "--target-frame-time")) {
+        target_frame_time = glm::max(CommandLine::get_float(arguments, "--target-frame-time", target_frame_time), 1.0f);
+        use_dynamic_resolution = true;
+    }
 
-    // Reserve space for vectors
-    particle_data.resize(max_particle_count);
+    if (CommandLine::has_flag(arguments, "--record")) {
+        capture_path = CommandLine::get_string(arguments, "--record", "capture.txt");
+        capture.emplace();
+    }
 
-    // Populate the light_ids and delays vectors
-    for (int i = 0; i < desired_snow_count; i++) {
-		particle_data[i].light_id = i % 3;
-		particle_data[i].delay = real_dist(gen);
+    if (CommandLine::has_flag(arguments, "--profile-csv")) {
+        profile_csv_path = CommandLine::get_string(arguments, "--profile-csv", profile_csv_path);
+        gpu_profiler.set_recording(true);
+        write_profile_at_exit = true;
+    }
 
-		particle_data[i].position = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
-		particle_data[i].velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-		particle_data[i].color = glm::vec3(1.0f, 1.0f, 1.0f);
+    // The particle count has to be one of the powers of two offered in the UI.
+    const int particles = CommandLine::get_int(arguments, "--particles", desired_snow_count);
+    if (particles != desired_snow_count) {
+        const int exponent = glm::clamp(static_cast<int>(std::round(std::log2(glm::max(particles, 1)))), 8, 23);
+        desired_snow_count = 1 << exponent;
+        update_particle_buffer();
     }
 
-    // Create the particle SSBO
-    glGenBuffers(1, &particle_ssbo);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particle_ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Particle) * desired_snow_count, particle_data.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    const int extra_spheres = glm::clamp(CommandLine::get_int(arguments, "--extra-spheres", extra_spheres_count), 0, 1000000);
+    if (extra_spheres != extra_spheres_count) {
+        extra_spheres_count = extra_spheres;
+        prepare_scene();
+    }
+    if (CommandLine::has_flag(arguments, "--scene")) {
+        load_scene(CommandLine::get_string(arguments, "--scene", ""));
+    }
+    if (CommandLine::has_flag(arguments, "--export-scene")) {
+        export_scene(CommandLine::get_string(arguments, "--export-scene", "scene.pv227scene"));
+    }
 }
 
-void Application::update_particle_buffer() {
+void Application::prepare_scene() {
+    generated_spheres.assign(snowman.spheres, snowman.spheres + snowman_size);
+    generated_materials.assign(snowman.materials, snowman.materials + snowman_size);
+
+    // Scatters the extra spheres on the ground around the snowman, the seed is fixed so the scene is reproducible.
+    std::mt19937 generator(227);
+    std::uniform_real_distribution<float> position_distribution(-38.0f, 38.0f);
+    std::uniform_real_distribution<float> radius_distribution(0.1f, 0.5f);
+    std::uniform_real_distribution<float> material_distribution(0.0f, 1.0f);
+    while (static_cast<int>(generated_spheres.size()) < snowman_size + extra_spheres_count) {
+        const glm::vec2 position = glm::vec2(position_distribution(generator), position_distribution(generator));
+        const float radius = radius_distribution(generator);
+        if (glm::length(position) < 3.0f) continue; // Keeps the snowman free.
+
+        generated_spheres.push_back(glm::vec4(position.x, 0.8f * radius, position.y, radius));
+        generated_materials.push_back(material_distribution(generator) < 0.9f ? snowman.materials[0] : snowman.materials[5]);
+    }
+    static_spheres_count = static_cast<int>(generated_spheres.size());
 
-    // Initialize random number generators
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> int_dist(0, 2);  // Random light id
-    std::uniform_real_distribution<> real_dist(0.0f, 5000.0f);  // Random delay in ms
+    // The light spheres go last, they are placed every frame in update_scene_buffers.
+    for (int i = 0; i < light_count; i++) {
+        generated_spheres.push_back(glm::vec4(0.0f, 0.0f, 0.0f, sphere_light_radius));
+        generated_materials.push_back(snowman.materials[0]);
+    }
 
-    // Populate the light_ids and delays vectors
-    for (int i = 0; i < desired_snow_count; i++) {
-        particle_data[i].light_id = i % 3;
-        particle_data[i].lifetime = real_dist(gen);
-        particle_data[i].delay = particle_data[i].lifetime;
+    scene_file.reset();
+    scene_spheres = generated_spheres.data();
+    scene_materials = generated_materials.data();
+    scene_spheres_count = static_cast<int>(generated_spheres.size());
 
-        particle_data[i].position = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
-        particle_data[i].velocity = glm::vec3(0.0f, 0.0f, 0.0f);
-        particle_data[i].color = glm::vec3(1.0f, 1.0f, 1.0f);
+    const auto start = std::chrono::high_resolution_clock::now();
+    sphere_bvh.build(scene_spheres, scene_spheres_count, static_spheres_count);
+    const auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "BVH over " << scene_spheres_count << " spheres built in "
+              << std::chrono::duration<float, std::milli>(end - start).count() << " ms (" << sphere_bvh.get_nodes().size() << " nodes)."
+              << std::endl;
+
+    upload_scene();
+}
+
+bool Application::load_scene(const std::filesystem::path& path) {
+    const auto start = std::chrono::high_resolution_clock::now();
+    std::optional<SceneFile> file = SceneFile::open(path);
+    if (!file) {
+        return false;
+    }
+
+    // The light spheres are placed by the application, so the file has to reserve exactly their slots.
+    const SceneFileHeader& header = file->get_header();
+    const int sphere_count = static_cast<int>(header.sphere_count);
+    const int static_count = static_cast<int>(header.static_count);
+    SphereBVH bvh;
+    if (sphere_count - static_count != light_count || header.index_count != header.sphere_count ||
+        !bvh.assign(file->get_nodes(), static_cast<int>(header.node_count), file->get_sphere_indices(), sphere_count, static_count)) {
+        std::cerr << "The scene " << path << " does not match the " << light_count << " light spheres of the application." << std::endl;
+        return false;
+    }
+
+    // The hierarchy keeps its own copy for the refitting, the mapped one is not needed anymore.
+    file->release(file->get_nodes(), sizeof(BVHNode) * header.node_count);
+    file->release(file->get_sphere_indices(), sizeof(int32_t) * header.index_count);
+
+    sphere_bvh = std::move(bvh);
+    scene_file = std::move(file);
+    std::vector<glm::vec4>().swap(generated_spheres);
+    std::vector<PBRMaterialData>().swap(generated_materials);
+    scene_spheres = scene_file->get_spheres();
+    scene_materials = scene_file->get_materials();
+    scene_spheres_count = sphere_count;
+    static_spheres_count = static_count;
+
+    upload_scene();
+    const auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Scene " << path << " with " << scene_spheres_count << " spheres loaded in "
+              << std::chrono::duration<float, std::milli>(end - start).count() << " ms." << std::endl;
+    return true;
+}
+
+bool Application::export_scene(const std::filesystem::path& path) const {
+    if (!SceneFile::write(path, scene_spheres, scene_materials, scene_spheres_count, static_spheres_count, sphere_bvh)) {
+        std::cerr << "Could not write the scene " << path << "." << std::endl;
+        return false;
     }
+    std::cout << "The scene with " << scene_spheres_count << " spheres was written into " << path << "." << std::endl;
+    return true;
+}
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, particle_ssbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Particle) * desired_snow_count, particle_data.data(), GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+void Application::upload_scene() {
+    // The buffers are immutable, so we have to create new ones. They are filled in chunks, so a mapped scene never has
+    // more than one chunk of its spheres in memory besides the copy in the driver.
+    const auto create_buffer = [&](GLuint& buffer, const void* data, size_t size) {
+        glDeleteBuffers(1, &buffer);
+        glCreateBuffers(1, &buffer);
+        glNamedBufferStorage(buffer, static_cast<GLsizeiptr>(size), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t offset = 0; offset < size; offset += scene_upload_chunk_size) {
+            const size_t length = std::min(scene_upload_chunk_size, size - offset);
+            glNamedBufferSubData(buffer, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(length), bytes + offset);
+            if (scene_file) {
+                scene_file->release(bytes + offset, length);
+            }
+        }
+    };
+    create_buffer(scene_spheres_buffer, scene_spheres, sizeof(glm::vec4) * scene_spheres_count);
+    create_buffer(scene_materials_buffer, scene_materials, sizeof(PBRMaterialData) * scene_spheres_count);
+    create_buffer(bvh_nodes_buffer, sphere_bvh.get_nodes().data(), sizeof(BVHNode) * sphere_bvh.get_nodes().size());
+    create_buffer(bvh_indices_buffer, sphere_bvh.get_sphere_indices().data(), sizeof(int32_t) * sphere_bvh.get_sphere_indices().size());
+
+    // Every draw command has its own list of visible spheres, the commands start the instances at its beginning.
+    const GLsizeiptr capacity = static_cast<GLsizeiptr>(scene_spheres_count);
+    glDeleteBuffers(1, &visible_spheres_buffer);
+    glCreateBuffers(1, &visible_spheres_buffer);
+    glNamedBufferStorage(visible_spheres_buffer, sizeof(GLuint) * capacity * sphere_command_count, nullptr, 0);
+    for (int command = 0; command < sphere_command_count; command++) {
+        const GLuint base_instance = static_cast<GLuint>(command * capacity);
+        glNamedBufferSubData(sphere_draw_commands_template,
+                             sizeof(DrawElementsIndirectCommand) * command + offsetof(DrawElementsIndirectCommand, base_instance), sizeof(GLuint),
+                             &base_instance);
+    }
+
+    // The snowman is the only part of the static scene that may change, the baked occlusion is checked against it.
+    ambient_occlusion_cache.reset(scene_spheres, static_spheres_count, std::min(snowman_size, static_spheres_count), analytic_occlusion_range);
+    accumulation_key.reset();
+}
+
+void Application::update_scene_buffers() {
+    std::vector<int> moved;
+    for (int i = 0; i < light_count; i++) {
+        scene_spheres[static_spheres_count + i] = snowman.spheres[snowman_size + i];
+        scene_materials[static_spheres_count + i] = snowman.materials[snowman_size + i];
+        moved.push_back(static_spheres_count + i);
+    }
+    upload_ring.upload(scene_spheres_buffer, sizeof(glm::vec4) * static_spheres_count, sizeof(glm::vec4) * light_count,
+                       &scene_spheres[static_spheres_count]);
+    upload_ring.upload(scene_materials_buffer, sizeof(PBRMaterialData) * static_spheres_count, sizeof(PBRMaterialData) * light_count,
+                       &scene_materials[static_spheres_count]);
+
+    // Only the light subtree and the root change, the nodes are uploaded in contiguous runs.
+    const std::vector<int> changed = sphere_bvh.refit(scene_spheres, moved);
+    const std::vector<BVHNode>& nodes = sphere_bvh.get_nodes();
+    for (size_t begin = 0; begin < changed.size();) {
+        size_t end = begin + 1;
+        while (end < changed.size() && changed[end] == changed[end - 1] + 1) {
+            end++;
+        }
+        upload_ring.upload(bvh_nodes_buffer, sizeof(BVHNode) * changed[begin], sizeof(BVHNode) * (end - begin), &nodes[changed[begin]]);
+        begin = end;
+    }
 }
 
-void Application::prepare_scene() { 
-    snowman_ubo = SnowmanUBO(snowman, GL_DYNAMIC_STORAGE_BIT);
+void Application::prepare_framebuffers() { resize_fullscreen_textures(); }
+
+void Application::prepare_wavefront_queues() {
+    // Every pixel of a wavefront has at most one ray in each queue.
+    glCreateBuffers(2, wavefront_ray_queues);
+    for (const GLuint queue : wavefront_ray_queues) {
+        glNamedBufferStorage(queue, wavefront_queue_header_size + static_cast<GLsizeiptr>(wavefront_size) * wavefront_ray_size, nullptr, 0);
+    }
+    glCreateBuffers(1, &wavefront_shadow_queue);
+    glNamedBufferStorage(wavefront_shadow_queue, wavefront_queue_header_size + static_cast<GLsizeiptr>(wavefront_size) * sizeof(GLuint), nullptr, 0);
 }
 
-void Application::prepare_framebuffers() {}
+void Application::resize_fullscreen_textures() {
+    if (width == 0 || height == 0) {
+        return; // The window is minimized.
+    }
+
+    // The textures are immutable, so we have to create new ones.
+    glDeleteTextures(1, &cpu_color_texture);
+    glDeleteTextures(1, &cpu_depth_texture);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &cpu_color_texture);
+    glTextureStorage2D(cpu_color_texture, 1, GL_RGBA32F, width, height);
+    TextureUtils::set_texture_2d_parameters(cpu_color_texture, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &cpu_depth_texture);
+    glTextureStorage2D(cpu_depth_texture, 1, GL_R32F, width, height);
+    TextureUtils::set_texture_2d_parameters(cpu_depth_texture, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+
+    // The accumulation target, its content is invalid after the resize so the accumulation restarts.
+    glDeleteFramebuffers(1, &accumulation_framebuffer);
+    glDeleteTextures(1, &accumulation_color_texture);
+    glDeleteTextures(1, &accumulation_unshadowed_texture);
+    glDeleteTextures(1, &accumulation_visibility_texture);
+    glDeleteTextures(1, &accumulation_depth_texture);
+
+    for (GLuint* texture : {&accumulation_color_texture, &accumulation_unshadowed_texture, &accumulation_visibility_texture}) {
+        glCreateTextures(GL_TEXTURE_2D, 1, texture);
+        glTextureStorage2D(*texture, 1, GL_RGBA32F, width, height);
+        TextureUtils::set_texture_2d_parameters(*texture, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+    }
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &accumulation_depth_texture);
+    glTextureStorage2D(accumulation_depth_texture, 1, GL_DEPTH_COMPONENT32F, width, height);
+    TextureUtils::set_texture_2d_parameters(accumulation_depth_texture, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
 
-void Application::resize_fullscreen_textures() {}
+    glCreateFramebuffers(1, &accumulation_framebuffer);
+    glNamedFramebufferTexture(accumulation_framebuffer, GL_COLOR_ATTACHMENT0, accumulation_color_texture, 0);
+    glNamedFramebufferTexture(accumulation_framebuffer, GL_DEPTH_ATTACHMENT, accumulation_depth_texture, 0);
+    glNamedFramebufferDrawBuffer(accumulation_framebuffer, GL_COLOR_ATTACHMENT0);
+    accumulation_key.reset();
+
+    // The visibility buffer of the hybrid rendering, like the accumulation only its bottom-left part is used when the render scale is below one.
+    glDeleteFramebuffers(1, &visibility_framebuffer);
+    glDeleteTextures(1, &visibility_sphere_texture);
+    glDeleteTextures(1, &visibility_depth_texture);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &visibility_sphere_texture);
+    glTextureStorage2D(visibility_sphere_texture, 1, GL_R32UI, width, height);
+    TextureUtils::set_texture_2d_parameters(visibility_sphere_texture, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &visibility_depth_texture);
+    glTextureStorage2D(visibility_depth_texture, 1, GL_DEPTH_COMPONENT32F, width, height);
+
+    glCreateFramebuffers(1, &visibility_framebuffer);
+    glNamedFramebufferTexture(visibility_framebuffer, GL_COLOR_ATTACHMENT0, visibility_sphere_texture, 0);
+    glNamedFramebufferTexture(visibility_framebuffer, GL_DEPTH_ATTACHMENT, visibility_depth_texture, 0);
+    glNamedFramebufferDrawBuffer(visibility_framebuffer, GL_COLOR_ATTACHMENT0);
+
+    // The image of the wavefront ray tracer.
+    glDeleteBuffers(1, &wavefront_pixels_buffer);
+    glCreateBuffers(1, &wavefront_pixels_buffer);
+    glNamedBufferStorage(wavefront_pixels_buffer, static_cast<GLsizeiptr>(width) * height * 3 * sizeof(glm::vec4), nullptr, 0);
+
+    // The images of the denoiser, its history is lost as well.
+    denoiser.resize(width, height);
+}
 
 // ----------------------------------------------------------------------------
 // Update
@@ -209,13 +631,31 @@ glm::vec3 Application::HSVtoRGB(float h, float s, float v) {
 void Application::update(float delta) {
     PV227Application::update(delta);
 
+    // Uploads the textures that have finished loading in the background.
+    asset_loader.update();
+
+    // Waits only if the GPU is more than two frames behind.
+    upload_ring.begin_frame();
+
     // Updates the main camera.
-    const glm::vec3 eye_position = camera.get_eye_position();
-    camera_ubo.set_view(lookAt(eye_position, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
-    camera_ubo.update_opengl_data();
+    eye_position = scripted_eye_position.value_or(camera.get_eye_position());
+    view_matrix = lookAt(eye_position, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const glm::mat3 view_it = glm::transpose(glm::inverse(glm::mat3(view_matrix)));
+    camera_data.view = view_matrix;
+    camera_data.view_inv = glm::inverse(view_matrix);
+    for (int i = 0; i < 3; i++) {
+        camera_data.view_it[i] = glm::vec4(view_it[i], 0.0f);
+    }
+    camera_data.eye_position = eye_position;
+    upload_ring.upload_changes(camera_buffer, &camera_data, sizeof(CameraBufferData), camera_uploaded, sizeof(glm::mat4));
 
-    float app_time_s = (float)elapsed_time * (light_sphere_speed / 10000);
+    scene_time = scripted_time.value_or(elapsed_time);
+    if (capture) {
+        capture->add_frame(scene_time, eye_position, get_settings());
+    }
+    float app_time_s = (float)scene_time * (light_sphere_speed / 10000);
     t_delta = delta;
+    particle_time_accumulator += delta;
 
     // Updates lights
     phong_lights_ubo.clear();
@@ -237,19 +677,23 @@ void Application::update(float delta) {
         snowman.materials[i + snowman_size] = light_pbr_material;
     }
 
-    snowman_ubo = SnowmanUBO(snowman, GL_DYNAMIC_STORAGE_BIT);
-    phong_lights_ubo.update_opengl_data();
+    update_scene_buffers();
+
+    for (int i = 0; i < light_count; i++) {
+        lights_data.lights[i] = phong_lights_ubo.get_light(i);
+    }
+    upload_ring.upload_changes(lights_buffer, &lights_data, sizeof(LightsBufferData), lights_uploaded, 16);
 }
 
 // ----------------------------------------------------------------------------
 // Render
 // ----------------------------------------------------------------------------
 void Application::render() {
-    // Starts measuring the elapsed time.
-    glBeginQuery(GL_TIME_ELAPSED, render_time_query);
+    // Starts measuring the elapsed time, the results are read back a few frames later.
+    gpu_profiler.begin_frame();
 
-    // Binds the main window framebuffer.
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Binds the output framebuffer (the main window unless rendering offline).
+    glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
     glViewport(0, 0, width, height);
 
     // Clears the framebuffer color.
@@ -258,53 +702,80 @@ void Application::render() {
     glEnable(GL_DEPTH_TEST);
 
     // Binds the the camera and the lights buffers.
-    camera_ubo.bind_buffer_base(CameraUBO::DEFAULT_CAMERA_BINDING);
-    phong_lights_ubo.bind_buffer_base(PhongLightsUBO::DEFAULT_LIGHTS_BINDING);
+    glBindBufferBase(GL_UNIFORM_BUFFER, CameraUBO::DEFAULT_CAMERA_BINDING, camera_buffer);
+    glBindBufferBase(GL_UNIFORM_BUFFER, PhongLightsUBO::DEFAULT_LIGHTS_BINDING, lights_buffer);
 
     if (use_ray_tracing) {
-		ray_trace_snowman();
+        if (compare_ray_tracers) {
+            compare_cpu_and_gpu_ray_tracing();
+            compare_ray_tracers = false;
+        }
+
+        if (use_cpu_ray_tracing) {
+            gpu_profiler.begin_scope("cpu_ray_trace_snowman");
+            cpu_ray_trace_snowman();
+            gpu_profiler.end_scope();
+        } else {
+            gpu_profiler.begin_scope("ray_trace_snowman");
+            accumulate_ray_tracing();
+            gpu_profiler.end_scope();
+        }
     }
     else {
+        gpu_profiler.begin_scope("raster_snowman");
         raster_snowman();
+        gpu_profiler.end_scope();
     }
 
+    gpu_profiler.begin_scope("simulate_particles");
+    simulate_particles();
+    gpu_profiler.end_scope();
+
+    gpu_profiler.begin_scope("render_particles");
     render_particles();
+    gpu_profiler.end_scope();
 
     // Resets the VAO and the program.
     glBindVertexArray(0);
     glUseProgram(0);
 
     // Stops measuring the elapsed time.
-    glEndQuery(GL_TIME_ELAPSED);
+    gpu_profiler.end_frame();
 
-    // Waits for OpenGL - don't forget OpenGL is asynchronous.
-    glFinish();
+    // Fences the uploads of the frame, there is no glFinish so the CPU can record the next frames while the GPU renders.
+    upload_ring.end_frame();
 
-    // Evaluates the query.
-    GLuint64 render_time;
-    glGetQueryObjectui64v(render_time_query, GL_QUERY_RESULT, &render_time);
-    fps_gpu = 1000.f / (static_cast<float>(render_time) * 1e-6f);
+    const GpuProfiler::Statistics frame_statistics = gpu_profiler.get_statistics(GpuProfiler::frame_scope);
+    if (frame_statistics.samples > 0) {
+        fps_gpu = 1000.f / frame_statistics.last;
+    }
 }
 
-void Application::ray_trace_snowman() {
+void Application::ray_trace_snowman() { trace_full_screen(shadow_samples, ambient_occlusion_samples); }
+
+void Application::trace_full_screen(int shadow_count, int ao_count, int shadow_offset, int ao_offset, bool split_visibility) {
     // We do not need depth and depth test.
     // Enable depth testing with always pass for full-screen quad.
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_ALWAYS); // Always pass the depth test for ray tracing.
 
-    // Uses the proper program.
-    ray_tracing_program.use();
-    ray_tracing_program.uniform("resolution", glm::vec2(width, height));
-    ray_tracing_program.uniform("spheres_count", static_cast<int>(snowman_size + light_count));
-    ray_tracing_program.uniform("iterations", reflections);
-	ray_tracing_program.uniform("sphere_light_radius", sphere_light_radius);
-	ray_tracing_program.uniform("shadow_samples", shadow_samples);
-	ray_tracing_program.uniform("time", (float)elapsed_time * 0.001f);
-    ray_tracing_program.uniform("use_ambient_occlusion", corrective_use_ambient_occlusion);
-	ray_tracing_program.uniform("ambient_occlusion_samples", ambient_occlusion_samples);
-
-	// Binds the snowman.
-    snowman_ubo.bind_buffer_base(3);
+    // Uses the variant specialized for the current settings, or the generic program until the variant is built.
+    const auto set_uniforms = [&](auto& program) {
+        program.use();
+        program.uniform("resolution", glm::vec2(width, height));
+        program.uniform("time", (float)scene_time * 0.001f);
+        set_ray_tracing_uniforms(program, shadow_count, ao_count, shadow_offset, ao_offset);
+        program.uniform("use_visibility_buffer", use_hybrid_rendering);
+        program.uniform("use_denoiser", use_denoiser);
+        program.uniform("use_split_visibility", split_visibility);
+    };
+    glBindTextureUnit(4, visibility_sphere_texture);
+    GpuProgram* variant = use_shader_variants ? ray_tracing_variants.get(get_ray_tracing_defines(shadow_count, ao_count)) : nullptr;
+    if (variant) {
+        set_uniforms(*variant);
+    } else {
+        set_uniforms(ray_tracing_program);
+    }
 
     // Renders the full screen quad to evaluate every pixel.
     // Binds an empty VAO as we do not need any state.
@@ -315,52 +786,652 @@ void Application::ray_trace_snowman() {
 	glDepthFunc(GL_LESS); // Restore the depth function.
 }
 
-void Application::raster_snowman() {
-    int id = 0;
-    // Renders the snowman
-    for (glm::vec4 sph : snowman.spheres) {
-        default_lit_program.use();
+// ----------------------------------------------------------------------------
+// Capture and Replay
+// ----------------------------------------------------------------------------
+std::vector<Application::SettingBinding> Application::get_setting_bindings() {
+    return {{"use_ray_tracing", &use_ray_tracing},
+            {"use_cpu_ray_tracing", &use_cpu_ray_tracing},
+            {"reflections", &reflections},
+            {"shadow_samples", &shadow_samples},
+            {"use_ambient_occlusion", &corrective_use_ambient_occlusion},
+            {"ambient_occlusion_samples", &ambient_occlusion_samples},
+            {"particle_count", &desired_snow_count},
+            {"show_particles", &show_particles},
+            {"particle_size", &particle_size},
+            {"light_sphere_speed", &light_sphere_speed},
+            {"sphere_light_radius", &sphere_light_radius},
+            {"extra_spheres", &extra_spheres_count},
+            {"use_wavefront_ray_tracing", &use_wavefront_ray_tracing},
+            {"use_shader_variants", &use_shader_variants},
+            {"use_sample_sequences", &use_sample_sequences},
+            {"use_analytic_visibility", &use_analytic_visibility},
+            {"analytic_occlusion_range", &analytic_occlusion_range},
+            {"use_hybrid_rendering", &use_hybrid_rendering},
+            {"use_ambient_occlusion_cache", &use_ambient_occlusion_cache},
+            {"ambient_occlusion_bake_budget", &ambient_occlusion_bake_budget},
+            {"use_denoiser", &use_denoiser},
+            {"denoiser_iterations", &denoiser_iterations},
+            {"use_accumulation", &use_accumulation},
+            {"accumulation_samples_per_frame", &accumulation_samples_per_frame},
+            {"accumulation_target_samples", &accumulation_target_samples},
+            {"use_dynamic_resolution", &use_dynamic_resolution},
+            {"target_frame_time", &target_frame_time},
+            {"render_scale", &render_scale}};
+}
+
+SettingList Application::get_settings() {
+    SettingList settings;
+    for (const auto& [name, binding] : get_setting_bindings()) {
+        std::ostringstream value;
+        // The floats are written with all their digits, so set_setting restores exactly the same value.
+        value << std::setprecision(std::numeric_limits<float>::max_digits10);
+        std::visit([&](auto* variable) { value << *variable; }, binding);
+        settings.emplace_back(name, value.str());
+    }
+    return settings;
+}
+
+void Application::set_setting(const std::string& name, const std::string& value) {
+    for (const auto& [binding_name, binding] : get_setting_bindings()) {
+        if (name != binding_name) continue;
+
+        const int particles = desired_snow_count;
+        const int extra_spheres = extra_spheres_count;
+        std::istringstream stream(value);
+        std::visit([&](auto* variable) { stream >> *variable; }, binding);
+
+        // The settings with resources behind them are applied like in the UI.
+        if (desired_snow_count != particles) {
+            desired_snow_count = glm::clamp(desired_snow_count, 256, max_particle_count);
+            update_particle_buffer();
+        }
+        if (extra_spheres_count != extra_spheres) {
+            prepare_scene();
+        }
+        return;
+    }
+    std::cerr << "Unknown setting '" << name << "'." << std::endl;
+}
+
+void Application::reset_simulation_state() {
+    seeded_particle_count = 0;
+    update_particle_buffer();
+    particle_time_accumulator = 0;
+    accumulation_key.reset();
+    denoiser.reset();
+    sample_frame = 0;
+}
+
+ShaderDefines Application::get_ray_tracing_defines(int shadow_count, int ao_count) const {
+    return {{"STATIC_SPHERES_COUNT", std::to_string(static_spheres_count)},
+            {"ITERATIONS", std::to_string(reflections)},
+            {"SHADOW_SAMPLES", std::to_string(shadow_count)},
+            {"USE_AMBIENT_OCCLUSION", corrective_use_ambient_occlusion ? "true" : "false"},
+            {"AMBIENT_OCCLUSION_SAMPLES", std::to_string(ao_count)},
+            {"USE_SAMPLE_SEQUENCES", use_sample_sequences ? "true" : "false"},
+            {"USE_ANALYTIC_VISIBILITY", use_analytic_visibility ? "true" : "false"},
+            {"USE_VISIBILITY_BUFFER", use_hybrid_rendering ? "true" : "false"},
+            {"USE_DENOISER", use_denoiser ? "true" : "false"}};
+}
+
+template <typename Program>
+void Application::set_ray_tracing_uniforms(Program& program, int shadow_count, int ao_count, int shadow_offset, int ao_offset) {
+    program.uniform("static_spheres_count", static_spheres_count);
+    program.uniform("bvh_static_root", sphere_bvh.get_static_root());
+    program.uniform("bvh_static_end", sphere_bvh.get_static_end());
+    program.uniform("iterations", reflections);
+	program.uniform("sphere_light_radius", sphere_light_radius);
+	program.uniform("shadow_samples", shadow_count);
+	program.uniform("shadow_sample_offset", shadow_offset);
+    program.uniform("use_ambient_occlusion", corrective_use_ambient_occlusion);
+	program.uniform("ambient_occlusion_samples", ao_count);
+	program.uniform("ambient_occlusion_sample_offset", ao_offset);
+	program.uniform("use_sample_sequences", use_sample_sequences);
+	program.uniform("sample_frame", sample_frame);
+	program.uniform("use_analytic_visibility", use_analytic_visibility);
+	program.uniform("analytic_occlusion_range", analytic_occlusion_range);
+	program.uniform("use_ambient_occlusion_cache", use_ambient_occlusion_cache);
+	program.uniform("ambient_occlusion_cache_capacity", AmbientOcclusionCache::capacity);
+	program.uniform("ambient_occlusion_tiles_per_row", AmbientOcclusionCache::tiles_per_row);
+	sampler.bind(2, 3);
+	ambient_occlusion_cache.bind(5, 6);
+
+	// Binds the spheres and the BVH over them.
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, scene_spheres_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, scene_materials_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, bvh_nodes_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, bvh_indices_buffer);
+}
+
+void Application::trace_wavefront(glm::ivec2 resolution, int shadow_count, int ao_count, int shadow_offset, int ao_offset) {
+    // The stages of wavefront_ray_tracing.comp.
+    enum Stage { GENERATE = 0, BEGIN_BOUNCE = 1, INTERSECT = 2, SHADE = 3, BEGIN_SHADOWS = 4, SHADOW = 5 };
+    // The offset of the DispatchIndirectCommand in the header of a queue.
+    constexpr GLintptr dispatch_offset = 16;
+    const GLbitfield barriers = GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT;
+
+    wavefront_program.use();
+    wavefront_program.uniform("resolution", glm::vec2(resolution.x, resolution.y));
+    set_ray_tracing_uniforms(wavefront_program, shadow_count, ao_count, shadow_offset, ao_offset);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, wavefront_shadow_queue);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, wavefront_pixels_buffer);
+
+    const int pixel_count = resolution.x * resolution.y;
+    for (int pixel_offset = 0; pixel_offset < pixel_count; pixel_offset += wavefront_size) {
+        const int wavefront_pixels = std::min(wavefront_size, pixel_count - pixel_offset);
+        wavefront_program.uniform("pixel_offset", pixel_offset);
+        wavefront_program.uniform("pixel_count", wavefront_pixels);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, wavefront_ray_queues[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, wavefront_ray_queues[1]);
+        wavefront_program.uniform("stage", static_cast<int>(GENERATE));
+        glDispatchCompute((wavefront_pixels + 255) / 256, 1, 1);
+        glMemoryBarrier(barriers);
+
+        // The number of bounces is not read back, the dispatches of the empty queues have zero work groups. The shade
+        // stage only queues reflections while bounce + 1 < reflections, so the last bounce leaves the output queue empty.
+        for (int bounce = 0; bounce < reflections; bounce++) {
+            const GLuint input_queue = wavefront_ray_queues[bounce % 2];
+            const GLuint output_queue = wavefront_ray_queues[(bounce + 1) % 2];
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, input_queue);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, output_queue);
+            wavefront_program.uniform("bounce", bounce);
+
+            wavefront_program.uniform("stage", static_cast<int>(BEGIN_BOUNCE));
+            glDispatchCompute(1, 1, 1);
+            glMemoryBarrier(barriers);
+
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, input_queue);
+            wavefront_program.uniform("stage", static_cast<int>(INTERSECT));
+            glDispatchComputeIndirect(dispatch_offset);
+            glMemoryBarrier(barriers);
+
+            wavefront_program.uniform("stage", static_cast<int>(SHADE));
+            glDispatchComputeIndirect(dispatch_offset);
+            glMemoryBarrier(barriers);
+
+            wavefront_program.uniform("stage", static_cast<int>(BEGIN_SHADOWS));
+            glDispatchCompute(1, 1, 1);
+            glMemoryBarrier(barriers);
+
+            glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, wavefront_shadow_queue);
+            wavefront_program.uniform("stage", static_cast<int>(SHADOW));
+            glDispatchComputeIndirect(dispatch_offset);
+            glMemoryBarrier(barriers);
+        }
+    }
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+    // Writes the traced image into the framebuffer, with the same depth as the fragment path.
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_ALWAYS);
+
+    wavefront_resolve_program.use();
+    wavefront_resolve_program.uniform("resolution", glm::vec2(resolution.x, resolution.y));
+    glBindVertexArray(empty_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glDepthFunc(GL_LESS);
+}
 
-        ModelUBO model_ubo(translate(glm::mat4(1.0f), glm::vec3(sph)) * scale(glm::mat4(1.0f), glm::vec3(sph.w)));
+void Application::update_ambient_occlusion_cache(int budget) {
+    ambient_occlusion_cache.update(scene_spheres, analytic_occlusion_range);
+    if (ambient_occlusion_cache.get_pending_count() == 0) {
+        return;
+    }
+
+    // The tiles are baked against the static subtree, like the sampled occlusion.
+    ambient_occlusion_bake_program.use();
+    ambient_occlusion_bake_program.uniform("bvh_static_root", sphere_bvh.get_static_root());
+    ambient_occlusion_bake_program.uniform("bvh_static_end", sphere_bvh.get_static_end());
+    sampler.bind(2, 3);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, scene_spheres_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, bvh_nodes_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, bvh_indices_buffer);
+    ambient_occlusion_cache.bake(ambient_occlusion_bake_program, upload_ring, budget);
+}
+
+void Application::finish_ambient_occlusion_cache() {
+    if (!use_ray_tracing || !use_ambient_occlusion_cache || !corrective_use_ambient_occlusion) {
+        return;
+    }
+    do {
+        update_ambient_occlusion_cache(AmbientOcclusionCache::max_jobs);
+    } while (ambient_occlusion_cache.get_pending_count() > 0);
+}
+
+void Application::accumulate_ray_tracing() {
+    update_render_scale();
+
+    // The baked tiles change the image, so they are added before the accumulation key is taken.
+    if (use_ambient_occlusion_cache && corrective_use_ambient_occlusion) {
+        gpu_profiler.begin_scope("ambient_occlusion_cache");
+        update_ambient_occlusion_cache(ambient_occlusion_bake_budget);
+        gpu_profiler.end_scope();
+    }
+
+    // Without the accumulation, every frame simply starts anew. The denoiser integrates the frames itself, it reprojects
+    // them, so the image follows the camera and the lights instead of restarting.
+    const bool denoise = use_denoiser && !use_wavefront_ray_tracing;
+    if (!denoise) {
+        denoiser.reset();
+    }
+    const AccumulationKey key = get_accumulation_key();
+    if (!use_accumulation || denoise || !accumulation_key || !(*accumulation_key == key)) {
+        accumulation_key = key;
+        accumulated_shadow_samples = 0;
+        accumulated_ambient_occlusion_samples = 0;
+    }
+
+    // The first frame uses the full sample counts, so a moving scene looks as without the accumulation. The following frames
+    // add a few samples each until both targets are reached, after that the image is only displayed. The analytic visibility
+    // has no noise, so its first frame is already converged.
+    if (use_analytic_visibility && accumulated_shadow_samples > 0) {
+        accumulated_shadow_samples = std::max(accumulated_shadow_samples, accumulation_target_samples);
+        accumulated_ambient_occlusion_samples = std::max(accumulated_ambient_occlusion_samples, accumulation_target_samples);
+    }
+    const bool first_frame = accumulated_shadow_samples == 0;
+    consecutive_full_frames = first_frame ? consecutive_full_frames + 1 : 0;
+    if (first_frame) {
+        sample_frame++; // A new rotation of the sequences, the accumulated frames keep it to stay stratified.
+    }
+    if (first_frame || accumulated_shadow_samples < accumulation_target_samples || accumulated_ambient_occlusion_samples < accumulation_target_samples) {
+        const int shadow_count = first_frame ? shadow_samples : accumulation_samples_per_frame;
+        const int ao_count = first_frame ? ambient_occlusion_samples : accumulation_samples_per_frame;
+
+        // The running averages weighted by the number of samples: new = old * (1 - alpha) + frame * alpha. The shadows and
+        // the occlusion of the primary hits are averaged apart (see use_split_visibility in ray_tracing.frag), each with the
+        // weight of its own samples: the blend constant holds the shadow weight in rgb and the occlusion weight in alpha.
+        // The rest of the color (the reflections and the visible lights) follows the shadow samples.
+        const float shadow_alpha = static_cast<float>(shadow_count) / static_cast<float>(accumulated_shadow_samples + shadow_count);
+        const float ao_alpha = static_cast<float>(ao_count) / static_cast<float>(accumulated_ambient_occlusion_samples + ao_count);
+        // Only the bottom-left part of the target is traced when the render scale is below one.
+        const glm::ivec2 scaled_resolution = get_scaled_resolution();
+
+        // The visible spheres only change when the accumulation restarts, the refining frames reuse the buffer.
+        const bool hybrid = use_hybrid_rendering && !use_wavefront_ray_tracing;
+        if (hybrid && first_frame) {
+            gpu_profiler.begin_scope("visibility_buffer");
+            render_visibility_buffer(scaled_resolution);
+            gpu_profiler.end_scope();
+        }
 
-        // Handles the textures.
-        default_lit_program.uniform("has_texture", false);
-        glBindTextureUnit(0, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, accumulation_framebuffer);
+        glViewport(0, 0, scaled_resolution.x, scaled_resolution.y);
+        glEnable(GL_BLEND);
+        glBlendColor(shadow_alpha, shadow_alpha, shadow_alpha, ao_alpha);
+        glBlendFunc(GL_CONSTANT_COLOR, GL_ONE_MINUS_CONSTANT_COLOR);
 
-        // Note that the materials are hard-coded here since the default lit shader works with PhongMaterial not PBRMaterial as defined in
-        // snowman.
-        if (id < 5) {
-            white_material_ubo.bind_buffer_base(PhongMaterialUBO::DEFAULT_MATERIAL_BINDING);
+        if (denoise) {
+            denoiser.attach(accumulation_framebuffer);
+            trace_full_screen(shadow_count, ao_count, accumulated_shadow_samples, accumulated_ambient_occlusion_samples, true);
+            Denoiser::detach(accumulation_framebuffer);
         } else {
-            black_material_ubo.bind_buffer_base(PhongMaterialUBO::DEFAULT_MATERIAL_BINDING);
+            // The denoiser shares the framebuffer, so the split visibility targets are attached again every frame.
+            glNamedFramebufferTexture(accumulation_framebuffer, GL_COLOR_ATTACHMENT1, accumulation_unshadowed_texture, 0);
+            glNamedFramebufferTexture(accumulation_framebuffer, GL_COLOR_ATTACHMENT2, accumulation_visibility_texture, 0);
+            const GLenum draw_buffers[3] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2};
+            glNamedFramebufferDrawBuffers(accumulation_framebuffer, 3, draw_buffers);
+            if (use_wavefront_ray_tracing) {
+                trace_wavefront(scaled_resolution, shadow_count, ao_count, accumulated_shadow_samples, accumulated_ambient_occlusion_samples);
+            } else {
+                trace_full_screen(shadow_count, ao_count, accumulated_shadow_samples, accumulated_ambient_occlusion_samples, true);
+            }
+            glNamedFramebufferDrawBuffer(accumulation_framebuffer, GL_COLOR_ATTACHMENT0);
         }
-        model_ubo.bind_buffer_base(ModelUBO::DEFAULT_MODEL_BINDING);
-        sphere.bind_vao();
-        sphere.draw();
-        id++;
 
-		if (id == snowman_size) {
-			break;
-		}
+        glDisable(GL_BLEND);
+        if (denoise) {
+            gpu_profiler.begin_scope("denoise");
+            denoise_ray_tracing(scaled_resolution);
+            gpu_profiler.end_scope();
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+        glViewport(0, 0, width, height);
+
+        accumulated_shadow_samples += shadow_count;
+        accumulated_ambient_occlusion_samples += ao_count;
     }
 
-    // Renders the lights.
-    for (int i = 0; i < 3; i++) {
-        default_unlit_program.use();
+    // Upscales the average to the window, the depth keeps the particles behind the snowman hidden.
+    const glm::ivec2 scaled_resolution = get_scaled_resolution();
+    glDepthFunc(GL_ALWAYS);
+
+    upscale_program.use();
+    upscale_program.uniform("source_size", glm::vec2(scaled_resolution.x, scaled_resolution.y));
+    upscale_program.uniform("scale", glm::vec2(static_cast<float>(scaled_resolution.x) / width, static_cast<float>(scaled_resolution.y) / height));
+    upscale_program.uniform("use_split_visibility", !denoise);
+    glBindTextureUnit(0, denoise ? denoised_texture : accumulation_color_texture);
+    glBindTextureUnit(1, accumulation_depth_texture);
+    glBindTextureUnit(2, accumulation_unshadowed_texture);
+    glBindTextureUnit(3, accumulation_visibility_texture);
+
+    glBindVertexArray(empty_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glDepthFunc(GL_LESS);
+}
+
+void Application::denoise_ray_tracing(glm::ivec2 scaled_resolution) {
+    DenoiserFrame frame = {};
+    frame.view_projection = projection_matrix * view_matrix;
+    frame.eye_position = eye_position;
+    for (int i = 0; i < light_count; i++) {
+        frame.light_positions[i] = glm::vec3(scene_spheres[static_spheres_count + i]);
+    }
+    frame.resolution = scaled_resolution;
+
+    glBindVertexArray(empty_vao);
+    denoised_texture = denoiser.denoise(denoise_temporal_program, denoise_atrous_program, denoise_composite_program, accumulation_color_texture,
+                                        frame, glm::clamp(denoiser_iterations, 1, Denoiser::max_iterations), sphere_light_radius);
+}
+
+bool AccumulationKey::operator==(const AccumulationKey& other) const {
+    return view == other.view && projection == other.projection &&
+           std::equal(std::begin(light_spheres), std::end(light_spheres), std::begin(other.light_spheres)) &&
+           std::equal(std::begin(light_colors), std::end(light_colors), std::begin(other.light_colors)) &&
+           static_spheres_count == other.static_spheres_count && reflections == other.reflections && shadow_samples == other.shadow_samples &&
+           ambient_occlusion_samples == other.ambient_occlusion_samples && use_ambient_occlusion == other.use_ambient_occlusion &&
+           use_sample_sequences == other.use_sample_sequences && use_analytic_visibility == other.use_analytic_visibility &&
+           use_hybrid_rendering == other.use_hybrid_rendering && use_denoiser == other.use_denoiser &&
+           analytic_occlusion_range == other.analytic_occlusion_range && ambient_occlusion_cache_version == other.ambient_occlusion_cache_version &&
+           width == other.width && height == other.height;
+}
+
+AccumulationKey Application::get_accumulation_key() const {
+    AccumulationKey key = {};
+    key.view = view_matrix;
+    key.projection = projection_matrix;
+    for (int i = 0; i < light_count; i++) {
+        key.light_spheres[i] = scene_spheres[static_spheres_count + i];
+        key.light_colors[i] = scene_materials[static_spheres_count + i].diffuse;
+    }
+    key.static_spheres_count = static_spheres_count;
+    key.reflections = reflections;
+    key.shadow_samples = shadow_samples;
+    key.ambient_occlusion_samples = ambient_occlusion_samples;
+    key.use_ambient_occlusion = corrective_use_ambient_occlusion;
+    key.use_sample_sequences = use_sample_sequences;
+    key.use_analytic_visibility = use_analytic_visibility;
+    key.use_hybrid_rendering = use_hybrid_rendering;
+    key.use_denoiser = use_denoiser;
+    key.analytic_occlusion_range = analytic_occlusion_range;
+    key.ambient_occlusion_cache_version = use_ambient_occlusion_cache ? ambient_occlusion_cache.get_version() : 0;
+    const glm::ivec2 scaled_resolution = get_scaled_resolution();
+    key.width = scaled_resolution.x;
+    key.height = scaled_resolution.y;
+    return key;
+}
+
+glm::ivec2 Application::get_scaled_resolution() const {
+    return glm::ivec2(glm::max(1, static_cast<int>(std::round(width * render_scale))), glm::max(1, static_cast<int>(std::round(height * render_scale))));
+}
+
+void Application::update_render_scale() {
+    if (!use_dynamic_resolution) {
+        return;
+    }
+
+    // The frames only refining or displaying the accumulation say nothing about the cost of tracing, and the profiler
+    // reports the frames with a delay, so the scale changes at most once per that delay and only while the scene moves.
+    const GpuProfiler::Statistics frame_statistics = gpu_profiler.get_statistics(GpuProfiler::frame_scope);
+    if (frame_statistics.samples == 0 || frame_statistics.last <= 0.0f || consecutive_full_frames <= GpuProfiler::frames_in_flight ||
+        consecutive_full_frames % (GpuProfiler::frames_in_flight + 1) != 0) {
+        return;
+    }
+
+    // The cost is proportional to the number of pixels, i.e., to the square of the scale. The step is damped and small
+    // errors are ignored, so the scale does not oscillate around the target.
+    const float ratio = target_frame_time / frame_statistics.last;
+    if (std::abs(ratio - 1.0f) < 0.05f) {
+        return;
+    }
+    const float ideal_scale = render_scale * std::sqrt(ratio);
+    render_scale = glm::clamp(render_scale + 0.5f * (ideal_scale - render_scale), min_render_scale, 1.0f);
+}
+
+void Application::cpu_ray_trace_snowman() {
+    run_cpu_ray_tracer();
+
+    // Uploads the image and displays it, the depth keeps the particles behind the snowman hidden.
+    glTextureSubImage2D(cpu_color_texture, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, cpu_ray_tracer.get_color().data());
+    glTextureSubImage2D(cpu_depth_texture, 0, 0, 0, width, height, GL_RED, GL_FLOAT, cpu_ray_tracer.get_depth().data());
+
+    glDepthFunc(GL_ALWAYS);
+
+    display_texture_program.use();
+    glBindTextureUnit(0, cpu_color_texture);
+    glBindTextureUnit(1, cpu_depth_texture);
+
+    glBindVertexArray(empty_vao);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glDepthFunc(GL_LESS);
+}
+
+void Application::run_cpu_ray_tracer() {
+    std::vector<PhongLightData> lights;
+    for (int i = 0; i < light_count; i++) {
+        lights.push_back(phong_lights_ubo.get_light(i));
+    }
+
+    CpuRayTracerCamera cpu_camera;
+    cpu_camera.view_inv = glm::inverse(view_matrix);
+    cpu_camera.projection_inv = glm::inverse(projection_matrix);
+    cpu_camera.eye_position = eye_position;
+
+    CpuRayTracerSettings settings;
+    settings.width = width;
+    settings.height = height;
+    settings.spheres_count = snowman_size + light_count;
+    settings.iterations = reflections;
+    settings.sphere_light_radius = sphere_light_radius;
+    settings.shadow_samples = shadow_samples;
+    settings.use_ambient_occlusion = corrective_use_ambient_occlusion;
+    settings.ambient_occlusion_samples = ambient_occlusion_samples;
+
+    const auto start = std::chrono::high_resolution_clock::now();
+    cpu_ray_tracer.render(snowman, lights, cpu_camera, settings);
+    const auto end = std::chrono::high_resolution_clock::now();
+    cpu_ray_tracing_time = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void Application::compare_cpu_and_gpu_ray_tracing() {
+    // Renders the GPU version into the window and reads it back before anything else is drawn. The CPU ray tracer only
+    // mirrors the hash-based sampling.
+    const bool sequences = use_sample_sequences, analytic = use_analytic_visibility, hybrid = use_hybrid_rendering;
+    const bool ao_cache = use_ambient_occlusion_cache, denoise = use_denoiser;
+    use_sample_sequences = false;
+    use_analytic_visibility = false;
+    use_hybrid_rendering = false;
+    use_ambient_occlusion_cache = false;
+    use_denoiser = false;
+    ray_trace_snowman();
+    use_sample_sequences = sequences;
+    use_analytic_visibility = analytic;
+    use_hybrid_rendering = hybrid;
+    use_ambient_occlusion_cache = ao_cache;
+    use_denoiser = denoise;
+    std::vector<glm::vec4> gpu_color(static_cast<size_t>(width) * height);
+    GLint pack_alignment;
+    glGetIntegerv(GL_PACK_ALIGNMENT, &pack_alignment);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_FLOAT, gpu_color.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, pack_alignment);
+
+    run_cpu_ray_tracer();
+    const std::vector<glm::vec4>& cpu_color = cpu_ray_tracer.get_color();
+
+    // The window stores 8-bit colors, so the CPU colors are clamped and anything within one step is considered equal.
+    double error_sum = 0.0;
+    float max_error = 0.0f;
+    size_t different_pixels = 0;
+    for (size_t i = 0; i < gpu_color.size(); i++) {
+        const glm::vec3 difference = glm::abs(glm::clamp(glm::vec3(cpu_color[i]), 0.0f, 1.0f) - glm::vec3(gpu_color[i]));
+        const float error = glm::max(difference.x, glm::max(difference.y, difference.z));
+        error_sum += error;
+        max_error = glm::max(max_error, error);
+        if (error > 1.5f / 255.0f) {
+            different_pixels++;
+        }
+    }
 
-        ModelUBO model_ubo(translate(glm::mat4(1.0f), glm::vec3(phong_lights_ubo.get_light(i).position)) *
-                           scale(glm::mat4(1.0f), glm::vec3(sphere_light_radius)));
+    std::cout << "CPU vs GPU ray tracing: mean error " << error_sum / static_cast<double>(gpu_color.size()) << ", max error " << max_error
+              << ", pixels differing by more than one step " << different_pixels << " of " << gpu_color.size() << " ("
+              << cpu_ray_tracing_time << " ms on " << task_scheduler.get_worker_count() << " threads)." << std::endl;
+}
 
-        // Note that the material is hard-coded here since the default lit shader works with PhongMaterial not PBRMaterial as defined in
-        // snowman.
-        light_material_ubo.set_material(PhongMaterialData(phong_lights_ubo.get_light(i).diffuse, true, 200.0f, 1.0f));
-        light_material_ubo.update_opengl_data();
+void Application::compare_cpu_and_gpu_particles() {
+    // Both simulations start from the current particle buffer and take the same steps with the current lights.
+    constexpr int steps = 120;
+    const int count = desired_snow_count;
+    std::vector<glm::vec4> particles(count);
+    glGetNamedBufferSubData(particle_ssbo, 0, static_cast<GLsizeiptr>(count) * sizeof(glm::vec4), particles.data());
+    cpu_particle_simulation.set_particles(particles);
 
-        light_material_ubo.bind_buffer_base(PhongMaterialUBO::DEFAULT_MATERIAL_BINDING);
-        model_ubo.bind_buffer_base(ModelUBO::DEFAULT_MODEL_BINDING);
-        sphere.bind_vao();
-        sphere.draw();
+    CpuParticleStep settings;
+    for (int i = 0; i < light_count; i++) {
+        settings.light_positions.push_back(glm::vec3(snowman.spheres[snowman_size + i]));
     }
+    settings.light_radius = sphere_light_radius;
+    settings.t_delta = particle_time_step * 0.0001f;
+
+    particle_simulation_program.use();
+    particle_simulation_program.uniform("t_delta", settings.t_delta);
+    particle_simulation_program.uniform("light_radius", settings.light_radius);
+    particle_simulation_program.uniform("particle_count", count);
+    for (int step = 0; step < steps; step++) {
+        glDispatchCompute((count + 255) / 256, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    const auto start = std::chrono::steady_clock::now();
+    cpu_particle_simulation.step(settings, steps);
+    const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    glGetNamedBufferSubData(particle_ssbo, 0, static_cast<GLsizeiptr>(count) * sizeof(glm::vec4), particles.data());
+    const std::vector<glm::vec4> cpu_particles = cpu_particle_simulation.get_particles();
+
+    // The equations are the same, only the rounding differs (e.g., fused multiply-adds), so a particle near the ground may
+    // respawn one step apart on the two sides.
+    float max_error = 0.0f;
+    int different_particles = 0;
+    for (int i = 0; i < count; i++) {
+        const float error = glm::length(glm::vec3(cpu_particles[i]) - glm::vec3(particles[i]));
+        max_error = glm::max(max_error, error);
+        if (error > 1e-3f || std::abs(cpu_particles[i].w - particles[i].w) > 1e-3f) {
+            different_particles++;
+        }
+    }
+
+    std::cout << "CPU vs GPU particles after " << steps << " steps: max position error " << max_error << ", particles differing by more than 1e-3 "
+              << different_particles << " of " << count << " (" << elapsed.count() << " ms on " << task_scheduler.get_worker_count()
+              << " threads)." << std::endl;
+}
+
+void Application::cull_spheres(bool impostors) {
+    const int spheres_count = scene_spheres_count;
+
+    // Culls the spheres on the GPU, the instance counts of the commands are reset first.
+    glCopyNamedBufferSubData(sphere_draw_commands_template, sphere_draw_commands, 0, 0, sizeof(DrawElementsIndirectCommand) * sphere_command_count);
+
+    sphere_cull_program.use();
+    sphere_cull_program.uniform("spheres_count", spheres_count);
+    sphere_cull_program.uniform("lod_capacity", spheres_count);
+    sphere_cull_program.uniform("lod_pixel_radius", sphere_lod_pixel_radius);
+    sphere_cull_program.uniform("viewport_height", static_cast<float>(height));
+    sphere_cull_program.uniform("impostor_command", impostors ? sphere_impostor_command : -1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, scene_spheres_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, sphere_draw_commands);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, visible_spheres_buffer);
+    glDispatchCompute((spheres_count + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void Application::raster_snowman() {
+    cull_spheres(false);
+
+    // Renders all the spheres and lights with a single draw call, one command per level of detail.
+    instanced_sphere_program.use();
+    instanced_sphere_program.uniform("static_spheres_count", static_spheres_count);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, scene_materials_buffer);
+
+    glBindVertexArray(sphere_mesh_vao);
+    glVertexArrayVertexBuffer(sphere_mesh_vao, 1, visible_spheres_buffer, 0, sizeof(GLuint));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sphere_draw_commands);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, sphere_lod_count, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void Application::render_visibility_buffer(glm::ivec2 resolution) {
+    cull_spheres(true);
+
+    // The pixels without a sphere keep the clear value, the ray tracer intersects only the ground plane there.
+    const GLuint no_sphere[4] = {0xFFFFFFFFu, 0, 0, 0};
+    const GLfloat far_depth = 1.0f;
+    glClearNamedFramebufferuiv(visibility_framebuffer, GL_COLOR, 0, no_sphere);
+    glClearNamedFramebufferfv(visibility_framebuffer, GL_DEPTH, 0, &far_depth);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, visibility_framebuffer);
+    glViewport(0, 0, resolution.x, resolution.y);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+
+    sphere_visibility_program.use();
+    glBindVertexArray(sphere_mesh_vao);
+    glVertexArrayVertexBuffer(sphere_mesh_vao, 1, visible_spheres_buffer, 0, sizeof(GLuint));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, sphere_draw_commands);
+    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<const void*>(sizeof(DrawElementsIndirectCommand) * sphere_impostor_command));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, output_framebuffer);
+    glViewport(0, 0, width, height);
+}
+
+void Application::simulate_particles() {
+    if (!show_particles) {
+        particle_time_accumulator = 0;
+        return;
+    }
+
+    // The simulation runs with a fixed time step, independently of the frame rate.
+    int steps = static_cast<int>(particle_time_accumulator / particle_time_step);
+    particle_time_accumulator -= steps * particle_time_step;
+    if (steps > max_particle_steps) {
+        steps = max_particle_steps;
+        particle_time_accumulator = 0;
+    }
+
+    const GLuint groups = (desired_snow_count + 255) / 256;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_ssbo);
+    if (compare_particle_simulations) {
+        compare_cpu_and_gpu_particles();
+        compare_particle_simulations = false;
+    }
+
+    particle_simulation_program.use();
+    particle_simulation_program.uniform("t_delta", particle_time_step * 0.0001f);
+    particle_simulation_program.uniform("light_radius", sphere_light_radius);
+    particle_simulation_program.uniform("particle_count", desired_snow_count);
+    for (int step = 0; step < steps; step++) {
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // Collects the visible particles, the atomic counter is the instance count of the draw command.
+    const GLuint zero = 0;
+    glClearNamedBufferSubData(particle_draw_buffer, GL_R32UI, offsetof(DrawArraysIndirectCommand, instance_count), sizeof(GLuint),
+                              GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+
+    particle_compaction_program.use();
+    particle_compaction_program.uniform("particle_size_vs", particle_size);
+    particle_compaction_program.uniform("particle_count", desired_snow_count);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, visible_particles_buffer);
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 0, particle_draw_buffer);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
 }
 
 void Application::render_particles() {
@@ -373,16 +1444,18 @@ void Application::render_particles() {
     // Renders the particles
     if (show_particles) {
         particle_program.use();
-        particle_program.uniform("t_delta", (float)t_delta * 0.0001f);
         particle_program.uniform("particle_size_vs", particle_size);
-        particle_program.uniform("light_radius", sphere_light_radius);
 
         glBindTextureUnit(0, particle_tex);
 
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, particle_ssbo);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, visible_particles_buffer);
 
+        // Draws only the visible particles, their count was written by the compaction.
         glBindVertexArray(empty_vao);
-        glDrawArrays(GL_POINTS, 0, desired_snow_count);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, particle_draw_buffer);
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, nullptr);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     }
 
     // Disables the blending.
@@ -408,7 +1481,8 @@ void Application::render_ui() {
     ImGui::SliderInt("Reflections Quality", &reflections, 1, 100);
 
     current_snow_count = desired_snow_count;
-    const char* particle_labels[10] = {"256", "512", "1024", "2048", "4096", "8192", "16384", "32768", "65536", "131072"};
+    const char* particle_labels[16] = {"256",    "512",    "1024",   "2048",    "4096",    "8192",    "16384",   "32768",
+                                       "65536", "131072", "262144", "524288", "1048576", "2097152", "4194304", "8388608"};
     int exponent = static_cast<int>(log2(current_snow_count) - 8); // -8 because we start at 256 = 2^8
     if (ImGui::Combo("Particle Count", &exponent, particle_labels, IM_ARRAYSIZE(particle_labels))) {
         desired_snow_count = static_cast<int>(glm::pow(2, exponent + 8)); // +8 because we start at 256 = 2^8
@@ -416,6 +1490,9 @@ void Application::render_ui() {
     }
 
     ImGui::Checkbox("Show Particles", &show_particles);
+    if (show_particles && ImGui::Button("Compare CPU and GPU Particles")) {
+        compare_particle_simulations = true;
+    }
 
 	ImGui::SliderFloat("Particle Size", &particle_size, 0.1f, 2.0f, "%.1f");
 	ImGui::SliderFloat("Sphere Light Speed", &light_sphere_speed, 0.0f, 10.0f, "%.1f");
@@ -425,13 +1502,119 @@ void Application::render_ui() {
     ImGui::Checkbox("Use Ray Tracing", &use_ray_tracing);
 
 	if (use_ray_tracing) {
+		const char* extra_spheres_labels[5] = {"0", "1000", "10000", "100000", "1000000"};
+		const int extra_spheres_values[5] = {0, 1000, 10000, 100000, 1000000};
+		int extra_spheres_index = static_cast<int>(std::find(extra_spheres_values, extra_spheres_values + 5, extra_spheres_count) - extra_spheres_values);
+		if (ImGui::Combo("Extra Spheres", &extra_spheres_index, extra_spheres_labels, IM_ARRAYSIZE(extra_spheres_labels))) {
+			extra_spheres_count = extra_spheres_values[extra_spheres_index];
+			prepare_scene();
+		}
+		ImGui::InputText("Scene File", scene_path_input, sizeof(scene_path_input));
+		if (ImGui::Button("Load Scene")) {
+			load_scene(scene_path_input);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Export Scene")) {
+			export_scene(scene_path_input);
+		}
+		ImGui::Text("Scene: %d spheres (%s)", scene_spheres_count, scene_file ? "mapped" : "generated");
 		ImGui::Checkbox("Use Ambient Occlusion", &corrective_use_ambient_occlusion);
 		ImGui::SliderInt("Ambient Occlusion Samples", &ambient_occlusion_samples, 4, 64);
+		ImGui::Checkbox("Baked Ambient Occlusion Cache", &use_ambient_occlusion_cache);
+		if (use_ambient_occlusion_cache) {
+			ImGui::SliderInt("Tiles Baked per Frame", &ambient_occlusion_bake_budget, 1, AmbientOcclusionCache::max_jobs);
+			ImGui::Text("Tiles waiting for the bake: %d", ambient_occlusion_cache.get_pending_count());
+		}
+
+		ImGui::Checkbox("Wavefront Ray Tracing", &use_wavefront_ray_tracing);
+		if (!use_wavefront_ray_tracing) {
+			ImGui::Checkbox("Hybrid (Visibility Buffer)", &use_hybrid_rendering);
+			ImGui::Checkbox("Denoiser (Shadows and AO)", &use_denoiser);
+			if (use_denoiser) {
+				ImGui::SliderInt("Filter Iterations", &denoiser_iterations, 1, Denoiser::max_iterations);
+			}
+		}
+		ImGui::Checkbox("Specialized Shader Variants", &use_shader_variants);
+		if (use_shader_variants) {
+			ImGui::Text("Variants: %d cached, %d building, %d built", static_cast<int>(ray_tracing_variants.size()),
+			            ray_tracing_variants.get_pending_count(), ray_tracing_variants.get_built_count());
+		}
+		if (asset_loader.get_pending_count() > 0) {
+			ImGui::Text("Loading %d textures", asset_loader.get_pending_count());
+		}
+		if (ProgramBinaryCache::is_enabled()) {
+			ImGui::Text("Program binaries: %d loaded, %d compiled, %d rejected", ProgramBinaryCache::get_hit_count(),
+			            ProgramBinaryCache::get_miss_count(), ProgramBinaryCache::get_rejected_count());
+		}
+		ImGui::Checkbox("Low-Discrepancy Sampling", &use_sample_sequences);
+		ImGui::Checkbox("Analytic Shadows and AO", &use_analytic_visibility);
+		if (use_analytic_visibility || use_ambient_occlusion_cache) {
+			ImGui::SliderFloat("Occlusion Range", &analytic_occlusion_range, 1.0f, 40.0f, "%.1f");
+		}
+
+		ImGui::Checkbox("Progressive Accumulation", &use_accumulation);
+		if (use_accumulation) {
+			ImGui::SliderInt("Samples per Frame", &accumulation_samples_per_frame, 1, 8);
+			ImGui::SliderInt("Accumulated Samples", &accumulation_target_samples, 16, 1024);
+			ImGui::Text("Accumulated: %d / %d", accumulated_shadow_samples, accumulation_target_samples);
+		}
+
+		ImGui::Checkbox("Dynamic Resolution", &use_dynamic_resolution);
+		if (use_dynamic_resolution) {
+			ImGui::SliderFloat("Target Frame Time (ms)", &target_frame_time, 4.0f, 100.0f, "%.1f");
+			ImGui::Text("Render Scale: %.2f", render_scale);
+		} else {
+			ImGui::SliderFloat("Render Scale", &render_scale, min_render_scale, 1.0f, "%.2f");
+		}
+
+		ImGui::Checkbox("Use CPU Ray Tracing", &use_cpu_ray_tracing);
+		if (use_cpu_ray_tracing) {
+			std::string cpu_time_string = "CPU Ray Tracing (ms): ";
+			ImGui::Text(cpu_time_string.append(std::to_string(cpu_ray_tracing_time)).c_str());
+		}
+		if (ImGui::Button("Compare CPU and GPU")) {
+			compare_ray_tracers = true;
+		}
 	}
 
+    render_profiler_ui();
+
     ImGui::End();
 }
 
+void Application::render_profiler_ui() {
+    if (!ImGui::CollapsingHeader("GPU Profiler")) {
+        return;
+    }
+
+    // The values are in ms, min/avg/p99 are computed over the last few seconds.
+    ImGui::Text("%-24s %7s %7s %7s %7s", "Pass", "last", "min", "avg", "p99");
+    for (const std::string& name : gpu_profiler.get_scope_names()) {
+        const GpuProfiler::Statistics statistics = gpu_profiler.get_statistics(name);
+        ImGui::Text("%-24s %7.3f %7.3f %7.3f %7.3f", name.c_str(), statistics.last, statistics.min, statistics.avg, statistics.p99);
+    }
+    if (gpu_profiler.get_dropped_frames() > 0) {
+        ImGui::Text("Dropped frames: %d", gpu_profiler.get_dropped_frames());
+    }
+    ImGui::Text("Frames waiting for the GPU: %d", upload_ring.get_stalled_frames());
+    if (upload_ring.get_overflowed_uploads() > 0) {
+        ImGui::Text("Synchronous uploads: %d", upload_ring.get_overflowed_uploads());
+    }
+
+    bool recording = gpu_profiler.is_recording();
+    if (ImGui::Checkbox("Record Timings", &recording)) {
+        gpu_profiler.set_recording(recording);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Save CSV")) {
+        if (gpu_profiler.write_csv(profile_csv_path)) {
+            std::cout << "GPU timings of " << gpu_profiler.get_recorded_frame_count() << " frames written to " << profile_csv_path << "." << std::endl;
+        } else {
+            std::cerr << "Could not write " << profile_csv_path << "." << std::endl;
+        }
+    }
+}
+
 // ----------------------------------------------------------------------------
 // Input Events
 // ----------------------------------------------------------------------------
@@ -1,9 +1,23 @@
 #pragma once
+#include "ambient_occlusion_cache.hpp"
 #include "camera_ubo.hpp"
+#include "cpu_particle_simulation.hpp"
+#include "cpu_ray_tracer.hpp"
+#include "denoiser.hpp"
+#include "gpu_profiler.hpp"
 #include "light_ubo.hpp"
 #include "pbr_material_ubo.hpp"
 #include "pv227_application.hpp"
-#include "ubo_impl.hpp" // required for UBO with snowman
+#include "asset_loader.hpp"
+#include "sampler.hpp"
+#include "scene_capture.hpp"
+#include "scene_file.hpp"
+#include "shader_variant_cache.hpp"
+#include "sphere_bvh.hpp"
+#include "task_scheduler.hpp"
+#include "upload_ring.hpp"
+#include <optional>
+#include <variant>
 
 /** The number of spheres forming the snowman. */
 constexpr int snowman_size = 10;
@@ -12,7 +26,7 @@ constexpr int snowman_size = 10;
 constexpr int light_count = 3;
 
 /** The max number of particles */
-constexpr int max_particle_count = 131072;
+constexpr int max_particle_count = 8388608;
 
 /** The structure defining the snowman. */
 struct Snowman {
@@ -20,18 +34,72 @@ struct Snowman {
     PBRMaterialData materials[snowman_size + light_count]; // The respective materials for each sphere.
 };
 
-/** The definition of a snowman ubo. */
-class SnowmanUBO : public UBO<Snowman> {
-    using UBO<Snowman>::UBO; // copies constructors from the parent class
+/**
+ * The particle as stored on the GPU (std430). The velocity, the lifetime, the light, and the color follow from the index
+ * and the age of the particle and are recomputed by the shaders (see particle_simulate.comp).
+ */
+struct Particle {
+	glm::vec3 position; // The position of the particle.
+	float delay; // The time before the particle respawns, negative for a particle waiting for its first spawn.
 };
 
-struct Particle {
-	glm::vec4 position; // The position of particles (on CPU).
-	glm::vec3 velocity; // The velocity of particles (on CPU).
-    int light_id; // The id of the light source
-	glm::vec3 color; // The colors of all particles (on GPU).
-	float delay; // The delay of the particle
-	float lifetime; // The lifetime of the particle
+/** The command read by glMultiDrawElementsIndirect. */
+struct DrawElementsIndirectCommand {
+    GLuint count;          // The number of indices.
+    GLuint instance_count; // The number of instances.
+    GLuint first_index;    // The first index.
+    GLint base_vertex;     // The value added to the indices.
+    GLuint base_instance;  // The first instance.
+};
+
+/** The std140 layout of the CameraBuffer block in the shaders. */
+struct CameraBufferData {
+    glm::mat4 projection;     // The projection matrix.
+    glm::mat4 projection_inv; // The inverse of the projection matrix.
+    glm::mat4 view;           // The view matrix.
+    glm::mat4 view_inv;       // The inverse of the view matrix.
+    glm::vec4 view_it[3];     // The columns of the inverse of the transpose of the top-left 3x3 part of the view matrix (padded).
+    glm::vec3 eye_position;   // The position of the eye in world space.
+    float padding;
+};
+
+/** The std140 layout of the PhongLightsBuffer block in the shaders. */
+struct LightsBufferData {
+    glm::vec3 global_ambient_color;    // The global ambient color.
+    int lights_count;                  // The number of lights in the buffer.
+    PhongLightData lights[light_count]; // The lights.
+};
+
+/** The state the accumulated ray traced image depends on, the accumulation restarts whenever it changes. */
+struct AccumulationKey {
+    glm::mat4 view;                        // The view matrix.
+    glm::mat4 projection;                  // The projection matrix.
+    glm::vec4 light_spheres[light_count];  // The positions and radii of the lights.
+    glm::vec3 light_colors[light_count];   // The colors of the lights.
+    int static_spheres_count;              // The number of static spheres (changes with the extra spheres).
+    int reflections;                       // The number of reflections.
+    int shadow_samples;                    // The number of shadow samples of the first frame.
+    int ambient_occlusion_samples;         // The number of ambient occlusion samples of the first frame.
+    bool use_ambient_occlusion;            // The flag determining if the ambient occlusion is used.
+    bool use_sample_sequences;             // The flag determining if the low-discrepancy sequences are used.
+    bool use_analytic_visibility;          // The flag determining if the shadows and the occlusion are analytic.
+    bool use_hybrid_rendering;             // The flag determining if the primary hits come from the visibility buffer.
+    bool use_denoiser;                     // The flag determining if the shadows and the occlusion are denoised.
+    float analytic_occlusion_range;        // The range of the analytic ambient occlusion.
+    int ambient_occlusion_cache_version;   // The version of the baked ambient occlusion (0 if the cache is not used).
+    int width;                             // The width of the ray traced image (after the render scale).
+    int height;                            // The height of the ray traced image (after the render scale).
+
+    /** @return Whether all the members are equal. */
+    bool operator==(const AccumulationKey& other) const;
+};
+
+/** The command read by glDrawArraysIndirect. */
+struct DrawArraysIndirectCommand {
+    GLuint count;          // The number of vertices.
+    GLuint instance_count; // The number of instances.
+    GLuint first;          // The first vertex.
+    GLuint base_instance;  // The first instance.
 };
 
 class Application : public PV227Application {
@@ -41,8 +109,57 @@ class Application : public PV227Application {
   protected:
     /** The definition of the snowman. */
     Snowman snowman;
-    /** The buffer with the snowman. */
-    SnowmanUBO snowman_ubo;
+
+    /** The spheres of the generated scene: the snowman, the extra spheres, and the light spheres at the end. */
+    std::vector<glm::vec4> generated_spheres;
+    /** The materials of the spheres in {@link generated_spheres}. */
+    std::vector<PBRMaterialData> generated_materials;
+    /** The scene loaded from a file, it replaces the generated scene while it is open. */
+    std::optional<SceneFile> scene_file;
+    /** The spheres of the ray traced scene (generated or mapped from {@link scene_file}), the light spheres are at the end. */
+    glm::vec4* scene_spheres = nullptr;
+    /** The materials of the spheres in {@link scene_spheres}. */
+    PBRMaterialData* scene_materials = nullptr;
+    /** The number of spheres in {@link scene_spheres}. */
+    int scene_spheres_count = 0;
+    /** The number of static spheres, i.e., the index of the first light sphere in {@link scene_spheres}. */
+    int static_spheres_count = 0;
+    /** The number of extra spheres scattered around the snowman (to stress the ray tracer). */
+    int extra_spheres_count = 0;
+
+    /** The bounding volume hierarchy over {@link scene_spheres}. */
+    SphereBVH sphere_bvh;
+    /** The size of the pieces the scene is uploaded in (in bytes), the mapped pages are released after each one. */
+    static constexpr size_t scene_upload_chunk_size = 4 << 20;
+    /** The SSBO with {@link scene_spheres}. */
+    GLuint scene_spheres_buffer = 0;
+    /** The SSBO with {@link scene_materials}. */
+    GLuint scene_materials_buffer = 0;
+    /** The SSBO with the nodes of {@link sphere_bvh}. */
+    GLuint bvh_nodes_buffer = 0;
+    /** The SSBO with the sphere indices referenced by the leaves of {@link sphere_bvh}. */
+    GLuint bvh_indices_buffer = 0;
+
+    /** The number of levels of detail of the sphere mesh used by the rasterization. */
+    static constexpr int sphere_lod_count = 2;
+    /** The draw command of the impostor quads rendered into the visibility buffer, it follows the levels of detail. */
+    static constexpr int sphere_impostor_command = sphere_lod_count;
+    /** The number of sphere draw commands (the levels of detail and the impostors). */
+    static constexpr int sphere_command_count = sphere_lod_count + 1;
+    /** The VAO with the sphere meshes, the second binding provides the sphere index per instance. */
+    GLuint sphere_mesh_vao = 0;
+    /** The vertices of all the levels of detail (positions on the unit sphere) followed by the corners of the impostor quad. */
+    GLuint sphere_mesh_vertices = 0;
+    /** The indices of all the levels of detail. */
+    GLuint sphere_mesh_indices = 0;
+    /** The draw commands with zero instances, copied into {@link sphere_draw_commands} before the culling. */
+    GLuint sphere_draw_commands_template = 0;
+    /** The draw commands (one per level of detail and the impostors), their instance counts are written by the culling. */
+    GLuint sphere_draw_commands = 0;
+    /** The indices of the visible spheres, one list per draw command. */
+    GLuint visible_spheres_buffer = 0;
+    /** The projected radius (in pixels) below which the coarse sphere mesh is used. */
+    float sphere_lod_pixel_radius = 16.0f;
 
     // ----------------------------------------------------------------------------
     // Variables (Textures)
@@ -52,32 +169,115 @@ class Application : public PV227Application {
     // Variables (Light)
     // ----------------------------------------------------------------------------
   protected:
-    /** The UBO storing the data about lights - positions, colors, etc. */
+    /** The lights - positions, colors, etc., uploaded into {@link lights_buffer}. */
     PhongLightsUBO phong_lights_ubo;
-    /** The UBO defining a material that is used for lights during rasterization. */
-    PhongMaterialUBO light_material_ubo;
+    /** The content of {@link lights_buffer}. */
+    LightsBufferData lights_data = {};
+    /** The uniform buffer with the lights. */
+    GLuint lights_buffer = 0;
+    /** The content of {@link lights_buffer} uploaded last time. */
+    std::vector<uint8_t> lights_uploaded;
 
     // ----------------------------------------------------------------------------
     // Variables (Camera)
     // ----------------------------------------------------------------------------
   protected:
-    /** The UBO storing the information about camera. */
-    CameraUBO camera_ubo;
+    /** The content of {@link camera_buffer}. */
+    CameraBufferData camera_data = {};
+    /** The uniform buffer with the information about camera. */
+    GLuint camera_buffer = 0;
+    /** The content of {@link camera_buffer} uploaded last time. */
+    std::vector<uint8_t> camera_uploaded;
+    /** The view matrix of the camera (kept on CPU for the CPU ray tracer). */
+    glm::mat4 view_matrix = glm::mat4(1.0f);
+    /** The projection matrix of the camera (kept on CPU for the CPU ray tracer). */
+    glm::mat4 projection_matrix = glm::mat4(1.0f);
+    /** The position of the eye used in the current frame. */
+    glm::vec3 eye_position = glm::vec3(0.0f);
 
     // ----------------------------------------------------------------------------
     // Variables (Shaders)
     // ----------------------------------------------------------------------------
 	/** The shader program for rendering the snowman using ray tracing. */
-	ShaderProgram ray_tracing_program;
+	GpuProgram ray_tracing_program;
+
+    /** The variants of the ray tracing program with the settings compiled in as constants. */
+    ShaderVariantCache ray_tracing_variants{16};
+
+	/** The shader program rendering all the spheres instanced. */
+	GpuProgram instanced_sphere_program;
+
+	/** The shader program rendering the spheres as impostors into the visibility buffer. */
+	GpuProgram sphere_visibility_program;
+
+	/** The compute program culling the spheres and selecting their level of detail. */
+	GpuProgram sphere_cull_program;
 
 	/** The shader program for rendering the particle. */
-    ShaderProgram particle_program;
+    GpuProgram particle_program;
+
+    /** The compute program initializing the newly activated particles. */
+    GpuProgram particle_seed_program;
+
+    /** The compute program advancing the particle simulation by one fixed time step. */
+    GpuProgram particle_simulation_program;
+
+    /** The compute program collecting the visible particles for the indirect draw. */
+    GpuProgram particle_compaction_program;
+
+    /** The shader program displaying a full screen color and depth texture (e.g., the output of the CPU ray tracer). */
+    GpuProgram display_texture_program;
+
+    /** The shader program upscaling the ray traced image to the window with an edge-aware filter. */
+    GpuProgram upscale_program;
+
+    /** The compute program with all the stages of the wavefront ray tracer, the stage is selected by a uniform. */
+    GpuProgram wavefront_program;
+
+    /** The shader program writing the image traced by the wavefront ray tracer into the framebuffer. */
+    GpuProgram wavefront_resolve_program;
+
+    /** The compute program baking the tiles of the ambient occlusion cache. */
+    GpuProgram ambient_occlusion_bake_program;
+
+    /** The shader programs of the passes of the denoiser (reprojection, a-trous filter, and composite). */
+    GpuProgram denoise_temporal_program;
+    GpuProgram denoise_atrous_program;
+    GpuProgram denoise_composite_program;
 
   protected:
     // ----------------------------------------------------------------------------
     // Variables (Frame Buffers)
     // ----------------------------------------------------------------------------
   protected:
+    /** The framebuffer the frame is rendered into, 0 is the window. */
+    GLuint output_framebuffer = 0;
+
+    /** The full screen texture with the colors computed by the CPU ray tracer. */
+    GLuint cpu_color_texture = 0;
+    /** The full screen texture with the depth computed by the CPU ray tracer. */
+    GLuint cpu_depth_texture = 0;
+
+    /** The framebuffer the ray traced frames are progressively accumulated in, only its bottom-left part is used when the render scale is below one. */
+    GLuint accumulation_framebuffer = 0;
+    /** The color attachment of {@link accumulation_framebuffer} with the running average, without the direct light of the primary hits. */
+    GLuint accumulation_color_texture = 0;
+    /** The second color attachment of {@link accumulation_framebuffer} with the direct light of the primary hits without the visibility. */
+    GLuint accumulation_unshadowed_texture = 0;
+    /** The third color attachment of {@link accumulation_framebuffer} with the running averages of the shadows (rgb) and the ambient occlusion (a). */
+    GLuint accumulation_visibility_texture = 0;
+    /** The depth attachment of {@link accumulation_framebuffer}. */
+    GLuint accumulation_depth_texture = 0;
+    /** The texture of {@link denoiser} with the last denoised frame, owned by the denoiser. */
+    GLuint denoised_texture = 0;
+
+    /** The framebuffer the visible spheres are rasterized into, the ray tracing starts from it in the hybrid mode. */
+    GLuint visibility_framebuffer = 0;
+    /** The color attachment of {@link visibility_framebuffer} with the index of the visible sphere (0xFFFFFFFF for none). */
+    GLuint visibility_sphere_texture = 0;
+    /** The depth attachment of {@link visibility_framebuffer}. */
+    GLuint visibility_depth_texture = 0;
+
     // ----------------------------------------------------------------------------
     // Variables (GUI)
     // ----------------------------------------------------------------------------
@@ -109,6 +309,42 @@ class Application : public PV227Application {
 	/** The flag determining if the snowman should be rendered using raytracing. */
     bool use_ray_tracing = false;
 
+    /** The flag determining if the ray traced samples should be accumulated over frames while the scene is static. */
+    bool use_accumulation = true;
+
+    /** The number of shadow and ambient occlusion samples added per frame after the first accumulated frame. */
+    int accumulation_samples_per_frame = 2;
+
+    /** The number of shadow samples after which the accumulation stops. */
+    int accumulation_target_samples = 128;
+
+    /** The flag determining if the render scale should be adjusted to hold the target frame time. */
+    bool use_dynamic_resolution = false;
+
+    /** The GPU frame time the dynamic resolution aims for (in ms). */
+    float target_frame_time = 33.3f;
+
+    /** The ratio between the resolution of the ray traced image and the window in each axis. */
+    float render_scale = 1.0f;
+
+    /** The lowest render scale the dynamic resolution may choose. */
+    float min_render_scale = 0.25f;
+
+    /** The flag determining if the ray tracing should run on CPU instead of GPU. */
+    bool use_cpu_ray_tracing = false;
+
+    /** The flag requesting a comparison of the CPU and the GPU ray tracer in the next frame. */
+    bool compare_ray_tracers = false;
+
+    /** The flag requesting a comparison of the CPU and the GPU particle simulation in the next frame. */
+    bool compare_particle_simulations = false;
+
+    /** The path of the scene file edited in the UI. */
+    char scene_path_input[512] = "scene.pv227scene";
+
+    /** The path of the CSV file with the GPU timings. */
+    std::string profile_csv_path = "gpu_profile.csv";
+
 protected:
     // ----------------------------------------------------------------------------
     // Variables (Particles)
@@ -116,11 +352,26 @@ protected:
 
     GLuint particle_tex;
 
-	/** The Particle Shader Storage BO */
-	GLuint particle_ssbo;
+	/** The Particle Shader Storage BO, allocated once for {@link max_particle_count} particles. */
+	GLuint particle_ssbo = 0;
+
+	/** The number of particles initialized in the buffer, i.e., the active count when the buffer was last updated. */
+    int seeded_particle_count = 0;
+
+    /** The SSBO with the indices of the visible particles, filled every frame by the compaction. */
+    GLuint visible_particles_buffer = 0;
+
+    /** The indirect draw command, its vertex count is the atomic counter of the compaction. */
+    GLuint particle_draw_buffer = 0;
+
+    /** The fixed time step of the particle simulation (in ms). */
+    float particle_time_step = 1000.0f / 120.0f;
 
-	/** The Particle Data Array */
-    std::vector<Particle> particle_data;
+    /** The maximum number of simulation steps per frame, slower frames drop the remaining time. */
+    int max_particle_steps = 8;
+
+    /** The time not simulated yet (in ms). */
+    double particle_time_accumulator = 0;
 
 	/** Particle Size */
     float particle_size = 0.5f;
@@ -131,6 +382,138 @@ protected:
 	/** Global Time Delta */
     float t_delta = 0;
 
+    /** The time of the scene in the current frame (in ms). */
+    double scene_time = 0;
+
+    // ----------------------------------------------------------------------------
+    // Variables (Offline Rendering)
+    // ----------------------------------------------------------------------------
+    /** The time of the scene set from outside, e.g., the fixed time step of the offline rendering (in ms). */
+    std::optional<double> scripted_time;
+
+    /** The position of the eye set from outside, e.g., the camera path of the offline rendering. */
+    std::optional<glm::vec3> scripted_eye_position;
+
+    // ----------------------------------------------------------------------------
+    // Variables (Profiling)
+    // ----------------------------------------------------------------------------
+    /** The profiler measuring the GPU time of the individual passes. */
+    GpuProfiler gpu_profiler;
+
+    /** The flag determining if the GPU timings should be written into {@link profile_csv_path} at exit. */
+    bool write_profile_at_exit = false;
+
+    /** The session recorded with --record, written into {@link capture_path} at exit. */
+    std::optional<SceneCapture> capture;
+
+    /** The file of the recorded session. */
+    std::filesystem::path capture_path;
+
+    // ----------------------------------------------------------------------------
+    // Variables (Frame Resources)
+    // ----------------------------------------------------------------------------
+    /** The ring streaming the per-frame data to the GPU, lets the CPU run ahead without stalls. */
+    UploadRing upload_ring;
+
+    /** The sample sequences and the blue noise of the shadows and the ambient occlusion. */
+    Sampler sampler;
+
+    /** Decodes and uploads the textures in the background while the first frames are rendered. */
+    AssetLoader asset_loader;
+
+    // ----------------------------------------------------------------------------
+    // Variables (CPU Ray Tracing)
+    // ----------------------------------------------------------------------------
+    /** The scheduler running the CPU ray tracer on all cores. */
+    TaskScheduler task_scheduler;
+
+    /** The CPU reference ray tracer. */
+    CpuRayTracer cpu_ray_tracer{task_scheduler};
+
+    /** The CPU reference particle simulation, it only runs in {@link compare_cpu_and_gpu_particles}. */
+    CpuParticleSimulation cpu_particle_simulation{task_scheduler};
+
+    /** The time the CPU ray tracer needed for the last frame (in ms). */
+    float cpu_ray_tracing_time = 0;
+
+    // ----------------------------------------------------------------------------
+    // Variables (Accumulation)
+    // ----------------------------------------------------------------------------
+    /** The state the current accumulation was started with. */
+    std::optional<AccumulationKey> accumulation_key;
+
+    /** The number of shadow samples accumulated so far. */
+    int accumulated_shadow_samples = 0;
+
+    /** The number of ambient occlusion samples accumulated so far. */
+    int accumulated_ambient_occlusion_samples = 0;
+
+    /** The flag determining if the GPU ray tracing should use the wavefront compute pipeline instead of the fragment shader. */
+    bool use_wavefront_ray_tracing = false;
+
+    /** The flag determining if the primary hits should be rasterized into a visibility buffer instead of traced. */
+    bool use_hybrid_rendering = false;
+
+    /** The flag determining if the fragment ray tracer should use the variants specialized for the current settings. */
+    bool use_shader_variants = true;
+
+    /** The flag determining if the shadows and the ambient occlusion should use the low-discrepancy sequences instead of the hash. */
+    bool use_sample_sequences = true;
+
+    /** The flag determining if the soft shadows and the ambient occlusion should be evaluated analytically (no sampling). */
+    bool use_analytic_visibility = false;
+
+    /** The distance up to which the spheres contribute to the analytic ambient occlusion. */
+    float analytic_occlusion_range = 8.0f;
+
+    /** The ambient occlusion of the static spheres and the ground baked into textures, limited to {@link analytic_occlusion_range}. */
+    AmbientOcclusionCache ambient_occlusion_cache;
+
+    /** The flag determining if the ambient occlusion should be read from {@link ambient_occlusion_cache} where it is baked. */
+    bool use_ambient_occlusion_cache = true;
+
+    /** The maximum number of tiles of the ambient occlusion cache baked per frame. */
+    int ambient_occlusion_bake_budget = 64;
+
+    /** The spatio-temporal denoiser of the shadows and the ambient occlusion of the fragment ray tracer. */
+    Denoiser denoiser;
+
+    /** The flag determining if every frame should be traced anew and denoised instead of accumulated. */
+    bool use_denoiser = false;
+
+    /** The number of a-trous passes of the denoiser. */
+    int denoiser_iterations = 4;
+
+    /** The number of accumulations started so far, it offsets the per-pixel rotations of the sample sequences. */
+    int sample_frame = 0;
+
+    /**
+     * The number of consecutive frames that started a new accumulation, i.e., traced all the samples. The measured
+     * frame times lag behind by a few frames, so the controller only trusts them once they come from such frames.
+     */
+    int consecutive_full_frames = 0;
+
+    // ----------------------------------------------------------------------------
+    // Variables (Wavefront Ray Tracing)
+    // ----------------------------------------------------------------------------
+    /** The maximum number of pixels traced at once, larger images are traced in several wavefronts. */
+    static constexpr int wavefront_size = 1 << 20;
+
+    /** The size of the header of the queues: the count and the DispatchIndirectCommand (in bytes). */
+    static constexpr int wavefront_queue_header_size = 32;
+
+    /** The size of a queued ray (QueuedRay in wavefront_ray_tracing.comp, in bytes). */
+    static constexpr int wavefront_ray_size = 48;
+
+    /** The ray queues, the bounces alternate between reading one and appending to the other. */
+    GLuint wavefront_ray_queues[2] = {0, 0};
+
+    /** The queue of the surface hits waiting for the shadow stage. */
+    GLuint wavefront_shadow_queue = 0;
+
+    /** The traced image (TracedPixel in wavefront_ray_tracing.comp), large enough for the window. */
+    GLuint wavefront_pixels_buffer = 0;
+
     // ----------------------------------------------------------------------------
     // Constructors
     // ----------------------------------------------------------------------------
@@ -167,21 +550,90 @@ protected:
     /** Builds a snowman from individual parts. */
     void prepare_snowman();
 
+    /** Prepares the sphere meshes and the draw commands of the instanced rasterization. */
+    void prepare_sphere_meshes();
+
     /** Prepares particle setup. */
 	void prepare_particles();
 
-    /** Prepares the scene objects. */
+    /** Prepares the scene objects, i.e., collects the spheres and builds the BVH over them. */
     void prepare_scene();
 
+    /**
+     * Maps a scene file and uploads it instead of the current scene, the scene stays unchanged if the file cannot be used.
+     *
+     * @return	True if the scene was loaded.
+     */
+    bool load_scene(const std::filesystem::path& path);
+
+    /** Writes the current scene into a file for {@link load_scene}, returns true if the file was written. */
+    bool export_scene(const std::filesystem::path& path) const;
+
+    /** Creates the buffers of the current scene and uploads the spheres, the materials, and the BVH in chunks. */
+    void upload_scene();
+
+    /** Uploads the moved light spheres and refits the BVH around them. */
+    void update_scene_buffers();
+
     /** Prepares the frame buffer objects. */
     void prepare_framebuffers();
 
+    /** Prepares the queues of the wavefront ray tracer. */
+    void prepare_wavefront_queues();
+
     /** Resizes the full screen textures match the window. */
     void resize_fullscreen_textures();
 
-    /** Updates the Particle Buffer on Change */
+    /** Updates the Particle Buffer on Change, the newly activated particles are initialized on the GPU. */
 	void update_particle_buffer();
 
+    /**
+     * Applies the render settings given on the command line.
+     *
+     * --ray-tracing, --cpu-ray-tracing, --reflections N, --shadow-samples N, --no-ao, --ao-samples N, --particles N,
+     * --no-particles, --particle-size S, --light-radius R, --light-speed S, --profile-csv PATH, --extra-spheres N,
+     * --no-accumulation, --accumulation-samples N, --render-scale S, --target-frame-time MS, --wavefront, --hash-sampling, --analytic-visibility,
+     * --no-shader-variants, --shader-cache DIR, --no-shader-cache, --asset-cache DIR, --no-asset-cache,
+     * --record FILE, --scene FILE, --export-scene FILE, --hybrid, --no-ao-cache, --denoise
+     */
+    void apply_arguments(const std::vector<std::string>& arguments);
+
+    // ----------------------------------------------------------------------------
+    // Offline Rendering
+    // ----------------------------------------------------------------------------
+    /** Sets the framebuffer the frames are rendered into, 0 is the window. */
+    void set_output_framebuffer(GLuint framebuffer) { output_framebuffer = framebuffer; }
+
+    /** @return The directory with the shaders of the application. */
+    const std::filesystem::path& get_shaders_path() const { return lecture_shaders_path; }
+
+    /** Waits until all the textures have been loaded, so the rendered frames do not depend on the loading speed. */
+    void finish_loading() { asset_loader.wait(); }
+
+    /** Bakes all the pending tiles of the ambient occlusion cache, so the next frame does not depend on the earlier ones. */
+    void finish_ambient_occlusion_cache();
+
+    // ----------------------------------------------------------------------------
+    // Capture and Replay
+    // ----------------------------------------------------------------------------
+    /** @return The settings of the UI by their names, e.g., {"reflections", "3"}. */
+    SettingList get_settings();
+
+    /** Changes a setting of the UI (see {@link get_settings}), the unknown names are reported and ignored. */
+    void set_setting(const std::string& name, const std::string& value);
+
+    /** Restarts the particles, the progressive accumulation, and the sample sequences, so a replay starts from the same state. */
+    void reset_simulation_state();
+
+    /** @return The profiler measuring the GPU time of the frames. */
+    GpuProfiler& get_profiler() { return gpu_profiler; }
+
+    /** Overrides the time of the scene (in ms), std::nullopt returns to the wall-clock time. */
+    void set_scripted_time(std::optional<double> time) { scripted_time = time; }
+
+    /** Overrides the position of the eye, std::nullopt returns to the interactive camera. */
+    void set_scripted_eye_position(std::optional<glm::vec3> position) { scripted_eye_position = position; }
+
     // ----------------------------------------------------------------------------
     // Update
     // ----------------------------------------------------------------------------
@@ -208,12 +660,103 @@ protected:
     /** @copydoc PV227Application::render */
     void render() override;
 
-    /** Renders the snowman using rasterization. */
+    /**
+     * Culls the spheres against the frustum and fills the visible lists and the instance counts of the draw commands.
+     *
+     * @param 	impostors	The flag determining if all the visible spheres go to the impostor command instead of a level of detail.
+     */
+    void cull_spheres(bool impostors);
+
+    /** Renders the snowman, the extra spheres, and the lights using instanced rasterization with a single indirect draw. */
     void raster_snowman();
 
+    /**
+     * Rasterizes the visible spheres as analytic impostors into {@link visibility_framebuffer}, every pixel stores the
+     * sphere closest to the eye and its exact depth.
+     *
+     * @param 	resolution	The size of the ray traced image, only the bottom-left part of the buffer is rendered.
+     */
+    void render_visibility_buffer(glm::ivec2 resolution);
+
 	/** Renders the snowman using ray tracing. */
 	void ray_trace_snowman();
 
+	/**
+	 * Evaluates the ray tracing shader for every pixel of the bound framebuffer.
+	 *
+	 * @param 	shadow_count	The number of shadow samples.
+	 * @param 	ao_count		The number of ambient occlusion samples.
+	 * @param 	shadow_offset	The index of the first shadow sample.
+	 * @param 	ao_offset		The index of the first ambient occlusion sample.
+	 * @param 	split_visibility	The flag determining if the direct light of the primary hits should be written apart from its visibility.
+	 */
+	void trace_full_screen(int shadow_count, int ao_count, int shadow_offset = 0, int ao_offset = 0, bool split_visibility = false);
+
+	/**
+	 * Evaluates the ray tracing with the wavefront compute pipeline and writes the image into the bound framebuffer.
+	 *
+	 * The rays move through separate generate, intersect, shade, and shadow stages instead of one long loop per pixel.
+	 * Every stage processes a compacted queue filled by the previous one and is dispatched indirectly, so the work
+	 * groups only contain rays that are still alive and execute the same code.
+	 *
+	 * @param 	resolution  	The size of the traced image, the viewport must have the same size.
+	 * @param 	shadow_count	The number of shadow samples.
+	 * @param 	ao_count		The number of ambient occlusion samples.
+	 * @param 	shadow_offset	The index of the first shadow sample.
+	 * @param 	ao_offset		The index of the first ambient occlusion sample.
+	 */
+	void trace_wavefront(glm::ivec2 resolution, int shadow_count, int ao_count, int shadow_offset = 0, int ao_offset = 0);
+
+	/** Sets the uniforms shared by the fragment and the wavefront ray tracer, works with the generic program and the variants. */
+	template <typename Program>
+	void set_ray_tracing_uniforms(Program& program, int shadow_count, int ao_count, int shadow_offset, int ao_offset);
+
+	/** A setting of the UI that can be captured and replayed. */
+	using SettingBinding = std::pair<const char*, std::variant<bool*, int*, float*>>;
+
+	/** @return The settings of the UI bound to the variables they control. */
+	std::vector<SettingBinding> get_setting_bindings();
+
+	/** @return The settings compiled into the specialized variants of the ray tracing program. */
+	ShaderDefines get_ray_tracing_defines(int shadow_count, int ao_count) const;
+
+	/**
+	 * Invalidates the ambient occlusion cache around the changed snowman spheres and bakes a few pending tiles.
+	 *
+	 * @param 	budget	The largest number of tiles baked.
+	 */
+	void update_ambient_occlusion_cache(int budget);
+
+	/** Adds the samples of this frame to the accumulated ray traced image and displays it. */
+	void accumulate_ray_tracing();
+
+	/** Denoises the frame traced into the accumulation framebuffer, the result is stored in {@link denoised_texture}. */
+	void denoise_ray_tracing(glm::ivec2 scaled_resolution);
+
+	/** @return The current state the accumulated image depends on. */
+	AccumulationKey get_accumulation_key() const;
+
+	/** @return The size of the ray traced image, i.e., the window size multiplied by the render scale. */
+	glm::ivec2 get_scaled_resolution() const;
+
+	/** Adjusts the render scale so the measured GPU frame time approaches the target frame time. */
+	void update_render_scale();
+
+	/** Renders the snowman using the CPU ray tracer. */
+	void cpu_ray_trace_snowman();
+
+	/** Runs the CPU ray tracer into the full screen textures. */
+	void run_cpu_ray_tracer();
+
+	/** Renders the snowman with both ray tracers and prints the differences between them. */
+	void compare_cpu_and_gpu_ray_tracing();
+
+	/** Advances the particle simulation by the accumulated fixed time steps and collects the visible particles. */
+	void simulate_particles();
+
+	/** Advances the GPU particles and their copy on the CPU by the same steps and prints the differences between them. */
+	void compare_cpu_and_gpu_particles();
+
 	/** Renders the particles. */
 	void render_particles();
     // ----------------------------------------------------------------------------
@@ -223,6 +766,9 @@ protected:
     /** @copydoc PV227Application::render_ui */
     void render_ui() override;
 
+    /** Renders the timings of the individual passes. */
+    void render_profiler_ui();
+
     // ----------------------------------------------------------------------------
     // Input Events
     // ----------------------------------------------------------------------------
@@ -0,0 +1,322 @@
+#include "asset_loader.hpp"
+#include "jpeg_decoder.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <system_error>
+
+namespace {
+/** The identification of the cached mip chains, bumped when their layout or the encoder changes. */
+constexpr char magic[8] = {'P', 'V', '2', '2', '7', 'M', 'C', '1'};
+
+/** The largest difference of the color channels of an image that is still stored as grayscale. */
+constexpr int grayscale_tolerance = 16;
+
+/** The 64-bit FNV-1a hash. */
+uint64_t fnv1a(const std::vector<uint8_t>& data) {
+    uint64_t hash = 14695981039346656037ull;
+    for (const uint8_t c : data) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/** @return The image downsampled by two with a box filter, the last row/column is repeated for the odd sizes. */
+std::vector<uint8_t> downsample(const std::vector<uint8_t>& rgba, int width, int height, int new_width, int new_height) {
+    std::vector<uint8_t> result(static_cast<size_t>(new_width) * new_height * 4);
+    for (int y = 0; y < new_height; y++) {
+        const int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < new_width; x++) {
+            const int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < 4; c++) {
+                const int sum = rgba[(y0 * width + x0) * 4 + c] + rgba[(y0 * width + x1) * 4 + c] + rgba[(y1 * width + x0) * 4 + c] +
+                                rgba[(y1 * width + x1) * 4 + c];
+                result[(y * new_width + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * Compresses the red channel into RGTC1 (BC4) blocks: two 8-bit endpoints and a 3-bit index per texel selecting one of
+ * the eight values interpolated between them. The endpoints are the minimum and the maximum of the block.
+ */
+std::vector<uint8_t> compress_rgtc1(const std::vector<uint8_t>& rgba, int width, int height) {
+    const int blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+    std::vector<uint8_t> result(static_cast<size_t>(blocks_x) * blocks_y * 8);
+    for (int by = 0; by < blocks_y; by++) {
+        for (int bx = 0; bx < blocks_x; bx++) {
+            uint8_t values[16];
+            for (int i = 0; i < 16; i++) {
+                const int x = std::min(bx * 4 + i % 4, width - 1), y = std::min(by * 4 + i / 4, height - 1);
+                values[i] = rgba[(y * width + x) * 4];
+            }
+            const uint8_t high = *std::max_element(values, values + 16), low = *std::min_element(values, values + 16);
+
+            // With red_0 > red_1, index 0 is red_0, 1 is red_1 and 2-7 are the steps from red_0 to red_1.
+            uint64_t indices = 0;
+            if (high > low) {
+                for (int i = 0; i < 16; i++) {
+                    const int step = ((high - values[i]) * 14 + (high - low)) / (2 * (high - low));
+                    const uint64_t index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+                    indices |= index << (3 * i);
+                }
+            }
+            uint8_t* block = result.data() + (static_cast<size_t>(by) * blocks_x + bx) * 8;
+            block[0] = high;
+            block[1] = low;
+            for (int i = 0; i < 6; i++) {
+                block[2 + i] = static_cast<uint8_t>(indices >> (8 * i));
+            }
+        }
+    }
+    return result;
+}
+
+bool read_cache(const std::filesystem::path& file, GLenum& format, std::vector<AssetLoader::MipLevel>& levels) {
+    std::ifstream stream(file, std::ios::binary);
+    if (!stream) return false;
+    char file_magic[sizeof(magic)] = {};
+    uint32_t header[2] = {};
+    stream.read(file_magic, sizeof(file_magic));
+    stream.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!stream || std::memcmp(file_magic, magic, sizeof(magic)) != 0 || header[1] == 0 || header[1] > 16) return false;
+
+    format = header[0];
+    levels.resize(header[1]);
+    for (AssetLoader::MipLevel& level : levels) {
+        uint32_t level_header[3] = {};
+        stream.read(reinterpret_cast<char*>(level_header), sizeof(level_header));
+        if (!stream || level_header[2] > (64u << 20)) return false;
+        level.width = static_cast<int>(level_header[0]);
+        level.height = static_cast<int>(level_header[1]);
+        level.data.resize(level_header[2]);
+        stream.read(reinterpret_cast<char*>(level.data.data()), static_cast<std::streamsize>(level.data.size()));
+    }
+    return static_cast<bool>(stream);
+}
+
+void write_cache(const std::filesystem::path& file, GLenum format, const std::vector<AssetLoader::MipLevel>& levels) {
+    // Writes into a temporary file first, so a concurrently starting instance never reads a partial chain.
+    std::error_code error;
+    std::filesystem::create_directories(file.parent_path(), error);
+    // The name is unique per writer, instances storing the same file at once never write into the same temporary file.
+    const std::filesystem::path temporary = file.string() + "." + std::to_string(std::random_device{}()) + ".tmp";
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            std::cerr << "Could not write the mip chain " << temporary << "." << std::endl;
+            return;
+        }
+        const uint32_t header[2] = {format, static_cast<uint32_t>(levels.size())};
+        stream.write(magic, sizeof(magic));
+        stream.write(reinterpret_cast<const char*>(header), sizeof(header));
+        for (const AssetLoader::MipLevel& level : levels) {
+            const uint32_t level_header[3] = {static_cast<uint32_t>(level.width), static_cast<uint32_t>(level.height),
+                                              static_cast<uint32_t>(level.data.size())};
+            stream.write(reinterpret_cast<const char*>(level_header), sizeof(level_header));
+            stream.write(reinterpret_cast<const char*>(level.data.data()), static_cast<std::streamsize>(level.data.size()));
+        }
+    }
+    std::filesystem::rename(temporary, file, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+    }
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+AssetLoader::AssetLoader(int worker_count) {
+    for (int i = 0; i < worker_count; i++) {
+        workers.emplace_back([this]() {
+            while (true) {
+                std::function<void()> job;
+                {
+                    std::unique_lock lock(jobs_mutex);
+                    jobs_available.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                    if (stopping) return;
+                    job = std::move(jobs.front());
+                    jobs.pop_front();
+                }
+                job();
+            }
+        });
+    }
+}
+
+AssetLoader::~AssetLoader() {
+    {
+        std::lock_guard lock(jobs_mutex);
+        stopping = true;
+    }
+    jobs_available.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (const std::shared_ptr<TextureRequest>& request : requests) {
+        if (request->staging_buffer != 0) {
+            if (request->mapping) glUnmapNamedBuffer(request->staging_buffer);
+            glDeleteBuffers(1, &request->staging_buffer);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void AssetLoader::load_texture_2d(const std::filesystem::path& file, GLint wrap_s, GLint wrap_t, GLint min_filter, GLint mag_filter,
+                                  TextureCallback on_loaded) {
+    const std::shared_ptr<TextureRequest> request = std::make_shared<TextureRequest>();
+    request->file = file;
+    request->wrap_s = wrap_s;
+    request->wrap_t = wrap_t;
+    request->min_filter = min_filter;
+    request->mag_filter = mag_filter;
+    request->on_loaded = std::move(on_loaded);
+    requests.push_back(request);
+    post([this, request]() { decode(*request); });
+}
+
+void AssetLoader::update() {
+    for (size_t i = 0; i < requests.size();) {
+        const std::shared_ptr<TextureRequest> request = requests[i];
+        const State state = request->state;
+
+        if (state == State::Decoded) {
+            // The worker fills the mapped buffer, the render thread only creates it.
+            size_t size = 0;
+            for (const MipLevel& level : request->levels) size += level.data.size();
+            glCreateBuffers(1, &request->staging_buffer);
+            glNamedBufferStorage(request->staging_buffer, static_cast<GLsizeiptr>(size), nullptr, GL_MAP_WRITE_BIT);
+            request->mapping = glMapNamedBufferRange(request->staging_buffer, 0, static_cast<GLsizeiptr>(size),
+                                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            request->state = State::Copying;
+            post([request]() {
+                uint8_t* destination = static_cast<uint8_t*>(request->mapping);
+                for (const MipLevel& level : request->levels) {
+                    std::memcpy(destination, level.data.data(), level.data.size());
+                    destination += level.data.size();
+                }
+                request->state = State::Copied;
+            });
+        } else if (state == State::Copied || state == State::Unsupported) {
+            GLuint texture;
+            if (state == State::Copied) {
+                texture = upload(*request);
+            } else {
+                texture = TextureUtils::load_texture_2d(request->file);
+                glGenerateTextureMipmap(texture);
+            }
+            TextureUtils::set_texture_2d_parameters(texture, request->wrap_s, request->wrap_t, request->min_filter, request->mag_filter);
+            request->on_loaded(texture);
+            requests.erase(requests.begin() + static_cast<std::ptrdiff_t>(i));
+            continue;
+        }
+        i++;
+    }
+}
+
+void AssetLoader::wait() {
+    while (!requests.empty()) {
+        update();
+        std::this_thread::yield();
+    }
+}
+
+void AssetLoader::post(std::function<void()> job) {
+    {
+        std::lock_guard lock(jobs_mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobs_available.notify_one();
+}
+
+void AssetLoader::decode(TextureRequest& request) {
+    std::ifstream stream(request.file, std::ios::binary);
+    const std::vector<uint8_t> content((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(fnv1a(content)));
+    const std::filesystem::path cache_file =
+        cache_directory.empty() ? std::filesystem::path() : cache_directory / (request.file.stem().string() + "-" + key + ".mips");
+    if (!cache_file.empty() && read_cache(cache_file, request.format, request.levels)) {
+        cached_count++;
+        request.state = State::Decoded;
+        return;
+    }
+
+    int width = 0, height = 0;
+    std::vector<uint8_t> rgba = decode_jpeg(content.data(), content.size(), width, height);
+    if (rgba.empty()) {
+        request.state = State::Unsupported;
+        return;
+    }
+    decoded_count++;
+
+    bool grayscale = true;
+    for (size_t p = 0; p < rgba.size() && grayscale; p += 4) {
+        grayscale = std::abs(rgba[p] - rgba[p + 1]) <= grayscale_tolerance && std::abs(rgba[p] - rgba[p + 2]) <= grayscale_tolerance;
+    }
+    request.format = grayscale ? GL_COMPRESSED_RED_RGTC1 : GL_RGBA8;
+
+    request.levels.clear();
+    while (true) {
+        request.levels.push_back({width, height, grayscale ? compress_rgtc1(rgba, width, height) : rgba});
+        if (width == 1 && height == 1) break;
+        const int new_width = std::max(width / 2, 1), new_height = std::max(height / 2, 1);
+        rgba = downsample(rgba, width, height, new_width, new_height);
+        width = new_width;
+        height = new_height;
+    }
+
+    if (!cache_file.empty()) {
+        write_cache(cache_file, request.format, request.levels);
+    }
+    request.state = State::Decoded;
+}
+
+GLuint AssetLoader::upload(TextureRequest& request) {
+    glUnmapNamedBuffer(request.staging_buffer);
+    request.mapping = nullptr;
+
+    GLuint texture;
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, static_cast<GLsizei>(request.levels.size()), request.format, request.levels[0].width, request.levels[0].height);
+
+    // The offsets are relative to the bound pixel unpack buffer, the driver copies without stalling the render thread.
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, request.staging_buffer);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t offset = 0;
+    for (size_t level = 0; level < request.levels.size(); level++) {
+        const MipLevel& mip = request.levels[level];
+        const void* pointer = reinterpret_cast<const void*>(offset);
+        if (request.format == GL_RGBA8) {
+            glTextureSubImage2D(texture, static_cast<GLint>(level), 0, 0, mip.width, mip.height, GL_RGBA, GL_UNSIGNED_BYTE, pointer);
+        } else {
+            glCompressedTextureSubImage2D(texture, static_cast<GLint>(level), 0, 0, mip.width, mip.height, request.format,
+                                          static_cast<GLsizei>(mip.data.size()), pointer);
+        }
+        offset += mip.data.size();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &request.staging_buffer);
+    request.staging_buffer = 0;
+    request.levels.clear();
+
+    // The single channel is replicated to the color channels, so the samplers read the same gray image as before.
+    if (request.format == GL_COMPRESSED_RED_RGTC1) {
+        const GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTextureParameteriv(texture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    return texture;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include "pv227_application.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Loads the textures in the background while the application keeps rendering.
+ *
+ * A request goes through these stages:
+ * - Decode. A worker thread reads the file and looks up its mip chain in the cache directory, keyed by a hash of the
+ *   file content. On a miss, the worker decodes the JPEG, builds the mip chain with a box filter, compresses it, and
+ *   writes it to the cache. Grayscale images are compressed to RGTC1 (BC4), a quarter of R8 and an eighth of RGBA8.
+ *   Other images are stored as RGBA8.
+ * - Copy. The render thread maps a pixel unpack buffer, and a worker copies the mip chain into it.
+ * - Upload. The render thread creates the texture and uploads all the levels from the buffer, so the driver copies
+ *   asynchronously. It then passes the texture to the callback of the request.
+ *
+ * The stages advance only in {@link update}, which the render loop calls once per frame. Files the decoder does not
+ * support are loaded synchronously by the framework in update.
+ */
+class AssetLoader {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  public:
+    /** Receives the loaded texture, the callee takes the ownership. */
+    using TextureCallback = std::function<void(GLuint texture)>;
+
+    /** A mip level of a texture in its final (possibly compressed) format. */
+    struct MipLevel {
+        int width;
+        int height;
+        std::vector<uint8_t> data;
+    };
+
+  private:
+    /** The stages of a request, the workers and the render thread hand them over through the atomic state. */
+    enum class State { Decoding, Decoded, Copying, Copied, Unsupported };
+
+    /** A texture being loaded. */
+    struct TextureRequest {
+        std::filesystem::path file;
+        GLint wrap_s, wrap_t, min_filter, mag_filter;
+        TextureCallback on_loaded;
+        std::atomic<State> state = State::Decoding;
+        GLenum format = 0;             // The internal format of the levels.
+        std::vector<MipLevel> levels;  // The mip chain, released once it is copied to the staging buffer.
+        GLuint staging_buffer = 0;     // The pixel unpack buffer.
+        void* mapping = nullptr;       // The mapping of the staging buffer while the worker copies into it.
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  private:
+    /** The directory of the cached mip chains, empty if the cache is disabled. */
+    std::filesystem::path cache_directory;
+
+    /** The worker threads. */
+    std::vector<std::thread> workers;
+    /** The guard for the jobs and the stopping flag. */
+    std::mutex jobs_mutex;
+    /** Signals the workers that a job is available or that they should stop. */
+    std::condition_variable jobs_available;
+    /** The jobs waiting for a worker. */
+    std::deque<std::function<void()>> jobs;
+    /** The flag telling the workers to exit. */
+    bool stopping = false;
+
+    /** The requests that have not been completed yet, owned by the render thread. */
+    std::vector<std::shared_ptr<TextureRequest>> requests;
+
+    /** The number of mip chains read from the cache and decoded from the files. */
+    std::atomic<int> cached_count = 0;
+    std::atomic<int> decoded_count = 0;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Starts the workers.
+     *
+     * @param 	worker_count	The number of worker threads.
+     */
+    explicit AssetLoader(int worker_count = 2);
+
+    /** Stops the workers and releases the staging buffers of the unfinished requests. */
+    ~AssetLoader();
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** Sets the directory of the cached mip chains (created when needed), an empty path disables the cache. */
+    void set_cache_directory(const std::filesystem::path& directory) { cache_directory = directory; }
+
+    /**
+     * Starts loading a 2D texture with a full mip chain.
+     *
+     * @param 	file	  	The image file.
+     * @param 	wrap_s, wrap_t, min_filter, mag_filter	The sampling parameters of the texture.
+     * @param 	on_loaded 	Called from {@link update} once the texture is ready.
+     */
+    void load_texture_2d(const std::filesystem::path& file, GLint wrap_s, GLint wrap_t, GLint min_filter, GLint mag_filter,
+                         TextureCallback on_loaded);
+
+    /** Advances the requests, must be called from the thread owning the OpenGL context (e.g., once per frame). */
+    void update();
+
+    /** Blocks until every request has been completed (e.g., before the first frame of an offline rendering). */
+    void wait();
+
+    /** @return The number of requests that have not been completed yet. */
+    int get_pending_count() const { return static_cast<int>(requests.size()); }
+
+    /** @return The number of mip chains read from the cache. */
+    int get_cached_count() const { return cached_count; }
+
+    /** @return The number of images decoded from their files. */
+    int get_decoded_count() const { return decoded_count; }
+
+  private:
+    /** Queues a job for the workers. */
+    void post(std::function<void()> job);
+
+    /** The job decoding the file of the request or reading its mip chain from the cache. */
+    void decode(TextureRequest& request);
+
+    /** Creates the texture from the staging buffer of the request. */
+    GLuint upload(TextureRequest& request);
+};
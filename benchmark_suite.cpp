@@ -0,0 +1,285 @@
+#include "benchmark_suite.hpp"
+#include "application.hpp"
+#include "command_line.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace {
+constexpr const char* percentile_names[3] = {"p50", "p95", "p99"};
+constexpr double percentiles[3] = {0.50, 0.95, 0.99};
+
+/** Computes the nearest-rank percentiles of the values. */
+void compute_percentiles(std::vector<float> values, float (&result)[3]) {
+    if (values.empty()) return;
+    std::sort(values.begin(), values.end());
+    for (int i = 0; i < 3; i++) {
+        const size_t rank = static_cast<size_t>(std::ceil(percentiles[i] * static_cast<double>(values.size())));
+        result[i] = values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+    }
+}
+
+/** @return The camera of the built-in presets, orbiting the snowman like the default offline rendering. */
+glm::vec3 orbit_position(int frame) {
+    const float azimuth = glm::radians(-45.0f + 0.5f * static_cast<float>(frame));
+    const float elevation = glm::radians(20.0f);
+    return 25.0f * glm::vec3(std::cos(elevation) * std::sin(azimuth), std::sin(elevation), std::cos(elevation) * std::cos(azimuth));
+}
+
+/** @return The text escaped for a JSON string. */
+std::string json_string(const std::string& text) {
+    std::string escaped = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped + "\"";
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Settings
+// ----------------------------------------------------------------------------
+BenchmarkSettings BenchmarkSettings::from_arguments(const std::vector<std::string>& arguments) {
+    BenchmarkSettings settings;
+    settings.enabled = CommandLine::has_flag(arguments, "--benchmark") || CommandLine::has_flag(arguments, "--replay");
+    settings.frame_count = std::max(1, CommandLine::get_int(arguments, "--benchmark-frames", settings.frame_count));
+    settings.warmup_frames = std::max(0, CommandLine::get_int(arguments, "--benchmark-warmup", settings.warmup_frames));
+    settings.time_step = CommandLine::get_float(arguments, "--time-step", settings.time_step);
+    if (CommandLine::has_flag(arguments, "--replay")) {
+        settings.replay = CommandLine::get_string(arguments, "--replay", "");
+    }
+    settings.output = CommandLine::get_string(arguments, "--benchmark-output", settings.output.string());
+    if (CommandLine::has_flag(arguments, "--benchmark-baseline")) {
+        settings.baseline = CommandLine::get_string(arguments, "--benchmark-baseline", "");
+    }
+    settings.regression_threshold = CommandLine::get_float(arguments, "--regression-threshold", settings.regression_threshold);
+    settings.regression_floor = CommandLine::get_float(arguments, "--regression-floor", settings.regression_floor);
+    return settings;
+}
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+BenchmarkSuite::BenchmarkSuite(Application& application, BenchmarkSettings settings) : application(application), settings(std::move(settings)) {}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+std::vector<BenchmarkSuite::Workload> BenchmarkSuite::get_presets() {
+    // * Basic = (3 Reflections, 16 Shadow, 16 AO, 4096 Particles), without the progressive and adaptive features.
+    const SettingList basic = {{"use_ray_tracing", "1"},       {"use_cpu_ray_tracing", "0"},     {"reflections", "3"},
+                               {"shadow_samples", "16"},       {"use_ambient_occlusion", "1"},   {"ambient_occlusion_samples", "16"},
+                               {"particle_count", "4096"},     {"show_particles", "1"},          {"use_accumulation", "0"},
+                               {"use_dynamic_resolution", "0"}, {"render_scale", "1"},           {"use_analytic_visibility", "0"}};
+    const auto with = [&](SettingList changes) {
+        SettingList settings = basic;
+        settings.insert(settings.end(), changes.begin(), changes.end());
+        return settings;
+    };
+    return {{"Rasterization", with({{"use_ray_tracing", "0"}}), {}},
+            {"Ray Tracing Basic", basic, {}},
+            {"Max Reflections", with({{"reflections", "100"}}), {}},
+            {"Max Particle Simulation", with({{"particle_count", std::to_string(max_particle_count)}}), {}},
+            {"Max Shadow Sample", with({{"shadow_samples", "128"}}), {}},
+            {"Max Ambient Occlusion", with({{"ambient_occlusion_samples", "64"}}), {}},
+            {"Wavefront Ray Tracing", with({{"use_wavefront_ray_tracing", "1"}}), {}},
+            {"Hybrid Visibility Buffer", with({{"use_hybrid_rendering", "1"}}), {}},
+            {"Denoised Low Samples", with({{"use_denoiser", "1"}, {"shadow_samples", "1"}, {"ambient_occlusion_samples", "4"}}), {}}};
+}
+
+int BenchmarkSuite::run() {
+    std::vector<Workload> workloads;
+    if (settings.replay) {
+        std::optional<SceneCapture> capture = SceneCapture::load(*settings.replay);
+        if (!capture || capture->frames.empty()) {
+            std::cerr << "Could not read the capture " << *settings.replay << "." << std::endl;
+            return 1;
+        }
+        workloads.push_back({settings.replay->stem().string(), {}, std::move(capture->frames)});
+    } else {
+        workloads = get_presets();
+    }
+
+    const SettingList defaults = application.get_settings();
+    const bool was_recording = application.get_profiler().is_recording();
+    application.finish_loading();
+
+    std::vector<Result> results;
+    for (const Workload& workload : workloads) {
+        std::cout << "Measuring " << workload.name << "..." << std::endl;
+        results.push_back(measure(workload, defaults));
+    }
+
+    // Returns the application to the state it started in.
+    for (const auto& [name, value] : defaults) {
+        application.set_setting(name, value);
+    }
+    application.set_scripted_time(std::nullopt);
+    application.set_scripted_eye_position(std::nullopt);
+    application.get_profiler().set_recording(was_recording);
+
+    std::cout << std::left << std::setw(26) << "preset" << std::right;
+    for (const char* name : percentile_names) std::cout << std::setw(10) << (std::string("cpu ") + name);
+    for (const char* name : percentile_names) std::cout << std::setw(10) << (std::string("gpu ") + name);
+    std::cout << std::endl << std::fixed << std::setprecision(2);
+    for (const Result& result : results) {
+        std::cout << std::left << std::setw(26) << result.name << std::right;
+        for (const float value : result.cpu) std::cout << std::setw(10) << value;
+        for (const float value : result.gpu) std::cout << std::setw(10) << value;
+        std::cout << std::endl;
+    }
+
+    if (!write_reports(results)) {
+        std::cerr << "Could not write the reports " << settings.output << ".csv/.json." << std::endl;
+        return 1;
+    }
+    return settings.baseline && compare_with_baseline(results) > 0 ? 2 : 0;
+}
+
+BenchmarkSuite::Result BenchmarkSuite::measure(const Workload& workload, const SettingList& defaults) {
+    for (const auto& [name, value] : defaults) {
+        application.set_setting(name, value);
+    }
+    for (const auto& [name, value] : workload.settings) {
+        application.set_setting(name, value);
+    }
+    if (!workload.frames.empty()) {
+        for (const auto& [name, value] : workload.frames.front().changed_settings) {
+            application.set_setting(name, value);
+        }
+    }
+    application.reset_simulation_state();
+
+    // A capture is replayed as recorded, the presets orbit the camera.
+    const bool replay = !workload.frames.empty();
+    const int frame_count = replay ? static_cast<int>(workload.frames.size()) : settings.frame_count;
+    const int warmup_frames = replay ? 0 : settings.warmup_frames;
+
+    GpuProfiler& profiler = application.get_profiler();
+    std::vector<float> cpu_times;
+    for (int frame = -warmup_frames; frame < frame_count; frame++) {
+        if (frame == 0) {
+            profiler.flush();
+            profiler.clear_recording();
+            profiler.set_recording(true);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        if (replay) {
+            const CaptureFrame& captured = workload.frames[frame];
+            for (const auto& [name, value] : captured.changed_settings) {
+                application.set_setting(name, value);
+            }
+            application.set_scripted_time(captured.time);
+            application.set_scripted_eye_position(captured.eye_position);
+        } else {
+            application.set_scripted_time(static_cast<double>(frame + warmup_frames) * settings.time_step);
+            application.set_scripted_eye_position(orbit_position(frame + warmup_frames));
+        }
+        application.update(settings.time_step);
+        application.render();
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (frame >= 0) {
+            cpu_times.push_back(static_cast<float>(elapsed.count()));
+        }
+    }
+    profiler.flush();
+    profiler.set_recording(false);
+
+    Result result;
+    result.name = workload.name;
+    result.frames = frame_count;
+    compute_percentiles(cpu_times, result.cpu);
+    compute_percentiles(profiler.get_recorded_values(GpuProfiler::frame_scope), result.gpu);
+    profiler.clear_recording();
+    return result;
+}
+
+bool BenchmarkSuite::write_reports(const std::vector<Result>& results) const {
+    if (settings.output.has_parent_path()) {
+        std::filesystem::create_directories(settings.output.parent_path());
+    }
+
+    std::ofstream csv(settings.output.string() + ".csv");
+    csv << "preset,frames,cpu_p50_ms,cpu_p95_ms,cpu_p99_ms,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms\n";
+    for (const Result& result : results) {
+        csv << result.name << "," << result.frames;
+        for (const float value : result.cpu) csv << "," << value;
+        for (const float value : result.gpu) csv << "," << value;
+        csv << "\n";
+    }
+
+    std::ofstream json(settings.output.string() + ".json");
+    json << "{\n  \"time_step_ms\": " << settings.time_step << ",\n  \"presets\": [\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const Result& result = results[r];
+        json << "    {\"name\": " << json_string(result.name) << ", \"frames\": " << result.frames;
+        for (int i = 0; i < 3; i++) json << ", \"cpu_" << percentile_names[i] << "_ms\": " << result.cpu[i];
+        for (int i = 0; i < 3; i++) json << ", \"gpu_" << percentile_names[i] << "_ms\": " << result.gpu[i];
+        json << "}" << (r + 1 < results.size() ? "," : "") << "\n";
+    }
+    json << "  ]\n}\n";
+    return static_cast<bool>(csv) && static_cast<bool>(json);
+}
+
+int BenchmarkSuite::compare_with_baseline(const std::vector<Result>& results) const {
+    std::ifstream file(*settings.baseline);
+    if (!file) {
+        std::cerr << "Could not read the baseline " << *settings.baseline << "." << std::endl;
+        return 0;
+    }
+
+    // The columns after the name and the frame count are the percentiles in the order of the report.
+    std::map<std::string, std::vector<float>> baseline;
+    std::string line;
+    std::getline(file, line);
+    for (int row = 2; std::getline(file, line); row++) {
+        std::istringstream stream(line);
+        std::string name, value;
+        std::getline(stream, name, ',');
+        std::getline(stream, value, ',');
+        // A malformed row is reported and skipped, its workload is then compared as if it was not in the baseline.
+        std::vector<float> values;
+        bool valid = true;
+        for (int column = 3; valid && std::getline(stream, value, ','); column++) {
+            try {
+                values.push_back(value.empty() ? 0.0f : std::stof(value));
+            } catch (const std::exception&) {
+                std::cerr << "Invalid value '" << value << "' in row " << row << ", column " << column << " of the baseline, skipping the row." << std::endl;
+                valid = false;
+            }
+        }
+        if (valid) {
+            baseline[name] = std::move(values);
+        }
+    }
+
+    int regressions = 0;
+    std::cout << "Comparison with " << *settings.baseline << " (regression above +" << settings.regression_threshold << "% and +"
+              << settings.regression_floor << " ms):" << std::endl;
+    for (const Result& result : results) {
+        const auto it = baseline.find(result.name);
+        if (it == baseline.end() || it->second.size() < 6) {
+            std::cout << "  " << result.name << ": not in the baseline" << std::endl;
+            continue;
+        }
+        for (int i = 0; i < 6; i++) {
+            const float before = it->second[i];
+            const float after = i < 3 ? result.cpu[i] : result.gpu[i - 3];
+            const bool regression = after > before * (1.0f + settings.regression_threshold / 100.0f) && after - before > settings.regression_floor;
+            if (regression) regressions++;
+            std::cout << "  " << std::left << std::setw(26) << result.name << std::setw(5) << (i < 3 ? "cpu" : "gpu") << std::setw(5)
+                      << percentile_names[i % 3] << std::right << std::setw(10) << before << " -> " << std::setw(10) << after
+                      << std::setw(9) << std::showpos << (before > 0.0f ? 100.0f * (after - before) / before : 0.0f) << "%"
+                      << std::noshowpos << (regression ? "  REGRESSION" : "") << std::endl;
+        }
+    }
+    std::cout << regressions << " regressions." << std::endl;
+    return regressions;
+}
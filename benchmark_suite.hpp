@@ -0,0 +1,96 @@
+#pragma once
+#include "scene_capture.hpp"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+class Application;
+
+/** The settings of the benchmark suite. */
+struct BenchmarkSettings {
+    bool enabled = false;                          // The flag determining if the suite should run instead of the UI.
+    int frame_count = 300;                         // The number of measured frames of every preset.
+    int warmup_frames = 30;                        // The number of frames rendered before the measurement starts.
+    float time_step = 1000.0f / 60.0f;             // The fixed time step between frames (in ms).
+    std::optional<std::filesystem::path> replay;   // The capture replayed instead of the built-in presets.
+    std::filesystem::path output = "benchmark";    // The path of the reports without the extension (.csv and .json).
+    std::optional<std::filesystem::path> baseline; // The CSV report of an earlier run the results are compared with.
+    float regression_threshold = 10.0f;            // The slowdown of a percentile reported as a regression (in %).
+    float regression_floor = 0.1f;                 // The smallest slowdown reported as a regression (in ms).
+
+    /**
+     * Reads the settings from the command line.
+     *
+     * --benchmark, --replay FILE (implies --benchmark), --benchmark-frames N, --benchmark-warmup N, --time-step MS,
+     * --benchmark-output PATH, --benchmark-baseline FILE.csv, --regression-threshold PERCENT, --regression-floor MS
+     */
+    static BenchmarkSettings from_arguments(const std::vector<std::string>& arguments);
+};
+
+/**
+ * Replays the presets of the performance table (or a recorded capture) deterministically and reports the frame times.
+ *
+ * Every preset starts from the same state: the settings of the preset are applied over the settings the application
+ * started with, and the particles, the accumulation, and the sample sequences are restarted. The frames run with a fixed
+ * time step. The built-in presets orbit the camera around the snowman, and a capture replays its recorded camera,
+ * scene time, and settings. The suite reports the 50th, 95th, and 99th percentiles of the CPU time of a frame
+ * (update and render) and of its GPU time (the frame scope of the {@link GpuProfiler}). It writes them into a CSV and a
+ * JSON file. With a baseline report, every percentile that got slower by more than the threshold is flagged and the
+ * exit code is 2.
+ */
+class BenchmarkSuite {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  public:
+    /** A replayed workload. */
+    struct Workload {
+        std::string name;          // The name of the preset.
+        SettingList settings;      // The settings applied before the first frame.
+        std::vector<CaptureFrame> frames; // The frames, empty for the orbit of the built-in presets.
+    };
+
+    /** The measured percentiles of a workload (in ms). */
+    struct Result {
+        std::string name;
+        int frames = 0;
+        float cpu[3] = {}; // p50, p95, p99
+        float gpu[3] = {}; // p50, p95, p99
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  private:
+    /** The application that renders the frames. */
+    Application& application;
+    /** The settings. */
+    BenchmarkSettings settings;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    BenchmarkSuite(Application& application, BenchmarkSettings settings);
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** Runs all the workloads and writes the reports, returns the exit code of the application. */
+    int run();
+
+    /** @return The presets of the performance table in the README. */
+    static std::vector<Workload> get_presets();
+
+  private:
+    /** Renders the workload and measures its frames. */
+    Result measure(const Workload& workload, const SettingList& defaults);
+
+    /** Writes the CSV and the JSON report, returns false if any of them could not be written. */
+    bool write_reports(const std::vector<Result>& results) const;
+
+    /** Compares the results with the baseline and prints the table, returns the number of regressions. */
+    int compare_with_baseline(const std::vector<Result>& results) const;
+};
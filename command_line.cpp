@@ -0,0 +1,55 @@
+#include "command_line.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace CommandLine {
+namespace {
+/** @return The pointer to the value following the option or nullptr if there is none, another option is not a value. */
+const std::string* find_value(const std::vector<std::string>& arguments, const std::string& name) {
+    const auto it = std::find(arguments.begin(), arguments.end(), name);
+    if (it == arguments.end() || it + 1 == arguments.end()) {
+        return nullptr;
+    }
+    if ((it + 1)->rfind("--", 0) == 0) {
+        std::cerr << "Missing value of " << name << " before " << *(it + 1) << ", using the default value." << std::endl;
+        return nullptr;
+    }
+    return &*(it + 1);
+}
+} // namespace
+
+bool has_flag(const std::vector<std::string>& arguments, const std::string& name) {
+    return std::find(arguments.begin(), arguments.end(), name) != arguments.end();
+}
+
+std::string get_string(const std::vector<std::string>& arguments, const std::string& name, const std::string& default_value) {
+    const std::string* value = find_value(arguments, name);
+    return value ? *value : default_value;
+}
+
+int get_int(const std::vector<std::string>& arguments, const std::string& name, int default_value) {
+    const std::string* value = find_value(arguments, name);
+    if (!value) {
+        return default_value;
+    }
+    try {
+        return std::stoi(*value);
+    } catch (const std::exception&) {
+        std::cerr << "Invalid value '" << *value << "' of " << name << ", using " << default_value << "." << std::endl;
+        return default_value;
+    }
+}
+
+float get_float(const std::vector<std::string>& arguments, const std::string& name, float default_value) {
+    const std::string* value = find_value(arguments, name);
+    if (!value) {
+        return default_value;
+    }
+    try {
+        return std::stof(*value);
+    } catch (const std::exception&) {
+        std::cerr << "Invalid value '" << *value << "' of " << name << ", using " << default_value << "." << std::endl;
+        return default_value;
+    }
+}
+} // namespace CommandLine
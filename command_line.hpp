@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+
+/**
+ * Helpers reading options from the command line arguments passed to the {@link Application}.
+ *
+ * The options have the form "--name value", flags the form "--name". Malformed values and options followed by another
+ * option instead of a value are reported and replaced by the default value.
+ */
+namespace CommandLine {
+/** @return Whether the flag is present. */
+bool has_flag(const std::vector<std::string>& arguments, const std::string& name);
+
+/** @return The value following the option or the default value if the option is not present. */
+std::string get_string(const std::vector<std::string>& arguments, const std::string& name, const std::string& default_value);
+
+/** @return The integer value following the option or the default value if the option is not present. */
+int get_int(const std::vector<std::string>& arguments, const std::string& name, int default_value);
+
+/** @return The float value following the option or the default value if the option is not present. */
+float get_float(const std::vector<std::string>& arguments, const std::string& name, float default_value);
+} // namespace CommandLine
@@ -0,0 +1,116 @@
+#include "cpu_particle_simulation.hpp"
+#include "simd.hpp"
+#include <algorithm>
+
+using namespace simd;
+
+namespace {
+/** The hash of particle_simulate.comp. */
+vfloat random(vfloat p) {
+    p = fract(p * vfloat(0.1031f));
+    p = p * (p + vfloat(33.33f));
+    p = p * (p + p);
+    return fract(p);
+}
+
+/** Broadcasts a scalar vector into all lanes. */
+vvec3 splat(const glm::vec3& v) { return {v.x, v.y, v.z}; }
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+CpuParticleSimulation::CpuParticleSimulation(TaskScheduler& scheduler) : scheduler(scheduler) {}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void CpuParticleSimulation::resize(int count) {
+    // Only the newly activated range is initialized, the running particles are kept.
+    const size_t padded = (static_cast<size_t>(count) + width - 1) / width * width;
+    if (padded > delay.size()) {
+        position_x.resize(padded, 0.0f);
+        position_y.resize(padded, 0.0f);
+        position_z.resize(padded, 0.0f);
+        delay.resize(padded, -1.0f);
+    }
+    for (size_t i = particle_count; i < static_cast<size_t>(count); i++) {
+        position_x[i] = position_y[i] = position_z[i] = 0.0f;
+        delay[i] = -1.0f;
+    }
+    particle_count = count;
+}
+
+void CpuParticleSimulation::step(const CpuParticleStep& settings, int steps) {
+    if (settings.light_positions.empty() || steps <= 0) {
+        return;
+    }
+    const int chunks = (particle_count + chunk_size - 1) / chunk_size;
+    scheduler.parallel_for(chunks, [&](int chunk, int) { step_chunk(chunk, settings, steps); });
+}
+
+std::vector<glm::vec4> CpuParticleSimulation::get_particles() const {
+    std::vector<glm::vec4> particles(particle_count);
+    for (int i = 0; i < particle_count; i++) {
+        particles[i] = glm::vec4(position_x[i], position_y[i], position_z[i], delay[i]);
+    }
+    return particles;
+}
+
+void CpuParticleSimulation::set_particles(const std::vector<glm::vec4>& particles) {
+    particle_count = 0;
+    resize(static_cast<int>(particles.size()));
+    for (int i = 0; i < particle_count; i++) {
+        position_x[i] = particles[i].x;
+        position_y[i] = particles[i].y;
+        position_z[i] = particles[i].z;
+        delay[i] = particles[i].w;
+    }
+}
+
+void CpuParticleSimulation::step_chunk(int chunk, const CpuParticleStep& settings, int steps) {
+    const int first = chunk * chunk_size;
+    const int last = std::min(first + chunk_size, particle_count);
+    const int light_count = static_cast<int>(settings.light_positions.size());
+
+    const vfloat t_delta = settings.t_delta;
+    const vvec3 gravity = splat(settings.gravity);
+    const vvec3 fall = vfloat(0.5f) * gravity * t_delta * t_delta;
+    const vfloat light_radius = settings.light_radius;
+
+    // The particles stay in the registers for all the steps, they do not interact.
+    for (int i = first; i < last; i += width) {
+        // The lights, the directions and the lifetimes are fixed per particle, so they are recomputed instead of stored.
+        float id[width], light_x[width], light_y[width], light_z[width];
+        for (int l = 0; l < width; l++) {
+            const glm::vec3& light = settings.light_positions[(i + l) % light_count];
+            id[l] = static_cast<float>(i + l);
+            light_x[l] = light.x;
+            light_y[l] = light.y;
+            light_z[l] = light.z;
+        }
+        const vfloat ids = vfloat::load(id);
+        const vvec3 direction = normalize(vvec3(random(ids + vfloat(1.0f)), random(ids + vfloat(2.0f)), random(ids + vfloat(3.0f))) * vfloat(2.0f) -
+                                          vvec3(1.0f, 1.0f, 1.0f));
+        const vfloat lifetime = random(ids);
+        const vvec3 spawn = vvec3(vfloat::load(light_x), vfloat::load(light_y), vfloat::load(light_z)) + direction * light_radius;
+        const vvec3 launch = direction * vfloat(1.5f);
+
+        vvec3 position(vfloat::load(&position_x[i]), vfloat::load(&position_y[i]), vfloat::load(&position_z[i]));
+        vfloat remaining = vfloat::load(&delay[i]);
+        for (int step = 0; step < steps; step++) {
+            const vmask respawn = (remaining < vfloat(0.0f)) | (position.y < vfloat(0.0f));
+            position = select(respawn, spawn, position);
+            remaining = select(respawn, lifetime, remaining);
+
+            // The velocity at the spawn plus the gravity over the age of the particle.
+            const vvec3 velocity = launch + gravity * (lifetime - remaining);
+            remaining = remaining - t_delta;
+            position = position + (velocity * t_delta + fall);
+        }
+        position.x.store(&position_x[i]);
+        position.y.store(&position_y[i]);
+        position.z.store(&position_z[i]);
+        remaining.store(&delay[i]);
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "task_scheduler.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+
+/** The settings of a simulation step, they mirror the uniforms of particle_simulate.comp. */
+struct CpuParticleStep {
+    std::vector<glm::vec3> light_positions;            // The positions of the lights the particles respawn around.
+    float light_radius = 0.5f;                         // The radius of the light spheres.
+    float t_delta = 1000.0f / 120.0f * 0.0001f;        // The fixed time step of the simulation.
+    glm::vec3 gravity = glm::vec3(0.0f, -9.81f, 0.0f); // The gravity.
+};
+
+/**
+ * The CPU implementation of shaders/particle_simulate.comp.
+ *
+ * The particles have the same state (the position and the remaining time) and are updated by the same equations with the
+ * same hash, so the result can be compared with the GPU buffer particle by particle. The state is stored in SoA layout and
+ * simd::width particles are integrated and respawned at once, the particles are split into chunks of {@link chunk_size}
+ * that are distributed over all cores by the {@link TaskScheduler}. Every particle is updated independently and the
+ * chunks do not depend on the number of workers, so the result does not depend on the number of threads.
+ *
+ * The hash amplifies every rounding difference, so the spawn directions only match the shader when the compiler does not
+ * contract the multiplications and the additions into FMAs (the default x86-64 flags, or -ffp-contract=off with -mfma).
+ */
+class CpuParticleSimulation {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The number of particles in a task, a multiple of simd::width. */
+    static constexpr int chunk_size = 16384;
+
+  private:
+    /** The scheduler distributing the chunks. */
+    TaskScheduler& scheduler;
+    /** The number of active particles. */
+    int particle_count = 0;
+    /** The state of the particles, padded to a multiple of simd::width (the padding is simulated but never read). */
+    std::vector<float> position_x, position_y, position_z, delay;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    explicit CpuParticleSimulation(TaskScheduler& scheduler);
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** Changes the number of particles like Application::update_particle_buffer, the new ones wait for their first spawn. */
+    void resize(int count);
+
+    /**
+     * Advances all the particles.
+     *
+     * @param 	settings	The settings of the steps, at least one light is required.
+     * @param 	steps   	The number of fixed steps.
+     */
+    void step(const CpuParticleStep& settings, int steps = 1);
+
+    /** @return The number of active particles. */
+    int get_particle_count() const { return particle_count; }
+
+    /** @return The particles in the layout of the particle buffer (xyz = position, w = delay). */
+    std::vector<glm::vec4> get_particles() const;
+
+    /** Replaces all the particles, e.g., with a readback of the particle buffer. */
+    void set_particles(const std::vector<glm::vec4>& particles);
+
+  private:
+    /** Advances the particles of a single chunk. */
+    void step_chunk(int chunk, const CpuParticleStep& settings, int steps);
+};
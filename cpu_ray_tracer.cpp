@@ -0,0 +1,364 @@
+#include "cpu_ray_tracer.hpp"
+#include "application.hpp"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace simd;
+
+namespace {
+// ----------------------------------------------------------------------------
+// Constants (see ray_tracing.frag)
+// ----------------------------------------------------------------------------
+constexpr float PI = 3.14159265359f;
+constexpr float epsilon = 1e-2f;
+constexpr float miss_t = 1e20f;
+constexpr float near_plane = 1.0f;
+constexpr float far_plane = 1000.0f;
+
+/** The object id of the ground plane. */
+constexpr float plane_id = -1.0f;
+/** The object id of a miss. */
+constexpr float miss_id = -2.0f;
+
+// ----------------------------------------------------------------------------
+// Ray Tracing Structures
+// ----------------------------------------------------------------------------
+/** The closest intersections of a ray packet, the id is the index of the sphere, {@link plane_id} or {@link miss_id}. */
+struct HitPacket {
+    vfloat t;
+    vfloat id;
+};
+
+/** The hash used by the shader (from ShaderToy, https://www.shadertoy.com/view/4djSRW). */
+float random(float x, float y) {
+    const float value = std::sin(x * 12.9898f + y * 78.233f) * 43758.5453f;
+    return value - std::floor(value);
+}
+
+/** Broadcasts a scalar vector into all lanes. */
+vvec3 splat(const glm::vec3& v) { return {v.x, v.y, v.z}; }
+
+/** Loads a vector stored per lane in three arrays. */
+vvec3 load(const float* x, const float* y, const float* z) { return {vfloat::load(x), vfloat::load(y), vfloat::load(z)}; }
+
+// ----------------------------------------------------------------------------
+// Intersections
+// ----------------------------------------------------------------------------
+/**
+ * Mirrors Evaluate() and EvaluateExcludeLight(): the ground plane and then the first sphere_count spheres.
+ *
+ * @param 	stop_at_empty	Mirrors the early break on zero radius spheres in Evaluate().
+ */
+HitPacket closest_hit(const CpuRayTracer::Scene& scene, const vvec3& origin, const vvec3& direction, int sphere_count, bool stop_at_empty) {
+    // RayPlaneIntersection with the normal (0, 1, 0) going through the origin.
+    const vfloat plane_t = -origin.y / direction.y;
+    const vfloat plane_x = origin.x + plane_t * direction.x;
+    const vfloat plane_z = origin.z + plane_t * direction.z;
+    const vmask plane_miss =
+        (plane_t < 0.0f) | (plane_x > 40.0f) | (plane_x < -40.0f) | (plane_z > 40.0f) | (plane_z < -40.0f);
+
+    HitPacket hit;
+    hit.t = select(plane_miss, miss_t, plane_t);
+    hit.id = select(plane_miss, miss_id, plane_id);
+
+    for (int i = 0; i < sphere_count; i++) {
+        const float radius = scene.radius[i];
+        if (stop_at_empty && radius == 0.0f) break;
+
+        // RaySphereIntersection, note that it expects normalized directions.
+        const vvec3 oc = origin - vvec3(scene.center_x[i], scene.center_y[i], scene.center_z[i]);
+        const vfloat b = dot(direction, oc);
+        const vfloat c = dot(oc, oc) - radius * radius;
+        const vfloat det = b * b - c;
+        const vfloat sqrt_det = sqrt(det);
+        const vfloat t_near = -b - sqrt_det;
+        const vfloat t = select(t_near < 0.0f, -b + sqrt_det, t_near);
+        const vmask miss = (det < 0.0f) | (t < 0.0f);
+
+        const vmask closer = and_not(t < hit.t, miss);
+        hit.t = select(closer, t, hit.t);
+        hit.id = select(closer, static_cast<float>(i), hit.id);
+    }
+    return hit;
+}
+
+/** Returns the lanes where the ray hits anything in EvaluateExcludeLight(), i.e., where the hit would not be a miss. */
+vmask any_hit(const CpuRayTracer::Scene& scene, const vvec3& origin, const vvec3& direction, int sphere_count, vmask active) {
+    const vfloat plane_t = -origin.y / direction.y;
+    const vfloat plane_x = origin.x + plane_t * direction.x;
+    const vfloat plane_z = origin.z + plane_t * direction.z;
+    const vmask plane_miss =
+        (plane_t < 0.0f) | (plane_x > 40.0f) | (plane_x < -40.0f) | (plane_z > 40.0f) | (plane_z < -40.0f);
+    vmask hit = and_not(active, plane_miss);
+
+    for (int i = 0; i < sphere_count; i++) {
+        // The lanes that are already occluded do not need to test further.
+        const vmask pending = and_not(active, hit);
+        if (!any(pending)) break;
+
+        const float radius = scene.radius[i];
+        const vvec3 oc = origin - vvec3(scene.center_x[i], scene.center_y[i], scene.center_z[i]);
+        const vfloat b = dot(direction, oc);
+        const vfloat c = dot(oc, oc) - radius * radius;
+        const vfloat det = b * b - c;
+        const vfloat sqrt_det = sqrt(det);
+        const vfloat t_near = -b - sqrt_det;
+        const vfloat t = select(t_near < 0.0f, -b + sqrt_det, t_near);
+        const vmask miss = (det < 0.0f) | (t < 0.0f);
+        hit = hit | and_not(pending, miss);
+    }
+    return hit;
+}
+
+// ----------------------------------------------------------------------------
+// Shading
+// ----------------------------------------------------------------------------
+/** Mirrors SphereOcclusion() for all active lanes. */
+vfloat sphere_occlusion(const CpuRayTracer::Scene& scene, const CpuRayTracerSettings& settings, int static_count, const vvec3& point,
+                        const vvec3& normal, vmask active) {
+    alignas(32) float px[width], py[width], pz[width];
+    point.x.store(px);
+    point.y.store(py);
+    point.z.store(pz);
+
+    const vvec3 origin = point + normal * vfloat(epsilon);
+    vfloat occlusion = 0.0f;
+
+    for (int i = 0; i < settings.ambient_occlusion_samples; ++i) {
+        alignas(32) float dx[width], dy[width], dz[width];
+        for (int l = 0; l < width; l++) {
+            const float phi = random(px[l], py[l] + static_cast<float>(i)) * 2.0f * PI;
+            const float theta = random(py[l], pz[l] + static_cast<float>(i)) * 0.5f * PI;
+            dx[l] = std::sin(theta) * std::cos(phi);
+            dy[l] = std::cos(theta);
+            dz[l] = std::sin(theta) * std::sin(phi);
+        }
+        const vmask occluded = any_hit(scene, origin, load(dx, dy, dz), static_count, active);
+        occlusion += select(occluded, 1.0f, 0.0f);
+    }
+
+    return vfloat(1.0f) - occlusion / vfloat(static_cast<float>(settings.ambient_occlusion_samples));
+}
+
+/**
+ * Mirrors Trace() for a packet of primary rays.
+ *
+ * @param 	frag_x	The gl_FragCoord.x of every lane.
+ * @param 	frag_y	The gl_FragCoord.y shared by all lanes.
+ * @param 	active	The lanes that belong to the image.
+ * @param 	[out] color    	The resulting colors.
+ * @param 	[out] primary_t	The distance to the first hit, i.e., TraceDepth().
+ */
+void trace(const CpuRayTracer::Scene& scene, const CpuRayTracerSettings& settings, vvec3 origin, vvec3 direction, const float* frag_x,
+           float frag_y, vmask active, vvec3& color, vfloat& primary_t) {
+    const int lights_count = static_cast<int>(scene.light_positions.size());
+    const int static_count = settings.spheres_count - lights_count;
+
+    color = vvec3(0.0f, 0.0f, 0.0f);
+    vvec3 attenuation(1.0f, 1.0f, 1.0f);
+
+    for (int i = 0; i < settings.iterations; ++i) {
+        const HitPacket hit = closest_hit(scene, origin, direction, settings.spheres_count, true);
+        if (i == 0) primary_t = hit.t;
+
+        active = and_not(active, hit.id == miss_id);
+        if (!any(active)) break;
+
+        // Gathers the per-lane data of the hit objects, the plane uses the first material.
+        alignas(32) float ids[width];
+        alignas(32) float cx[width], cy[width], cz[width];
+        alignas(32) float dr[width], dg[width], db[width], fr[width], fg[width], fb[width];
+        alignas(32) float plane[width], light[width];
+        hit.id.store(ids);
+        for (int l = 0; l < width; l++) {
+            const int id = static_cast<int>(ids[l]);
+            const int material = id >= 0 ? id : 0;
+            cx[l] = id >= 0 ? scene.center_x[id] : 0.0f;
+            cy[l] = id >= 0 ? scene.center_y[id] : 0.0f;
+            cz[l] = id >= 0 ? scene.center_z[id] : 0.0f;
+            dr[l] = scene.diffuse_r[material];
+            dg[l] = scene.diffuse_g[material];
+            db[l] = scene.diffuse_b[material];
+            fr[l] = scene.f0_r[material];
+            fg[l] = scene.f0_g[material];
+            fb[l] = scene.f0_b[material];
+            plane[l] = id < 0 ? 1.0f : 0.0f;
+            light[l] = id >= snowman_size ? 1.0f : 0.0f;
+        }
+        const vmask is_plane = vfloat::load(plane) == 1.0f;
+        const vmask is_light = vfloat::load(light) == 1.0f;
+        const vvec3 diffuse = load(dr, dg, db);
+        const vvec3 f0 = load(fr, fg, fb);
+
+        const vvec3 intersection = origin + direction * hit.t;
+        const vvec3 normal = select(is_plane, vvec3(0.0f, 1.0f, 0.0f), normalize(intersection - load(cx, cy, cz)));
+
+        // FresnelSchlick(f0, V, N).
+        const vfloat cos_theta = min(max(dot(-1.0f * direction, normal), 0.0f), 1.0f);
+        const vfloat m = vfloat(1.0f) - cos_theta;
+        const vfloat m5 = m * m * m * m * m;
+        const vvec3 fresnel = f0 + (vvec3(1.0f, 1.0f, 1.0f) - f0) * m5;
+        const vvec3 one_minus_fresnel = vvec3(1.0f, 1.0f, 1.0f) - fresnel;
+
+        const vmask light_lanes = active & is_light;
+        color = color + select(light_lanes, diffuse * one_minus_fresnel * attenuation, vvec3(0.0f, 0.0f, 0.0f));
+        active = and_not(active, is_light);
+        if (!any(active)) break;
+
+        vfloat ao = 1.0f;
+        if (settings.use_ambient_occlusion) {
+            ao = sphere_occlusion(scene, settings, static_count, intersection, normal, active);
+        }
+
+        for (int j = 0; j < lights_count; j++) {
+            const vvec3 L_not_normalized = splat(scene.light_positions[j]) - intersection;
+            const vvec3 L = normalize(L_not_normalized);
+            const vvec3 T = normalize(cross(L, vvec3(0.0f, -1.0f, 0.0f)));
+            const vvec3 B = normalize(cross(L, T));
+
+            const vfloat distance_from_light = length(L_not_normalized);
+            const vfloat radius = vfloat(settings.sphere_light_radius) / distance_from_light;
+            const vfloat atten_factor = vfloat(1.0f) / (vfloat(1.0f) + vfloat(0.5f) * distance_from_light);
+
+            // The part of the contribution that does not depend on the sample.
+            const vvec3 contribution = splat(scene.light_diffuse[j]) * diffuse * one_minus_fresnel * attenuation *
+                                       (max(dot(normal, L), 0.0f) * atten_factor * ao);
+            const vvec3 shadow_origin = intersection + L * vfloat(epsilon);
+
+            vvec3 color_t(0.0f, 0.0f, 0.0f);
+            for (int k = 0; k < settings.shadow_samples; k++) {
+                const float v = static_cast<float>(k + 1) * .152f;
+
+                alignas(32) float angle_cos[width], angle_sin[width], radius_scale[width];
+                for (int l = 0; l < width; l++) {
+                    const float random_value = random(frag_x[l] * v, (frag_y + static_cast<float>(j)) * v);
+                    const float random_angle = 2 * PI * random_value;
+                    angle_cos[l] = std::cos(random_angle);
+                    angle_sin[l] = std::sin(random_angle);
+                    radius_scale[l] = std::sqrt(random_value);
+                }
+                const vfloat random_radius = radius * vfloat::load(radius_scale);
+                const vfloat disk_x = vfloat::load(angle_cos) * random_radius;
+                const vfloat disk_y = vfloat::load(angle_sin) * random_radius;
+                const vvec3 shadow_direction = normalize(L + T * disk_x + B * disk_y);
+
+                const HitPacket shadow_hit = closest_hit(scene, shadow_origin, shadow_direction, static_count, false);
+                const vmask lit = active & ((shadow_hit.id == miss_id) | (shadow_hit.t >= distance_from_light));
+                color_t = color_t + select(lit, contribution, vvec3(0.0f, 0.0f, 0.0f));
+            }
+
+            const vfloat samples = static_cast<float>(settings.shadow_samples);
+            color = color + vvec3(color_t.x / samples, color_t.y / samples, color_t.z / samples);
+        }
+
+        attenuation = attenuation * diffuse * fresnel;
+        active = and_not(active, length(attenuation) < 1e-4f);
+        if (!any(active)) break;
+
+        const vvec3 reflection = direction - normal * (vfloat(2.0f) * dot(normal, direction));
+        origin = intersection + reflection * vfloat(epsilon);
+        direction = reflection;
+    }
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+CpuRayTracer::CpuRayTracer(TaskScheduler& scheduler) : scheduler(scheduler) {}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void CpuRayTracer::render(const Snowman& snowman, const std::vector<PhongLightData>& lights, const CpuRayTracerCamera& camera,
+                          const CpuRayTracerSettings& settings) {
+    // Converts the scene into SoA layout.
+    const int count = snowman_size + light_count;
+    scene.center_x.resize(count);
+    scene.center_y.resize(count);
+    scene.center_z.resize(count);
+    scene.radius.resize(count);
+    scene.diffuse_r.resize(count);
+    scene.diffuse_g.resize(count);
+    scene.diffuse_b.resize(count);
+    scene.f0_r.resize(count);
+    scene.f0_g.resize(count);
+    scene.f0_b.resize(count);
+    for (int i = 0; i < count; i++) {
+        scene.center_x[i] = snowman.spheres[i].x;
+        scene.center_y[i] = snowman.spheres[i].y;
+        scene.center_z[i] = snowman.spheres[i].z;
+        scene.radius[i] = snowman.spheres[i].w;
+        scene.diffuse_r[i] = snowman.materials[i].diffuse.x;
+        scene.diffuse_g[i] = snowman.materials[i].diffuse.y;
+        scene.diffuse_b[i] = snowman.materials[i].diffuse.z;
+        scene.f0_r[i] = snowman.materials[i].f0.x;
+        scene.f0_g[i] = snowman.materials[i].f0.y;
+        scene.f0_b[i] = snowman.materials[i].f0.z;
+    }
+    scene.light_positions.clear();
+    scene.light_diffuse.clear();
+    for (const PhongLightData& light : lights) {
+        scene.light_positions.push_back(glm::vec3(light.position));
+        scene.light_diffuse.push_back(light.diffuse);
+    }
+
+    color.resize(static_cast<size_t>(settings.width) * settings.height);
+    depth.resize(static_cast<size_t>(settings.width) * settings.height);
+
+    const int tiles_x = (settings.width + tile_size - 1) / tile_size;
+    const int tiles_y = (settings.height + tile_size - 1) / tile_size;
+    scheduler.parallel_for(tiles_x * tiles_y, [&](int tile, int) { render_tile(tile, camera, settings); });
+}
+
+void CpuRayTracer::render_tile(int tile, const CpuRayTracerCamera& camera, const CpuRayTracerSettings& settings) {
+    const int tiles_x = (settings.width + tile_size - 1) / tile_size;
+    const int x0 = (tile % tiles_x) * tile_size;
+    const int y0 = (tile / tiles_x) * tile_size;
+    const int x1 = std::min(x0 + tile_size, settings.width);
+    const int y1 = std::min(y0 + tile_size, settings.height);
+
+    // The shader computes vec3(view_inv * projection_inv * vec4(uv, -1.0, 1.0)), i.e., without the perspective division.
+    const glm::mat4 inverse = camera.view_inv * camera.projection_inv;
+
+    for (int y = y0; y < y1; y++) {
+        const float frag_y = static_cast<float>(y) + 0.5f;
+        const float v = 2.0f * frag_y / static_cast<float>(settings.height) - 1.0f;
+
+        for (int x = x0; x < x1; x += width) {
+            alignas(32) float frag_x[width], lane_u[width], lane_valid[width];
+            for (int l = 0; l < width; l++) {
+                frag_x[l] = static_cast<float>(x + l) + 0.5f;
+                lane_u[l] = 2.0f * frag_x[l] / static_cast<float>(settings.width) - 1.0f;
+                lane_valid[l] = x + l < x1 ? 1.0f : 0.0f;
+            }
+            const vmask active = vfloat::load(lane_valid) == 1.0f;
+            const vfloat u = vfloat::load(lane_u);
+
+            const vvec3 P(u * inverse[0].x + v * inverse[1].x - inverse[2].x + inverse[3].x,
+                          u * inverse[0].y + v * inverse[1].y - inverse[2].y + inverse[3].y,
+                          u * inverse[0].z + v * inverse[1].z - inverse[2].z + inverse[3].z);
+            const vvec3 origin = splat(camera.eye_position);
+            const vvec3 direction = normalize(P - origin);
+
+            vvec3 lane_color;
+            vfloat primary_t = miss_t;
+            trace(scene, settings, origin, direction, frag_x, frag_y, active, lane_color, primary_t);
+
+            // Computes the depth in the same way as the shader.
+            const vfloat lane_depth = (vfloat(1.0f) / primary_t - vfloat(1.0f / near_plane)) / vfloat(1.0f / far_plane - 1.0f / near_plane);
+
+            alignas(32) float r[width], g[width], b[width], d[width];
+            lane_color.x.store(r);
+            lane_color.y.store(g);
+            lane_color.z.store(b);
+            lane_depth.store(d);
+            for (int l = 0; l < width && x + l < x1; l++) {
+                const size_t index = static_cast<size_t>(y) * settings.width + x + l;
+                color[index] = glm::vec4(r[l], g[l], b[l], 1.0f);
+                depth[index] = d[l];
+            }
+        }
+    }
+}
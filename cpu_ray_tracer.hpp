@@ -0,0 +1,97 @@
+#pragma once
+#include "light_ubo.hpp"
+#include "task_scheduler.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+
+struct Snowman;
+
+/** The settings of the CPU ray tracer, they mirror the uniforms of ray_tracing.frag. */
+struct CpuRayTracerSettings {
+    int width = 0;                          // The width of the image.
+    int height = 0;                         // The height of the image.
+    int spheres_count = 0;                  // The number of spheres (snowman + light spheres).
+    int iterations = 3;                     // The number of reflections.
+    float sphere_light_radius = 0.5f;       // The radius of the area lights.
+    int shadow_samples = 16;                // The number of shadow samples.
+    bool use_ambient_occlusion = true;      // The flag determining if the ambient occlusion should be used.
+    int ambient_occlusion_samples = 16;     // The number of ambient occlusion samples.
+};
+
+/** The camera used by the CPU ray tracer, the same data the shader reads from CameraBuffer. */
+struct CpuRayTracerCamera {
+    glm::mat4 view_inv;       // The inverse of the view matrix.
+    glm::mat4 projection_inv; // The inverse of the projection matrix.
+    glm::vec3 eye_position;   // The position of the eye in world space.
+};
+
+/**
+ * The CPU reference implementation of shaders/ray_tracing.frag.
+ *
+ * It evaluates the same Trace()/Evaluate()/SphereOcclusion() code paths with the same hash-based random numbers, so the
+ * result can be compared with the shader output pixel by pixel. The rays are traced in packets of simd::width rays
+ * against spheres stored in SoA layout, the frame is split into tiles that are distributed over all cores by the
+ * {@link TaskScheduler}. Every pixel is computed independently, so the image does not depend on the number of threads.
+ */
+class CpuRayTracer {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  public:
+    /** The scene converted to SoA layout, see {@link Snowman} and PhongLightsBuffer in the shader. */
+    struct Scene {
+        std::vector<float> center_x, center_y, center_z, radius; // The spheres.
+        std::vector<float> diffuse_r, diffuse_g, diffuse_b;      // The diffuse colors of the sphere materials.
+        std::vector<float> f0_r, f0_g, f0_b;                     // The Fresnel reflections at 0 of the sphere materials.
+        std::vector<glm::vec3> light_positions;                  // The positions of the lights.
+        std::vector<glm::vec3> light_diffuse;                    // The diffuse colors of the lights.
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The size of the square tiles the frame is split into. */
+    static constexpr int tile_size = 32;
+
+  private:
+    /** The scheduler distributing the tiles. */
+    TaskScheduler& scheduler;
+    /** The scene of the last rendered frame. */
+    Scene scene;
+    /** The resulting colors, rows are stored bottom-up like in OpenGL. */
+    std::vector<glm::vec4> color;
+    /** The resulting depth, in the same form as gl_FragDepth written by the shader. */
+    std::vector<float> depth;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    explicit CpuRayTracer(TaskScheduler& scheduler);
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Renders the scene.
+     *
+     * @param 	snowman 	The spheres and their materials.
+     * @param 	lights  	The lights, only the positions and the diffuse colors are used.
+     * @param 	camera  	The camera.
+     * @param 	settings	The settings of the ray tracer.
+     */
+    void render(const Snowman& snowman, const std::vector<PhongLightData>& lights, const CpuRayTracerCamera& camera,
+                const CpuRayTracerSettings& settings);
+
+    /** @return The colors of the last rendered frame. */
+    const std::vector<glm::vec4>& get_color() const { return color; }
+
+    /** @return The depth of the last rendered frame. */
+    const std::vector<float>& get_depth() const { return depth; }
+
+  private:
+    /** Renders a single tile. */
+    void render_tile(int tile, const CpuRayTracerCamera& camera, const CpuRayTracerSettings& settings);
+};
@@ -0,0 +1,111 @@
+#include "denoiser.hpp"
+#include "utils.hpp"
+#include <string>
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+Denoiser::~Denoiser() {
+    glDeleteTextures(1, &unshadowed_texture);
+    glDeleteTextures(1, &visibility_texture);
+    glDeleteTextures(2, guide_textures);
+    glDeleteTextures(2, history_textures);
+    glDeleteTextures(2, length_textures);
+    glDeleteTextures(2, filter_textures);
+    glDeleteFramebuffers(1, &framebuffer);
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void Denoiser::resize(int width, int height) {
+    // The textures are immutable, so we have to create new ones.
+    const auto create_texture = [&](GLuint& texture, GLenum format) {
+        glDeleteTextures(1, &texture);
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+        glTextureStorage2D(texture, 1, format, width, height);
+        TextureUtils::set_texture_2d_parameters(texture, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE, GL_NEAREST, GL_NEAREST);
+    };
+    create_texture(unshadowed_texture, GL_RGBA16F);
+    create_texture(visibility_texture, GL_RGBA16F);
+    for (int i = 0; i < 2; i++) {
+        create_texture(guide_textures[i], GL_RGBA16F);
+        create_texture(history_textures[i], GL_RGBA16F);
+        create_texture(length_textures[i], GL_R16F);
+        create_texture(filter_textures[i], GL_RGBA16F);
+    }
+    if (framebuffer == 0) {
+        glCreateFramebuffers(1, &framebuffer);
+    }
+    previous_frame.reset();
+}
+
+void Denoiser::attach(GLuint target_framebuffer) {
+    glNamedFramebufferTexture(target_framebuffer, GL_COLOR_ATTACHMENT1, unshadowed_texture, 0);
+    glNamedFramebufferTexture(target_framebuffer, GL_COLOR_ATTACHMENT2, visibility_texture, 0);
+    glNamedFramebufferTexture(target_framebuffer, GL_COLOR_ATTACHMENT3, guide_textures[1 - current], 0);
+    const GLenum draw_buffers[4] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3};
+    glNamedFramebufferDrawBuffers(target_framebuffer, 4, draw_buffers);
+}
+
+void Denoiser::detach(GLuint target_framebuffer) { glNamedFramebufferDrawBuffer(target_framebuffer, GL_COLOR_ATTACHMENT0); }
+
+GLuint Denoiser::denoise(GpuProgram& temporal_program, GpuProgram& atrous_program, GpuProgram& composite_program, GLuint color_texture,
+                         const DenoiserFrame& frame, int iterations, float light_radius) {
+    const int next = 1 - current;
+    const glm::vec2 resolution = glm::vec2(frame.resolution.x, frame.resolution.y);
+    glViewport(0, 0, frame.resolution.x, frame.resolution.y);
+
+    // The history is only usable if the previous frame was denoised at the same resolution.
+    const bool history_valid = previous_frame && previous_frame->resolution.x == frame.resolution.x &&
+                               previous_frame->resolution.y == frame.resolution.y;
+    const DenoiserFrame& previous = history_valid ? *previous_frame : frame;
+
+    temporal_program.use();
+    temporal_program.uniform("resolution", resolution);
+    temporal_program.uniform("history_valid", history_valid);
+    temporal_program.uniform("previous_view_projection", previous.view_projection);
+    temporal_program.uniform("previous_eye_position", previous.eye_position);
+    for (int i = 0; i < 3; i++) {
+        temporal_program.uniform("previous_light_positions[" + std::to_string(i) + "]", previous.light_positions[i]);
+    }
+    temporal_program.uniform("light_radius", light_radius);
+    glBindTextureUnit(0, visibility_texture);
+    glBindTextureUnit(1, guide_textures[next]);
+    glBindTextureUnit(2, history_textures[current]);
+    glBindTextureUnit(3, guide_textures[current]);
+    glBindTextureUnit(4, length_textures[current]);
+    draw_into(history_textures[next], length_textures[next]);
+
+    // The steps double with every pass, the kernel covers 4 * (2^iterations - 1) + 1 texels.
+    atrous_program.use();
+    atrous_program.uniform("resolution", resolution);
+    glBindTextureUnit(1, guide_textures[next]);
+    GLuint source = history_textures[next];
+    for (int i = 0; i < iterations; i++) {
+        atrous_program.uniform("step_size", 1 << i);
+        glBindTextureUnit(0, source);
+        draw_into(filter_textures[i % 2]);
+        source = filter_textures[i % 2];
+    }
+
+    composite_program.use();
+    glBindTextureUnit(0, color_texture);
+    glBindTextureUnit(1, unshadowed_texture);
+    glBindTextureUnit(2, source);
+    const GLuint result = filter_textures[iterations % 2];
+    draw_into(result);
+
+    current = next;
+    previous_frame = frame;
+    return result;
+}
+
+void Denoiser::draw_into(GLuint target, GLuint second_target) {
+    glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, target, 0);
+    glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT1, second_target, 0);
+    const GLenum draw_buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    glNamedFramebufferDrawBuffers(framebuffer, second_target ? 2 : 1, draw_buffers);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "gpu_program.hpp"
+#include <glm/glm.hpp>
+#include <optional>
+
+/** The camera and the lights a denoised frame was traced with, the next frame reprojects its history with them. */
+struct DenoiserFrame {
+    glm::mat4 view_projection;      // The projection matrix multiplied by the view matrix.
+    glm::vec3 eye_position;         // The position of the eye.
+    glm::vec3 light_positions[3];   // The positions of the light spheres.
+    glm::ivec2 resolution;          // The size of the traced image.
+};
+
+/**
+ * The spatio-temporal denoiser of the shadows and the ambient occlusion of the primary hits.
+ *
+ * With the denoiser enabled, the ray tracer writes four images: the color without the direct light of the primary hit,
+ * the direct light of the primary hit without the shadows and the occlusion (noise free), the visibility (the shadowed
+ * fraction of the direct light per channel and the ambient occlusion), and the guide (the normal and the distance of
+ * the primary hit). Only the visibility is noisy, so only the visibility is filtered:
+ *
+ * 1. The temporal pass reprojects the history of the previous frame with the camera, rejects the texels of other
+ *    surfaces by their normal and distance, and blends it with the new samples. The shadows keep less history when the
+ *    lights move relative to the size of their penumbra, the occlusion of the static scene only depends on the camera.
+ * 2. A fixed number of edge-aware a-trous passes (a 5x5 B3-spline kernel with doubling steps, weighted by the normals
+ *    and the distances of the guide) filter the integrated visibility.
+ * 3. The composite pass multiplies the direct light by the filtered visibility and adds the rest of the color.
+ *
+ * All the passes are full screen passes at the traced resolution, so the cost does not depend on the sample counts.
+ */
+class Denoiser {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The maximum number of a-trous passes. */
+    static constexpr int max_iterations = 5;
+
+  private:
+    /** The RGBA16F direct light of the primary hits without the shadows and the occlusion, written by the ray tracer. */
+    GLuint unshadowed_texture = 0;
+    /** The RGBA16F noisy visibility (rgb = shadows, a = occlusion), written by the ray tracer. */
+    GLuint visibility_texture = 0;
+    /** The RGBA16F guides (xyz = normal, w = distance, 0 if nothing was hit) of the current and the previous frame. */
+    GLuint guide_textures[2] = {0, 0};
+    /** The RGBA16F integrated visibility of the current and the previous frame. */
+    GLuint history_textures[2] = {0, 0};
+    /** The R16F number of frames integrated in {@link history_textures}. */
+    GLuint length_textures[2] = {0, 0};
+    /** The RGBA16F targets of the a-trous passes and the composite pass. */
+    GLuint filter_textures[2] = {0, 0};
+    /** The framebuffer of the passes, the targets are attached before each pass. */
+    GLuint framebuffer = 0;
+
+    /** The index of the textures of the current frame in the pairs. */
+    int current = 0;
+    /** The frame the history was traced with, std::nullopt if there is no usable history. */
+    std::optional<DenoiserFrame> previous_frame;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    Denoiser() = default;
+
+    /** Releases the textures and the framebuffer. */
+    ~Denoiser();
+
+    Denoiser(const Denoiser&) = delete;
+    Denoiser& operator=(const Denoiser&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** Creates the textures for the given maximum image size, the history is discarded. */
+    void resize(int width, int height);
+
+    /** Discards the history, e.g., when a frame was rendered without the denoiser. */
+    void reset() { previous_frame.reset(); }
+
+    /**
+     * Attaches the additional outputs of the ray tracer to the color attachments 1 to 3 of the framebuffer and enables
+     * all four draw buffers. The guide goes to the texture of the next frame.
+     */
+    void attach(GLuint target_framebuffer);
+
+    /** Restores the single draw buffer of the framebuffer. */
+    static void detach(GLuint target_framebuffer);
+
+    /**
+     * Denoises the traced frame, the caller binds the camera and the lights buffers and an empty VAO.
+     *
+     * @param 	temporal_program 	The program of denoise_temporal.frag.
+     * @param 	atrous_program   	The program of denoise_atrous.frag.
+     * @param 	composite_program	The program of denoise_composite.frag.
+     * @param 	color_texture	 	The color written by the ray tracer (without the direct light of the primary hits).
+     * @param 	frame			 	The camera and the lights of the frame.
+     * @param 	iterations		 	The number of a-trous passes (1 to {@link max_iterations}).
+     * @param 	light_radius	 	The radius of the light spheres.
+     * @return	The texture with the denoised color, the bottom-left frame.resolution texels are valid.
+     */
+    GLuint denoise(GpuProgram& temporal_program, GpuProgram& atrous_program, GpuProgram& composite_program, GLuint color_texture,
+                   const DenoiserFrame& frame, int iterations, float light_radius);
+
+  private:
+    /** Renders a full screen pass into the target texture. */
+    void draw_into(GLuint target, GLuint second_target = 0);
+};
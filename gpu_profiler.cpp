@@ -0,0 +1,199 @@
+#include "gpu_profiler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+GpuProfiler::GpuProfiler(size_t history_size) : history_size(std::max<size_t>(1, history_size)) {}
+
+GpuProfiler::~GpuProfiler() {
+    for (FrameQueries& frame : frames) {
+        if (!frame.queries.empty()) {
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void GpuProfiler::begin_frame() {
+    FrameQueries& frame = frames[frame_index % frames_in_flight];
+    if (frame.pending) {
+        // The results are several frames old, so they should be ready; if not, they are dropped instead of waiting.
+        if (!collect(frame)) {
+            dropped_frames++;
+        }
+        frame.pending = false;
+    }
+    std::fill(frame.issued.begin(), frame.issued.end(), false);
+
+    open_scopes.clear();
+    begin_scope(frame_scope);
+}
+
+void GpuProfiler::end_frame() {
+    while (!open_scopes.empty()) {
+        end_scope();
+    }
+    frames[frame_index % frames_in_flight].pending = true;
+    frame_index++;
+}
+
+void GpuProfiler::begin_scope(const std::string& name) {
+    const int id = get_scope_id(name);
+    FrameQueries& frame = frames[frame_index % frames_in_flight];
+    glQueryCounter(frame.queries[2 * id], GL_TIMESTAMP);
+    frame.issued[id] = true;
+    open_scopes.push_back(id);
+}
+
+void GpuProfiler::end_scope() {
+    if (open_scopes.empty()) {
+        return;
+    }
+    const int id = open_scopes.back();
+    open_scopes.pop_back();
+    glQueryCounter(frames[frame_index % frames_in_flight].queries[2 * id + 1], GL_TIMESTAMP);
+}
+
+void GpuProfiler::flush() {
+    glFinish();
+    // The oldest slot is the one used by the next frame.
+    for (int i = 0; i < frames_in_flight; i++) {
+        FrameQueries& frame = frames[(frame_index + i) % frames_in_flight];
+        if (frame.pending) {
+            collect(frame);
+            frame.pending = false;
+        }
+    }
+}
+
+GpuProfiler::Statistics GpuProfiler::get_statistics(const std::string& name) const {
+    Statistics statistics;
+    const auto it = std::find(scope_names.begin(), scope_names.end(), name);
+    if (it == scope_names.end()) {
+        return statistics;
+    }
+    const size_t id = it - scope_names.begin();
+    if (history[id].empty()) {
+        return statistics;
+    }
+
+    std::vector<float> sorted = history[id];
+    std::sort(sorted.begin(), sorted.end());
+
+    double sum = 0.0;
+    for (const float value : sorted) {
+        sum += value;
+    }
+    const size_t p99_index = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(sorted.size()))) - 1;
+
+    statistics.last = last_values[id];
+    statistics.min = sorted.front();
+    statistics.avg = static_cast<float>(sum / static_cast<double>(sorted.size()));
+    statistics.p99 = sorted[std::min(p99_index, sorted.size() - 1)];
+    statistics.samples = static_cast<int>(sorted.size());
+    return statistics;
+}
+
+bool GpuProfiler::write_csv(const std::filesystem::path& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    file << "frame";
+    for (const std::string& name : scope_names) {
+        file << "," << name << "_ms";
+    }
+    file << "\n";
+
+    for (size_t row = 0; row < recorded_frames.size(); row++) {
+        file << row;
+        for (size_t id = 0; id < scope_names.size(); id++) {
+            file << ",";
+            if (id < recorded_frames[row].size() && !std::isnan(recorded_frames[row][id])) {
+                file << recorded_frames[row][id];
+            }
+        }
+        file << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+std::vector<float> GpuProfiler::get_recorded_values(const std::string& name) const {
+    std::vector<float> values;
+    const auto it = std::find(scope_names.begin(), scope_names.end(), name);
+    if (it == scope_names.end()) {
+        return values;
+    }
+    const size_t id = it - scope_names.begin();
+    for (const std::vector<float>& row : recorded_frames) {
+        if (id < row.size() && !std::isnan(row[id])) {
+            values.push_back(row[id]);
+        }
+    }
+    return values;
+}
+
+int GpuProfiler::get_scope_id(const std::string& name) {
+    const auto it = std::find(scope_names.begin(), scope_names.end(), name);
+    if (it != scope_names.end()) {
+        return static_cast<int>(it - scope_names.begin());
+    }
+
+    // Registers a new scope in all the slots of the ring.
+    scope_names.push_back(name);
+    history.emplace_back();
+    history_next.push_back(0);
+    last_values.push_back(0.0f);
+    for (FrameQueries& frame : frames) {
+        GLuint queries[2];
+        glGenQueries(2, queries);
+        frame.queries.insert(frame.queries.end(), queries, queries + 2);
+        frame.issued.push_back(false);
+    }
+    return static_cast<int>(scope_names.size()) - 1;
+}
+
+bool GpuProfiler::collect(FrameQueries& frame) {
+    // Checks all the queries first so that we never block on GL_QUERY_RESULT.
+    for (size_t id = 0; id < frame.issued.size(); id++) {
+        if (!frame.issued[id]) continue;
+        for (int k = 0; k < 2; k++) {
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[2 * id + k], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                return false;
+            }
+        }
+    }
+
+    std::vector<float> row(scope_names.size(), std::numeric_limits<float>::quiet_NaN());
+    for (size_t id = 0; id < frame.issued.size(); id++) {
+        if (!frame.issued[id]) continue;
+
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[2 * id], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[2 * id + 1], GL_QUERY_RESULT, &end);
+        const float milliseconds = static_cast<float>(end - begin) * 1e-6f;
+
+        if (history[id].size() < history_size) {
+            history[id].push_back(milliseconds);
+        } else {
+            history[id][history_next[id]] = milliseconds;
+        }
+        history_next[id] = (history_next[id] + 1) % history_size;
+        last_values[id] = milliseconds;
+        row[id] = milliseconds;
+    }
+
+    if (recording) {
+        recorded_frames.push_back(std::move(row));
+    }
+    return true;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include "pv227_application.hpp"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * Measures the GPU time of individual render passes without stalling the pipeline.
+ *
+ * Every scope writes a GL_TIMESTAMP query at its beginning and at its end. The queries of a frame live in a ring of
+ * {@link frames_in_flight} slots and are read back only when the slot is reused, i.e., several frames later, when the
+ * results are already available. A rolling history of the results is kept for every scope.
+ *
+ * Usage:
+ *     profiler.begin_frame();
+ *     profiler.begin_scope("pass");
+ *     ...
+ *     profiler.end_scope();
+ *     profiler.end_frame();
+ */
+class GpuProfiler {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  public:
+    /** The rolling statistics of a single scope (in ms). */
+    struct Statistics {
+        float last = 0.0f;
+        float min = 0.0f;
+        float avg = 0.0f;
+        float p99 = 0.0f;
+        int samples = 0;
+    };
+
+  private:
+    /** The queries of a single frame. */
+    struct FrameQueries {
+        std::vector<GLuint> queries; // Two queries (begin and end) per scope.
+        std::vector<bool> issued;    // The scopes measured in the frame.
+        bool pending = false;        // The flag determining if there are results to read back.
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The name of the scope measuring the whole frame. */
+    static constexpr const char* frame_scope = "frame";
+    /** The number of frames after which the results are read back. */
+    static constexpr int frames_in_flight = 4;
+
+  private:
+    /** The names of the scopes, the index is the id of the scope. */
+    std::vector<std::string> scope_names;
+    /** The ring with the queries. */
+    FrameQueries frames[frames_in_flight];
+    /** The index of the current frame. */
+    uint64_t frame_index = 0;
+    /** The stack of the open scopes. */
+    std::vector<int> open_scopes;
+
+    /** The maximum number of values kept in the history. */
+    size_t history_size;
+    /** The ring buffers with the history of every scope (in ms). */
+    std::vector<std::vector<float>> history;
+    /** The position of the next value in the ring buffers. */
+    std::vector<size_t> history_next;
+    /** The last value of every scope (in ms). */
+    std::vector<float> last_values;
+
+    /** The flag determining if all the results should be recorded for {@link write_csv}. */
+    bool recording = false;
+    /** The recorded results, one row per frame and one column per scope, NaN if the scope was not measured. */
+    std::vector<std::vector<float>> recorded_frames;
+
+    /** The number of frames whose results were not available in time and were dropped. */
+    int dropped_frames = 0;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Creates the profiler.
+     *
+     * @param 	history_size	The number of frames the rolling statistics are computed from.
+     */
+    explicit GpuProfiler(size_t history_size = 240);
+
+    /** Deletes the queries. */
+    ~GpuProfiler();
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** Collects the results of the frame that used the slot before and opens the frame scope. */
+    void begin_frame();
+
+    /** Closes the frame scope. */
+    void end_frame();
+
+    /** Opens a scope, scopes may be nested. */
+    void begin_scope(const std::string& name);
+
+    /** Closes the innermost open scope. */
+    void end_scope();
+
+    /** Waits for the GPU and collects the results of all the frames in flight (e.g., before the recording is read). */
+    void flush();
+
+    /** @return The names of all the scopes measured so far. */
+    const std::vector<std::string>& get_scope_names() const { return scope_names; }
+
+    /** @return The rolling statistics of the scope. */
+    Statistics get_statistics(const std::string& name) const;
+
+    /** @return The number of frames whose results were dropped. */
+    int get_dropped_frames() const { return dropped_frames; }
+
+    /** Enables or disables the recording of all the results for {@link write_csv}. */
+    void set_recording(bool enabled) { recording = enabled; }
+
+    /** @return Whether the results are recorded. */
+    bool is_recording() const { return recording; }
+
+    /** @return The number of recorded frames. */
+    size_t get_recorded_frame_count() const { return recorded_frames.size(); }
+
+    /** @return The recorded results of the scope (in ms), the frames that did not measure the scope are skipped. */
+    std::vector<float> get_recorded_values(const std::string& name) const;
+
+    /** Discards the recorded results. */
+    void clear_recording() { recorded_frames.clear(); }
+
+    /**
+     * Writes the recorded results into a CSV file, one row per frame and one column per scope (in ms).
+     *
+     * @return	True if the file was written.
+     */
+    bool write_csv(const std::filesystem::path& path) const;
+
+  private:
+    /** @return The id of the scope with the given name, registers the scope if needed. */
+    int get_scope_id(const std::string& name);
+
+    /** Reads back the results stored in the slot, returns false if they are not available yet. */
+    bool collect(FrameQueries& frame);
+};
@@ -0,0 +1,252 @@
+#include "gpu_program.hpp"
+#include "program_binary_cache.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifndef GL_COMPLETION_STATUS_ARB
+#define GL_COMPLETION_STATUS_ARB 0x91B1
+#endif
+
+namespace {
+/** @return The shader stage of the file given by its extension, 0 if unknown. */
+GLenum get_stage(const std::filesystem::path& file) {
+    const std::string extension = file.extension().string();
+    if (extension == ".vert") return GL_VERTEX_SHADER;
+    if (extension == ".geom") return GL_GEOMETRY_SHADER;
+    if (extension == ".frag") return GL_FRAGMENT_SHADER;
+    if (extension == ".comp") return GL_COMPUTE_SHADER;
+    return 0;
+}
+
+/**
+ * Replaces the lines #include "file" with the content of the file, the path is relative to the including shader.
+ *
+ * The included source gets its own source string number in #line, so the errors point to the right file and line.
+ */
+std::string expand_includes(const std::string& source, const std::filesystem::path& directory, int& next_string) {
+    const int string_number = next_string - 1;
+    std::istringstream lines(source);
+    std::string result;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(lines, line)) {
+        line_number++;
+        const size_t open = line.rfind("#include \"", 0);
+        const size_t close = open == 0 ? line.find('"', 10) : std::string::npos;
+        if (close == std::string::npos) {
+            result += line + "\n";
+            continue;
+        }
+        const std::filesystem::path file = directory / line.substr(10, close - 10);
+        std::ifstream stream(file);
+        if (!stream) {
+            std::cerr << "Could not open the shader include " << file << "." << std::endl;
+            result += line + "\n"; // Fails the compilation with the directive.
+            continue;
+        }
+        std::stringstream buffer;
+        buffer << stream.rdbuf();
+        result += "#line 1 " + std::to_string(next_string++) + "\n";
+        result += expand_includes(buffer.str(), file.parent_path(), next_string);
+        result += "#line " + std::to_string(line_number + 1) + " " + std::to_string(string_number) + "\n";
+    }
+    return result;
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+GpuProgram::GpuProgram(const std::vector<std::filesystem::path>& files, const ShaderDefines& defines) {
+    program = glCreateProgram();
+    std::vector<std::pair<GLenum, std::string>> sources;
+    for (const std::filesystem::path& file : files) {
+        label += (label.empty() ? "" : " + ") + file.filename().string();
+        sources.emplace_back(get_stage(file), load_source(file, defines));
+    }
+
+    // A binary from an earlier run skips the compilation entirely, it is linked already when accepted by the driver.
+    binary_key = ProgramBinaryCache::get_key(sources);
+    if (ProgramBinaryCache::load(program, binary_key)) {
+        finished = true;
+        linked = true;
+        return;
+    }
+
+    if (!binary_key.empty()) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    for (const auto& [stage, source] : sources) {
+        const char* source_pointer = source.c_str();
+        const GLuint shader = glCreateShader(stage);
+        glShaderSource(shader, 1, &source_pointer, nullptr);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        shaders.push_back(shader);
+    }
+    glLinkProgram(program);
+}
+
+GpuProgram::~GpuProgram() { release(); }
+
+GpuProgram::GpuProgram(GpuProgram&& other) noexcept { *this = std::move(other); }
+
+GpuProgram& GpuProgram::operator=(GpuProgram&& other) noexcept {
+    if (this != &other) {
+        release();
+        program = std::exchange(other.program, 0);
+        shaders = std::move(other.shaders);
+        other.shaders.clear();
+        label = std::move(other.label);
+        binary_key = std::move(other.binary_key);
+        finished = other.finished;
+        linked = other.linked;
+        locations = std::move(other.locations);
+    }
+    return *this;
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+bool GpuProgram::supports_parallel_compile() {
+    static const bool supported = []() {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char* name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (std::strcmp(name, "GL_ARB_parallel_shader_compile") == 0 || std::strcmp(name, "GL_KHR_parallel_shader_compile") == 0) {
+                return true;
+            }
+        }
+        return false;
+    }();
+    return supported;
+}
+
+std::string GpuProgram::load_source(const std::filesystem::path& file, const ShaderDefines& defines) {
+    std::ifstream stream(file);
+    if (!stream) {
+        std::cerr << "Could not open the shader " << file << "." << std::endl;
+        return {};
+    }
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    int next_string = 1;
+    std::string source = expand_includes(buffer.str(), file.parent_path(), next_string);
+    if (defines.empty()) {
+        return source;
+    }
+
+    // The definitions must follow the #version directive, #line keeps the line numbers in the errors.
+    std::string injected;
+    for (const auto& [name, value] : defines) {
+        injected += "#define " + name + " " + value + "\n";
+    }
+    const size_t version = source.find("#version");
+    const size_t line_end = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (line_end == std::string::npos) {
+        return injected + source;
+    }
+    return source.substr(0, line_end + 1) + injected + "#line 2\n" + source.substr(line_end + 1);
+}
+
+bool GpuProgram::is_ready() {
+    if (program == 0) return false;
+    if (!finished) {
+        if (supports_parallel_compile()) {
+            GLint completed = GL_FALSE;
+            glGetProgramiv(program, GL_COMPLETION_STATUS_ARB, &completed);
+            if (completed == GL_FALSE) return false;
+        }
+        finish();
+    }
+    return true;
+}
+
+bool GpuProgram::is_valid() {
+    if (program == 0) return false;
+    if (!finished) {
+        finish();
+    }
+    return linked;
+}
+
+void GpuProgram::finish() {
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    linked = status == GL_TRUE;
+    finished = true;
+
+    if (!linked) {
+        for (const GLuint shader : shaders) {
+            GLint length = 0;
+            glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+            if (length > 1) {
+                std::string log(length, '\0');
+                glGetShaderInfoLog(shader, length, nullptr, log.data());
+                std::cerr << label << ": " << log << std::endl;
+            }
+        }
+        GLint length = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        if (length > 1) {
+            std::string log(length, '\0');
+            glGetProgramInfoLog(program, length, nullptr, log.data());
+            std::cerr << label << ": " << log << std::endl;
+        }
+    } else {
+        ProgramBinaryCache::store(program, binary_key);
+    }
+
+    // The linked program keeps the binaries, the shaders are not needed anymore.
+    for (const GLuint shader : shaders) {
+        glDetachShader(program, shader);
+        glDeleteShader(shader);
+    }
+    shaders.clear();
+}
+
+GLint GpuProgram::get_location(const std::string& name) {
+    const auto it = locations.find(name);
+    if (it != locations.end()) {
+        return it->second;
+    }
+    const GLint location = glGetUniformLocation(program, name.c_str());
+    locations.emplace(name, location);
+    return location;
+}
+
+void GpuProgram::uniform(const std::string& name, int value) { glProgramUniform1i(program, get_location(name), value); }
+
+void GpuProgram::uniform(const std::string& name, bool value) { glProgramUniform1i(program, get_location(name), value ? 1 : 0); }
+
+void GpuProgram::uniform(const std::string& name, float value) { glProgramUniform1f(program, get_location(name), value); }
+
+void GpuProgram::uniform(const std::string& name, const glm::vec2& value) { glProgramUniform2f(program, get_location(name), value.x, value.y); }
+
+void GpuProgram::uniform(const std::string& name, const glm::vec3& value) {
+    glProgramUniform3f(program, get_location(name), value.x, value.y, value.z);
+}
+
+void GpuProgram::uniform(const std::string& name, const glm::vec4& value) {
+    glProgramUniform4f(program, get_location(name), value.x, value.y, value.z, value.w);
+}
+
+void GpuProgram::uniform(const std::string& name, const glm::mat4& value) {
+    glProgramUniformMatrix4fv(program, get_location(name), 1, GL_FALSE, &value[0][0]);
+}
+
+void GpuProgram::release() {
+    for (const GLuint shader : shaders) {
+        glDeleteShader(shader);
+    }
+    shaders.clear();
+    if (program != 0) {
+        glDeleteProgram(program);
+        program = 0;
+    }
+    locations.clear();
+}
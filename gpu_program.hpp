@@ -0,0 +1,104 @@
+#pragma once
+#include "pv227_application.hpp"
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** The preprocessor definitions injected into the shader sources, e.g., {"ITERATIONS", "3"}. */
+using ShaderDefines = std::vector<std::pair<std::string, std::string>>;
+
+/**
+ * A program built directly with OpenGL from shader files, with #include expansion, #define injection and a non-blocking link.
+ *
+ * The shaders are compiled and linked when the program is created, but nothing is queried until {@link is_ready}. With
+ * GL_ARB_parallel_shader_compile (or the KHR version), the driver compiles on its own threads and is_ready only polls
+ * GL_COMPLETION_STATUS_ARB, so the render loop never waits. Without the extension, the first query waits for the link.
+ * When the {@link ProgramBinaryCache} is enabled, a binary stored by an earlier run replaces the compilation, and every
+ * program compiled from the sources is stored once it links.
+ * The uniform interface mirrors ShaderProgram, so the render code can use either.
+ */
+class GpuProgram {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  private:
+    /** The program. */
+    GLuint program = 0;
+    /** The shaders attached to the program until the link finishes. */
+    std::vector<GLuint> shaders;
+    /** The name of the program used in the error messages. */
+    std::string label;
+    /** The key of the program in the {@link ProgramBinaryCache}, empty if the cache is disabled. */
+    std::string binary_key;
+    /** The flag determining if the link has finished and its status has been checked. */
+    bool finished = false;
+    /** The flag determining if the link has succeeded. */
+    bool linked = false;
+    /** The cached locations of the uniforms. */
+    std::unordered_map<std::string, GLint> locations;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    GpuProgram() = default;
+
+    /**
+     * Starts building the program.
+     *
+     * @param 	files  	The shader files, the stage is given by the extension (.vert, .geom, .frag, .comp).
+     * @param 	defines	The definitions inserted after the #version line of every shader.
+     */
+    explicit GpuProgram(const std::vector<std::filesystem::path>& files, const ShaderDefines& defines = {});
+
+    /** Releases the program and the shaders. */
+    ~GpuProgram();
+
+    GpuProgram(const GpuProgram&) = delete;
+    GpuProgram& operator=(const GpuProgram&) = delete;
+    GpuProgram(GpuProgram&& other) noexcept;
+    GpuProgram& operator=(GpuProgram&& other) noexcept;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** @return Whether the driver compiles the shaders in the background (GL_ARB/KHR_parallel_shader_compile). */
+    static bool supports_parallel_compile();
+
+    /** @return The content of the shader file with its #include "file" lines expanded and the definitions inserted after the #version line. */
+    static std::string load_source(const std::filesystem::path& file, const ShaderDefines& defines);
+
+    /** @return Whether the link has finished, never waits for the driver when the parallel compilation is supported. */
+    bool is_ready();
+
+    /** @return Whether the program has been linked successfully, waits for the link to finish. */
+    bool is_valid();
+
+    /** Binds the program. */
+    void use() const { glUseProgram(program); }
+
+    /** @return The OpenGL name of the program. */
+    GLuint get_id() const { return program; }
+
+    /** Sets the uniform, the uniforms missing in the program (e.g., replaced by a define) are ignored. */
+    void uniform(const std::string& name, int value);
+    void uniform(const std::string& name, bool value);
+    void uniform(const std::string& name, float value);
+    void uniform(const std::string& name, const glm::vec2& value);
+    void uniform(const std::string& name, const glm::vec3& value);
+    void uniform(const std::string& name, const glm::vec4& value);
+    void uniform(const std::string& name, const glm::mat4& value);
+
+  private:
+    /** Checks the link status and reports the errors, called once the link has finished. */
+    void finish();
+
+    /** @return The location of the uniform, -1 if the program does not use it. */
+    GLint get_location(const std::string& name);
+
+    /** Deletes the OpenGL objects. */
+    void release();
+};
@@ -0,0 +1,74 @@
+#include "image_writer.hpp"
+#include "png_encoder.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+ImageWriter::ImageWriter(int thread_count, size_t max_queued) : max_queued(std::max<size_t>(1, max_queued)) {
+    if (thread_count <= 0) {
+        thread_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < thread_count; i++) {
+        threads.emplace_back(&ImageWriter::worker_loop, this);
+    }
+}
+
+ImageWriter::~ImageWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    job_available.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void ImageWriter::submit(std::filesystem::path path, int width, int height, std::vector<uint8_t> rgba) {
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [this] { return jobs.size() < max_queued; });
+    jobs.push_back(Job{std::move(path), width, height, std::move(rgba)});
+    lock.unlock();
+    job_available.notify_one();
+}
+
+void ImageWriter::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    job_done.wait(lock, [this] { return jobs.empty() && active == 0; });
+}
+
+int ImageWriter::get_failed_count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return failed;
+}
+
+void ImageWriter::worker_loop() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            job_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty()) {
+                return; // Stopping and nothing left to write.
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            active++;
+        }
+        job_done.notify_all();
+
+        const std::vector<uint8_t> png = encode_png(job.rgba.data(), job.width, job.height);
+        std::ofstream file(job.path, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!file) {
+                std::cerr << "Could not write " << job.path << "." << std::endl;
+                failed++;
+            }
+            active--;
+        }
+        job_done.notify_all();
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Encodes images to PNG and writes them to disk on background threads.
+ *
+ * The queue is bounded: {@link submit} blocks once too many images are waiting, so a slow disk slows down the producer
+ * instead of exhausting the memory.
+ */
+class ImageWriter {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  private:
+    /** A single image waiting to be written. */
+    struct Job {
+        std::filesystem::path path;
+        int width;
+        int height;
+        std::vector<uint8_t> rgba;
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  private:
+    /** The encoding threads. */
+    std::vector<std::thread> threads;
+    /** The images waiting to be encoded. */
+    std::deque<Job> jobs;
+    /** The maximum number of images in the queue. */
+    size_t max_queued;
+    /** The number of images that are being encoded right now. */
+    int active = 0;
+    /** The number of images that could not be written. */
+    int failed = 0;
+    /** The flag telling the threads to exit once the queue is empty. */
+    bool stopping = false;
+
+    std::mutex mutex;
+    /** Signals the threads that there is a new job (or that they should stop). */
+    std::condition_variable job_available;
+    /** Signals the producer that a job has been taken or finished. */
+    std::condition_variable job_done;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Creates the writer.
+     *
+     * @param 	thread_count	The number of encoding threads, zero selects the number of cores.
+     * @param 	max_queued  	The maximum number of images waiting in the queue.
+     */
+    explicit ImageWriter(int thread_count = 0, size_t max_queued = 16);
+
+    /** Writes all the remaining images and joins the threads. */
+    ~ImageWriter();
+
+    ImageWriter(const ImageWriter&) = delete;
+    ImageWriter& operator=(const ImageWriter&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Queues an image for writing.
+     *
+     * @param 	path 	The path of the PNG file.
+     * @param 	width	The width of the image.
+     * @param 	height	The height of the image.
+     * @param 	rgba 	The pixels as returned by glReadPixels (RGBA8, bottom-up).
+     */
+    void submit(std::filesystem::path path, int width, int height, std::vector<uint8_t> rgba);
+
+    /** Blocks until all the queued images are written. */
+    void wait_idle();
+
+    /** @return The number of images that could not be written. */
+    int get_failed_count();
+
+  private:
+    /** The main loop of the encoding threads. */
+    void worker_loop();
+};
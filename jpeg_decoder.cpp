@@ -0,0 +1,324 @@
+#include "jpeg_decoder.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+/** The position of the coefficients in the zig-zag order. */
+constexpr uint8_t zigzag[64] = {0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+                                41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+                                30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+/** A Huffman table in the canonical form of the JPEG specification (F.2.2.3). */
+struct HuffmanTable {
+    std::array<int, 17> min_code = {};
+    std::array<int, 17> max_code = {};
+    std::array<int, 17> first_value = {};
+    std::vector<uint8_t> values;
+    bool defined = false;
+
+    void build(const uint8_t* counts, const uint8_t* symbols) {
+        int code = 0, index = 0;
+        for (int length = 1; length <= 16; length++) {
+            first_value[length] = index;
+            min_code[length] = code;
+            code += counts[length - 1];
+            index += counts[length - 1];
+            max_code[length] = counts[length - 1] ? code - 1 : -1;
+            code <<= 1;
+        }
+        values.assign(symbols, symbols + index);
+        defined = true;
+    }
+};
+
+/** A component of the frame with its decoded samples. */
+struct Component {
+    int id = 0;
+    int h = 1, v = 1;              // The sampling factors.
+    int quantization = 0;          // The index of the quantization table.
+    int dc_table = 0, ac_table = 0; // The indices of the Huffman tables of the current scan.
+    int dc_prediction = 0;
+    int stride = 0;                // The width of the sample plane (a multiple of 8).
+    std::vector<uint8_t> samples;
+};
+
+/** Reads the entropy coded data bit by bit, removes the stuffed zero bytes and stops at markers. */
+class BitReader {
+  private:
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+    uint32_t buffer = 0;
+    int available = 0;
+
+  public:
+    BitReader(const uint8_t* data, size_t size, size_t position) : data(data), size(size), position(position) {}
+
+    int bit() {
+        if (available == 0) {
+            uint8_t byte = 0;
+            if (position < size) {
+                byte = data[position];
+                if (byte == 0xFF) {
+                    const uint8_t next = position + 1 < size ? data[position + 1] : 0;
+                    if (next == 0x00) {
+                        position += 2;
+                    } else {
+                        byte = 0; // A marker, the remaining bits are zeros.
+                    }
+                } else {
+                    position++;
+                }
+            }
+            buffer = byte;
+            available = 8;
+        }
+        available--;
+        return (buffer >> available) & 1;
+    }
+
+    int bits(int count) {
+        int value = 0;
+        for (int i = 0; i < count; i++) value = (value << 1) | bit();
+        return value;
+    }
+
+    /** Skips the rest of the byte and the restart marker that follows. */
+    void restart() {
+        available = 0;
+        while (position + 1 < size && !(data[position] == 0xFF && data[position + 1] >= 0xD0 && data[position + 1] <= 0xD7)) {
+            position++;
+        }
+        position = std::min(position + 2, size);
+    }
+
+    size_t get_position() const { return position; }
+};
+
+int decode_symbol(BitReader& reader, const HuffmanTable& table) {
+    int code = 0;
+    for (int length = 1; length <= 16; length++) {
+        code = (code << 1) | reader.bit();
+        if (code <= table.max_code[length]) {
+            return table.values[table.first_value[length] + code - table.min_code[length]];
+        }
+    }
+    return -1;
+}
+
+/** Converts the magnitude category and the additional bits to the signed value (F.2.2.1). */
+int extend(int value, int category) { return value < (1 << (category - 1)) ? value - (1 << category) + 1 : value; }
+
+/** The inverse DCT with the precomputed cosines, separable in rows and columns. */
+void inverse_dct(const int coefficients[64], uint8_t* output, int stride) {
+    static const std::array<float, 64> cosines = []() {
+        std::array<float, 64> table{};
+        for (int x = 0; x < 8; x++) {
+            for (int u = 0; u < 8; u++) {
+                const float scale = u == 0 ? std::sqrt(0.125f) : 0.5f;
+                table[x * 8 + u] = scale * std::cos((2.0f * x + 1.0f) * u * 3.14159265359f / 16.0f);
+            }
+        }
+        return table;
+    }();
+
+    float rows[64];
+    for (int v = 0; v < 8; v++) {
+        for (int x = 0; x < 8; x++) {
+            float sum = 0.0f;
+            for (int u = 0; u < 8; u++) sum += cosines[x * 8 + u] * static_cast<float>(coefficients[v * 8 + u]);
+            rows[v * 8 + x] = sum;
+        }
+    }
+    for (int x = 0; x < 8; x++) {
+        for (int y = 0; y < 8; y++) {
+            float sum = 0.0f;
+            for (int v = 0; v < 8; v++) sum += cosines[y * 8 + v] * rows[v * 8 + x];
+            output[y * stride + x] = static_cast<uint8_t>(std::clamp(std::lround(sum + 128.0f), 0l, 255l));
+        }
+    }
+}
+
+bool decode_block(BitReader& reader, Component& component, const HuffmanTable& dc, const HuffmanTable& ac, const uint16_t* quantization,
+                  uint8_t* output) {
+    int coefficients[64] = {};
+    const int category = decode_symbol(reader, dc);
+    if (category < 0 || category > 11) return false;
+    component.dc_prediction += category ? extend(reader.bits(category), category) : 0;
+    coefficients[0] = component.dc_prediction * quantization[0];
+
+    for (int k = 1; k < 64;) {
+        const int symbol = decode_symbol(reader, ac);
+        if (symbol < 0) return false;
+        const int run = symbol >> 4, size = symbol & 15;
+        if (size == 0) {
+            if (run != 15) break; // End of block.
+            k += 16;
+            continue;
+        }
+        k += run;
+        if (k > 63) return false;
+        coefficients[zigzag[k]] = extend(reader.bits(size), size) * quantization[k];
+        k++;
+    }
+    inverse_dct(coefficients, output, component.stride);
+    return true;
+}
+} // namespace
+
+std::vector<uint8_t> decode_jpeg(const uint8_t* data, size_t size, int& width, int& height, bool bottom_up) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) return {};
+
+    uint16_t quantization[4][64] = {};
+    HuffmanTable dc_tables[4], ac_tables[4];
+    std::vector<Component> components;
+    int restart_interval = 0;
+    int max_h = 1, max_v = 1, mcu_columns = 0, mcu_rows = 0;
+    width = height = 0;
+
+    size_t position = 2;
+    while (position + 4 <= size) {
+        if (data[position] != 0xFF) return {};
+        const uint8_t marker = data[position + 1];
+        if (marker == 0xFF) {
+            position++;
+            continue;
+        }
+        if (marker == 0xD9) break;
+        const size_t length = (data[position + 2] << 8) | data[position + 3];
+        const uint8_t* segment = data + position + 4;
+        if (length < 2 || position + 2 + length > size) return {};
+        const size_t segment_size = length - 2;
+
+        if (marker == 0xDB) {
+            // Quantization tables, stored in the zig-zag order like the coefficients.
+            for (size_t i = 0; i < segment_size;) {
+                const int precision = segment[i] >> 4, index = segment[i] & 3;
+                if (i + 1 + (precision ? 128 : 64) > segment_size) return {};
+                i++;
+                for (int k = 0; k < 64; k++) {
+                    quantization[index][k] = precision ? static_cast<uint16_t>((segment[i + 2 * k] << 8) | segment[i + 2 * k + 1]) : segment[i + k];
+                }
+                i += precision ? 128 : 64;
+            }
+        } else if (marker == 0xC4) {
+            for (size_t i = 0; i + 17 <= segment_size;) {
+                const int type = segment[i] >> 4, index = segment[i] & 3;
+                const uint8_t* counts = segment + i + 1;
+                int total = 0;
+                for (int k = 0; k < 16; k++) total += counts[k];
+                if (i + 17 + total > segment_size) return {};
+                (type ? ac_tables : dc_tables)[index].build(counts, segment + i + 17);
+                i += 17 + total;
+            }
+        } else if (marker == 0xDD) {
+            if (segment_size < 2) return {};
+            restart_interval = (segment[0] << 8) | segment[1];
+        } else if (marker == 0xC0 || marker == 0xC1) {
+            if (segment_size < 6 || segment[0] != 8) return {};
+            height = (segment[1] << 8) | segment[2];
+            width = (segment[3] << 8) | segment[4];
+            const int count = segment[5];
+            if (width <= 0 || height <= 0 || (count != 1 && count != 3) || segment_size < 6 + 3 * static_cast<size_t>(count)) return {};
+            components.resize(count);
+            for (int c = 0; c < count; c++) {
+                components[c].id = segment[6 + 3 * c];
+                components[c].h = std::max(1, segment[7 + 3 * c] >> 4);
+                components[c].v = std::max(1, segment[7 + 3 * c] & 15);
+                components[c].quantization = segment[8 + 3 * c] & 3;
+                max_h = std::max(max_h, components[c].h);
+                max_v = std::max(max_v, components[c].v);
+            }
+            mcu_columns = (width + 8 * max_h - 1) / (8 * max_h);
+            mcu_rows = (height + 8 * max_v - 1) / (8 * max_v);
+            for (Component& component : components) {
+                component.stride = mcu_columns * component.h * 8;
+                component.samples.assign(static_cast<size_t>(component.stride) * mcu_rows * component.v * 8, 0);
+            }
+        } else if (marker >= 0xC2 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            return {}; // Progressive, lossless, or arithmetic coding.
+        } else if (marker == 0xDA) {
+            if (components.empty() || segment_size < 1) return {};
+            const int scan_count = segment[0];
+            // The components, then the spectral selection and the successive approximation.
+            if (scan_count < 1 || scan_count > static_cast<int>(components.size()) || segment_size < 1 + 2 * static_cast<size_t>(scan_count) + 3) return {};
+            std::vector<Component*> scan;
+            for (int s = 0; s < scan_count; s++) {
+                const int id = segment[1 + 2 * s];
+                const auto it = std::find_if(components.begin(), components.end(), [&](const Component& c) { return c.id == id; });
+                if (it == components.end()) return {};
+                // Only four tables of each kind exist.
+                if ((segment[2 + 2 * s] >> 4) > 3 || (segment[2 + 2 * s] & 15) > 3) return {};
+                it->dc_table = segment[2 + 2 * s] >> 4;
+                it->ac_table = segment[2 + 2 * s] & 15;
+                if (!dc_tables[it->dc_table].defined || !ac_tables[it->ac_table].defined) return {};
+                it->dc_prediction = 0;
+                scan.push_back(&*it);
+            }
+
+            BitReader reader(data, size, position + 2 + length);
+            const auto decode = [&](Component& c, int block_x, int block_y) {
+                return decode_block(reader, c, dc_tables[c.dc_table], ac_tables[c.ac_table], quantization[c.quantization],
+                                    c.samples.data() + static_cast<size_t>(block_y) * 8 * c.stride + block_x * 8);
+            };
+
+            // A single component scan is not interleaved and covers only the blocks of the component inside the image.
+            const bool interleaved = scan.size() > 1;
+            const int units_x = interleaved ? mcu_columns : (width * scan[0]->h / max_h + 7) / 8;
+            const int units_y = interleaved ? mcu_rows : (height * scan[0]->v / max_v + 7) / 8;
+            int decoded_units = 0;
+            for (int unit_y = 0; unit_y < units_y; unit_y++) {
+                for (int unit_x = 0; unit_x < units_x; unit_x++) {
+                    if (restart_interval && decoded_units > 0 && decoded_units % restart_interval == 0) {
+                        reader.restart();
+                        for (Component* c : scan) c->dc_prediction = 0;
+                    }
+                    if (interleaved) {
+                        for (Component* c : scan) {
+                            for (int y = 0; y < c->v; y++) {
+                                for (int x = 0; x < c->h; x++) {
+                                    if (!decode(*c, unit_x * c->h + x, unit_y * c->v + y)) return {};
+                                }
+                            }
+                        }
+                    } else if (!decode(*scan[0], unit_x, unit_y)) {
+                        return {};
+                    }
+                    decoded_units++;
+                }
+            }
+
+            // Continues after the entropy coded data.
+            position = reader.get_position();
+            while (position + 1 < size && !(data[position] == 0xFF && data[position + 1] != 0x00 && (data[position + 1] < 0xD0 || data[position + 1] > 0xD7))) {
+                position++;
+            }
+            continue;
+        }
+        position += 2 + length;
+    }
+    if (components.empty()) return {};
+
+    // Upsamples the chroma (nearest sample) and converts YCbCr to RGB.
+    std::vector<uint8_t> rgba(static_cast<size_t>(width) * height * 4);
+    const auto sample = [&](const Component& c, int x, int y) { return c.samples[static_cast<size_t>(y * c.v / max_v) * c.stride + x * c.h / max_h]; };
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = rgba.data() + static_cast<size_t>(bottom_up ? height - 1 - y : y) * width * 4;
+        for (int x = 0; x < width; x++) {
+            const float luma = sample(components[0], x, y);
+            float r = luma, g = luma, b = luma;
+            if (components.size() == 3) {
+                const float cb = sample(components[1], x, y) - 128.0f, cr = sample(components[2], x, y) - 128.0f;
+                r = luma + 1.402f * cr;
+                g = luma - 0.344136f * cb - 0.714136f * cr;
+                b = luma + 1.772f * cb;
+            }
+            row[4 * x + 0] = static_cast<uint8_t>(std::clamp(std::lround(r), 0l, 255l));
+            row[4 * x + 1] = static_cast<uint8_t>(std::clamp(std::lround(g), 0l, 255l));
+            row[4 * x + 2] = static_cast<uint8_t>(std::clamp(std::lround(b), 0l, 255l));
+            row[4 * x + 3] = 255;
+        }
+    }
+    return rgba;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Decodes a baseline JPEG file in memory, so the textures can be decoded on worker threads without touching OpenGL.
+ *
+ * The decoder is self-contained and supports what the textures of this project use: 8-bit baseline Huffman coding with
+ * one (grayscale) or three (YCbCr) components, any chroma subsampling, and restart intervals. Progressive and
+ * arithmetic coded files are rejected, the callers then fall back to the framework loader.
+ *
+ * @param 	data	 	The content of the file.
+ * @param 	size	 	The size of the file (in bytes).
+ * @param 	width	 	The width of the image (output).
+ * @param 	height   	The height of the image (output).
+ * @param 	bottom_up	The flag determining if the first row of the output is the bottom one (the order used by OpenGL).
+ * @return	The pixels in RGBA8 format, tightly packed, or an empty vector if the file is not supported.
+ */
+std::vector<uint8_t> decode_jpeg(const uint8_t* data, size_t size, int& width, int& height, bool bottom_up = true);
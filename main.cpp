@@ -2,22 +2,58 @@
 
 #include <string>
 #include <vector>
+#include <GLFW/glfw3.h>
 #include "application.hpp"
+#include "benchmark_suite.hpp"
+#include "command_line.hpp"
 #include "gui_manager.h"
+#include "offline_renderer.hpp"
+#include "particle_benchmark.hpp"
+#include "render_server.hpp"
+#include "sampler_benchmark.hpp"
 
 int main(int argc, char** argv) {
-    constexpr int initial_width = 1280;
-    constexpr int initial_height = 720;
-
     std::vector<std::string> arguments(argv, argv + argc);
 
+    // The benchmarks run on the CPU only and do not need any window.
+    if (CommandLine::has_flag(arguments, "--sampler-benchmark")) {
+        return run_sampler_benchmark(arguments);
+    }
+    if (CommandLine::has_flag(arguments, "--cpu-particle-benchmark")) {
+        return run_cpu_particle_benchmark(arguments);
+    }
+
+    // In the headless mode, the window is only used to obtain an OpenGL context and the frames go to image files.
+    const OfflineRenderSettings offline_settings = OfflineRenderSettings::from_arguments(arguments);
+    const RenderServerSettings server_settings = RenderServerSettings::from_arguments(arguments);
+    const int initial_width = offline_settings.width;
+    const int initial_height = offline_settings.height;
+
+    int exit_code = 0;
     ImGuiManager manager;
     manager.init(initial_width, initial_height, "PV227 Project #01", 4, 5);
     if(!manager.is_fail()) 
     {
         // Note that the application has to be created after the manager is initialized.
         Application application(initial_width, initial_height, arguments);
-        manager.run(application);
+        const BenchmarkSettings benchmark_settings = BenchmarkSettings::from_arguments(arguments);
+        if (benchmark_settings.enabled) {
+            glfwHideWindow(glfwGetCurrentContext());
+            exit_code = BenchmarkSuite(application, benchmark_settings).run();
+        } else if (CommandLine::has_flag(arguments, "--particle-benchmark")) {
+            // The GPU benchmarks only need the context and the shaders of the application.
+            glfwHideWindow(glfwGetCurrentContext());
+            exit_code = run_particle_benchmark(application.get_shaders_path(), arguments);
+        } else if (server_settings.enabled) {
+            // The server renders offscreen at the size of each request, the window only provides the context.
+            glfwHideWindow(glfwGetCurrentContext());
+            exit_code = RenderServer(application, server_settings).run();
+        } else if (offline_settings.enabled) {
+            glfwHideWindow(glfwGetCurrentContext());
+            exit_code = OfflineRenderer(application, offline_settings).run();
+        } else {
+            manager.run(application);
+        }
 
         // Free the entire application before terminating glfw. If this was done in a wrong order
         // application may crash on calling OpenGL (Delete*) calls after destruction of a context.
@@ -25,5 +61,5 @@ int main(int argc, char** argv) {
     }
 
     manager.terminate();
-    return 0;
+    return exit_code;
 }
@@ -0,0 +1,185 @@
+#include "offline_renderer.hpp"
+#include "application.hpp"
+#include "command_line.hpp"
+#include "image_writer.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// ----------------------------------------------------------------------------
+// Settings
+// ----------------------------------------------------------------------------
+OfflineRenderSettings OfflineRenderSettings::from_arguments(const std::vector<std::string>& arguments) {
+    OfflineRenderSettings settings;
+    settings.enabled = CommandLine::has_flag(arguments, "--headless");
+    settings.width = CommandLine::get_int(arguments, "--width", settings.width);
+    settings.height = CommandLine::get_int(arguments, "--height", settings.height);
+    settings.frame_count = CommandLine::get_int(arguments, "--frames", settings.frame_count);
+    settings.time_step = CommandLine::get_float(arguments, "--time-step", settings.time_step);
+    settings.start_time = CommandLine::get_float(arguments, "--start-time", settings.start_time);
+    settings.output_directory = CommandLine::get_string(arguments, "--output", settings.output_directory.string());
+    settings.prefix = CommandLine::get_string(arguments, "--prefix", settings.prefix);
+    settings.orbit_start = CommandLine::get_float(arguments, "--orbit-start", settings.orbit_start);
+    settings.orbit_speed = CommandLine::get_float(arguments, "--orbit-speed", settings.orbit_speed);
+    settings.elevation = CommandLine::get_float(arguments, "--elevation", settings.elevation);
+    settings.distance = CommandLine::get_float(arguments, "--distance", settings.distance);
+    settings.readback_buffers = glm::max(1, CommandLine::get_int(arguments, "--readback-buffers", settings.readback_buffers));
+    settings.encoder_threads = CommandLine::get_int(arguments, "--encoder-threads", settings.encoder_threads);
+    return settings;
+}
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+OfflineRenderer::OfflineRenderer(Application& application, OfflineRenderSettings settings)
+    : application(application), settings(std::move(settings)) {
+    const int width = this->settings.width;
+    const int height = this->settings.height;
+
+    glCreateRenderbuffers(1, &color_renderbuffer);
+    glNamedRenderbufferStorage(color_renderbuffer, GL_RGBA8, width, height);
+    glCreateRenderbuffers(1, &depth_renderbuffer);
+    glNamedRenderbufferStorage(depth_renderbuffer, GL_DEPTH_COMPONENT24, width, height);
+
+    glCreateFramebuffers(1, &framebuffer);
+    glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer);
+    glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+    glNamedFramebufferDrawBuffer(framebuffer, GL_COLOR_ATTACHMENT0);
+    glNamedFramebufferReadBuffer(framebuffer, GL_COLOR_ATTACHMENT0);
+    if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "The offscreen framebuffer is incomplete." << std::endl;
+    }
+
+    // The buffers are only ever read by the CPU after the GPU has written them.
+    const GLsizeiptr frame_size = static_cast<GLsizeiptr>(width) * height * 4;
+    slots.resize(this->settings.readback_buffers);
+    for (ReadbackSlot& slot : slots) {
+        glCreateBuffers(1, &slot.buffer);
+        glNamedBufferStorage(slot.buffer, frame_size, nullptr, GL_MAP_READ_BIT);
+    }
+}
+
+OfflineRenderer::~OfflineRenderer() {
+    for (ReadbackSlot& slot : slots) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color_renderbuffer);
+    glDeleteRenderbuffers(1, &depth_renderbuffer);
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+int OfflineRenderer::run() {
+    std::filesystem::create_directories(settings.output_directory);
+    ImageWriter writer(settings.encoder_threads);
+
+    application.set_output_framebuffer(framebuffer);
+    application.finish_loading();
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < settings.frame_count; frame++) {
+        // The slot we are about to overwrite has to be handed over first; after a full ring its fence is usually signaled.
+        ReadbackSlot& slot = slots[frame % slots.size()];
+        retire(slot, writer, true);
+
+        application.set_scripted_time(settings.start_time + static_cast<double>(frame) * settings.time_step);
+        application.set_scripted_eye_position(camera_position(frame));
+        application.update(settings.time_step);
+        application.render();
+
+        // Starts an asynchronous copy into the pixel pack buffer and fences it.
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, settings.width, settings.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        slot.frame = frame;
+        glFlush(); // Makes sure the fence reaches the GPU, otherwise a later non-blocking wait would never see it signaled.
+
+        // Hands over the older frames that are already finished, without waiting for the rest.
+        for (ReadbackSlot& other : slots) {
+            if (&other != &slot) {
+                retire(other, writer, false);
+            }
+        }
+
+        if ((frame + 1) % 100 == 0 || frame + 1 == settings.frame_count) {
+            std::cout << "Rendered " << frame + 1 << " / " << settings.frame_count << " frames." << std::endl;
+        }
+    }
+
+    // Drains the ring and waits for the encoders.
+    for (ReadbackSlot& slot : slots) {
+        retire(slot, writer, true);
+    }
+    const auto rendered = std::chrono::steady_clock::now();
+    writer.wait_idle();
+    const auto written = std::chrono::steady_clock::now();
+
+    application.set_output_framebuffer(0);
+    application.set_scripted_time(std::nullopt);
+    application.set_scripted_eye_position(std::nullopt);
+
+    const double render_seconds = std::chrono::duration<double>(rendered - start).count();
+    const double total_seconds = std::chrono::duration<double>(written - start).count();
+    std::cout << "Rendered " << settings.frame_count << " frames in " << render_seconds << " s, written in " << total_seconds << " s ("
+              << settings.frame_count / total_seconds << " frames/s) to " << settings.output_directory << "." << std::endl;
+
+    const int failed = writer.get_failed_count();
+    if (failed > 0) {
+        std::cerr << failed << " frames could not be written." << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+glm::vec3 OfflineRenderer::camera_position(int frame) const {
+    const float azimuth = glm::radians(settings.orbit_start + settings.orbit_speed * static_cast<float>(frame));
+    const float elevation = glm::radians(settings.elevation);
+    return settings.distance *
+           glm::vec3(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth));
+}
+
+std::filesystem::path OfflineRenderer::frame_path(int frame) const {
+    char number[16];
+    std::snprintf(number, sizeof(number), "%05d", frame);
+    return settings.output_directory / (settings.prefix + "_" + number + ".png");
+}
+
+bool OfflineRenderer::retire(ReadbackSlot& slot, ImageWriter& writer, bool wait) {
+    if (!slot.fence) {
+        return true;
+    }
+
+    GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    while (wait && status == GL_TIMEOUT_EXPIRED) {
+        status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1 s
+    }
+    if (status == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    if (status == GL_WAIT_FAILED) {
+        std::cerr << "Waiting for the readback of frame " << slot.frame << " failed." << std::endl;
+    }
+
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+
+    const size_t size = static_cast<size_t>(settings.width) * settings.height * 4;
+    std::vector<uint8_t> pixels(size);
+    if (const void* data = glMapNamedBufferRange(slot.buffer, 0, static_cast<GLsizeiptr>(size), GL_MAP_READ_BIT)) {
+        std::memcpy(pixels.data(), data, size);
+        glUnmapNamedBuffer(slot.buffer);
+    }
+    writer.submit(frame_path(slot.frame), settings.width, settings.height, std::move(pixels));
+    slot.frame = -1;
+    return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include "pv227_application.hpp"
+#include <filesystem>
+#include <string>
+#include <vector>
+
+class Application;
+class ImageWriter;
+
+/** The settings of the headless offline rendering. */
+struct OfflineRenderSettings {
+    bool enabled = false;                            // The flag determining if the application should run headless.
+    int width = 1280;                                // The width of the frames.
+    int height = 720;                                // The height of the frames.
+    int frame_count = 100;                           // The number of frames to render.
+    float time_step = 1000.0f / 60.0f;               // The fixed time step between frames (in ms).
+    float start_time = 0.0f;                         // The scene time of the first frame (in ms).
+    std::filesystem::path output_directory = "frames"; // The directory for the image sequence.
+    std::string prefix = "frame";                    // The prefix of the image names.
+    float orbit_start = -45.0f;                      // The azimuth of the camera in the first frame (in degrees).
+    float orbit_speed = 0.5f;                        // The change of the azimuth per frame (in degrees).
+    float elevation = 20.0f;                         // The elevation of the camera (in degrees).
+    float distance = 25.0f;                          // The distance of the camera from the origin.
+    int readback_buffers = 3;                        // The number of pixel pack buffers in the readback ring.
+    int encoder_threads = 0;                         // The number of PNG encoding threads, zero selects the number of cores.
+
+    /**
+     * Reads the settings from the command line.
+     *
+     * --headless, --width W, --height H, --frames N, --time-step MS, --start-time MS, --output DIR, --prefix NAME,
+     * --orbit-start DEG, --orbit-speed DEG, --elevation DEG, --distance D, --readback-buffers N, --encoder-threads N
+     */
+    static OfflineRenderSettings from_arguments(const std::vector<std::string>& arguments);
+};
+
+/**
+ * Renders an image sequence without any UI.
+ *
+ * Every frame is rendered with a fixed time step and a camera orbiting the snowman into an offscreen framebuffer. The
+ * pixels are read into a ring of pixel pack buffers guarded by fences, so glReadPixels never waits for the GPU. A buffer
+ * is mapped only once its fence has signaled (at the latest when the ring wraps around) and the pixels are handed to
+ * an {@link ImageWriter} that encodes the PNG files on worker threads.
+ */
+class OfflineRenderer {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  private:
+    /** A single slot of the readback ring. */
+    struct ReadbackSlot {
+        GLuint buffer = 0;     // The pixel pack buffer.
+        GLsync fence = nullptr; // The fence signaled once the pixels are in the buffer.
+        int frame = -1;        // The frame stored in the buffer.
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  private:
+    /** The application that renders the frames. */
+    Application& application;
+    /** The settings. */
+    OfflineRenderSettings settings;
+
+    /** The offscreen framebuffer. */
+    GLuint framebuffer = 0;
+    /** The color buffer of the offscreen framebuffer. */
+    GLuint color_renderbuffer = 0;
+    /** The depth buffer of the offscreen framebuffer. */
+    GLuint depth_renderbuffer = 0;
+    /** The readback ring. */
+    std::vector<ReadbackSlot> slots;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    OfflineRenderer(Application& application, OfflineRenderSettings settings);
+
+    /** Releases the OpenGL objects. */
+    ~OfflineRenderer();
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Renders all the frames and waits until they are written.
+     *
+     * @return	The process exit code, zero on success.
+     */
+    int run();
+
+  private:
+    /** @return The position of the camera in the given frame. */
+    glm::vec3 camera_position(int frame) const;
+
+    /** @return The path of the image of the given frame. */
+    std::filesystem::path frame_path(int frame) const;
+
+    /**
+     * Hands the pixels in the slot over to the writer.
+     *
+     * @param 	wait	If false, the slot is retired only if its fence has already signaled.
+     * @return	True if the slot is free afterwards.
+     */
+    bool retire(ReadbackSlot& slot, ImageWriter& writer, bool wait);
+};
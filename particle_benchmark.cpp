@@ -0,0 +1,161 @@
+#include "particle_benchmark.hpp"
+#include "command_line.hpp"
+#include "cpu_particle_simulation.hpp"
+#include "gpu_program.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+namespace {
+/** A layout of the particles measured by the benchmark. */
+struct Layout {
+    const char* name;
+    ShaderDefines defines;
+    GLsizeiptr particle_size; // The size of a particle (in bytes), read and written once per step.
+};
+
+/** @return The time of a single simulation step (in ms) of the given number of particles. */
+double measure(GpuProgram& program, GLuint buffer, int count, int steps) {
+    const GLuint groups = (count + 255) / 256;
+    program.use();
+    program.uniform("particle_count", count);
+    program.uniform("t_delta", 1000.0f / 120.0f * 0.0001f);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, buffer);
+
+    program.uniform("seed", true);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    program.uniform("seed", false);
+
+    // A few steps warm up the caches and the clocks, they are not measured.
+    for (int step = 0; step < 4; step++) {
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    GLuint queries[2];
+    glGenQueries(2, queries);
+    glQueryCounter(queries[0], GL_TIMESTAMP);
+    for (int step = 0; step < steps; step++) {
+        glDispatchCompute(groups, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    glQueryCounter(queries[1], GL_TIMESTAMP);
+
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+    glDeleteQueries(2, queries);
+    return static_cast<double>(end - start) * 1e-6 / steps;
+}
+} // namespace
+
+int run_particle_benchmark(const std::filesystem::path& shaders_path, const std::vector<std::string>& arguments) {
+    const int max_count = std::clamp(CommandLine::get_int(arguments, "--benchmark-particles", 4194304), 256, 16777216);
+    const int steps = std::clamp(CommandLine::get_int(arguments, "--benchmark-steps", 100), 1, 10000);
+
+    Layout layouts[2] = {{"legacy", {{"LEGACY_LAYOUT", "1"}}, 64}, {"compact", {}, 16}};
+    GpuProgram programs[2];
+    for (int i = 0; i < 2; i++) {
+        programs[i] = GpuProgram({shaders_path / "particle_bandwidth.comp"}, layouts[i].defines);
+        if (!programs[i].is_valid()) {
+            std::cerr << "The particle benchmark could not build its programs." << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "Simulation step, " << steps << " steps per count" << std::endl;
+    std::cout << std::setw(10) << "particles";
+    for (const Layout& layout : layouts) {
+        std::cout << std::setw(12) << (std::string(layout.name) + " ms") << std::setw(14) << (std::string(layout.name) + " GB/s");
+    }
+    std::cout << std::setw(10) << "speedup" << std::endl;
+
+    for (int count = 65536; count <= max_count; count *= 2) {
+        double times[2];
+        for (int i = 0; i < 2; i++) {
+            GLuint buffer;
+            glCreateBuffers(1, &buffer);
+            glNamedBufferStorage(buffer, layouts[i].particle_size * count, nullptr, 0);
+            times[i] = measure(programs[i], buffer, count, steps);
+            glDeleteBuffers(1, &buffer);
+        }
+
+        std::cout << std::setw(10) << count << std::fixed;
+        for (int i = 0; i < 2; i++) {
+            // Every particle is read and written once per step.
+            const double bandwidth = 2.0 * static_cast<double>(layouts[i].particle_size) * count / (times[i] * 1e6);
+            std::cout << std::setprecision(4) << std::setw(12) << times[i] << std::setprecision(1) << std::setw(14) << bandwidth;
+        }
+        std::cout << std::setprecision(2) << std::setw(10) << times[0] / times[1] << std::endl;
+    }
+    return 0;
+}
+
+int run_cpu_particle_benchmark(const std::vector<std::string>& arguments) {
+    const int count = std::clamp(CommandLine::get_int(arguments, "--benchmark-particles", 1048576), 256, 16777216);
+    const int steps = std::clamp(CommandLine::get_int(arguments, "--benchmark-steps", 100), 1, 10000);
+    const std::string output_path = CommandLine::get_string(arguments, "--particle-output", "");
+
+    // The lights at the start of the application (see Application::update), they stay in place during the benchmark.
+    CpuParticleStep settings;
+    settings.light_positions = {glm::vec3(4, 6, 4) * glm::vec3(cosf(3.14f), 1, sinf(3.14f)),
+                                glm::vec3(4, 4, 4) * glm::vec3(cosf(-3.14f / 2.0f), 1, sinf(3.14f / 2.0f)),
+                                glm::vec3(5, 2, 5) * glm::vec3(1, 1, 0)};
+
+    std::vector<int> thread_counts;
+    const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    for (int threads = 1; threads < cores; threads *= 2) {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(cores);
+
+    std::cout << "CPU simulation step, " << count << " particles, " << steps << " steps per thread count" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(16) << "Mparticles/s" << std::setw(20)
+              << "Mparticles/s/thread" << std::setw(12) << "identical" << std::endl;
+
+    std::vector<glm::vec4> reference;
+    for (int threads : thread_counts) {
+        TaskScheduler scheduler(threads);
+        CpuParticleSimulation simulation(scheduler);
+        simulation.resize(count);
+
+        // The steps are taken one by one like in the application, so the particles go through the memory every step.
+        const auto start = std::chrono::steady_clock::now();
+        for (int step = 0; step < steps; step++) {
+            simulation.step(settings);
+        }
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        const double time = elapsed.count() / steps;
+        const double throughput = count / (time * 1e3);
+
+        // The chunks do not depend on the workers, so any difference is a bug.
+        const std::vector<glm::vec4> particles = simulation.get_particles();
+        if (reference.empty()) {
+            reference = particles;
+        }
+        const bool identical = particles == reference;
+
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(4) << std::setw(12) << time << std::setprecision(1)
+                  << std::setw(16) << throughput << std::setw(20) << throughput / threads << std::setw(12) << (identical ? "yes" : "NO")
+                  << std::endl;
+        if (!identical) {
+            std::cerr << "The CPU particle simulation depends on the number of threads." << std::endl;
+            return 1;
+        }
+    }
+
+    if (!output_path.empty()) {
+        std::ofstream output(output_path, std::ios::binary);
+        output.write(reinterpret_cast<const char*>(reference.data()), static_cast<std::streamsize>(reference.size() * sizeof(glm::vec4)));
+        if (!output) {
+            std::cerr << "Could not write the particles to " << output_path << "." << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
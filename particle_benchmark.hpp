@@ -0,0 +1,31 @@
+#pragma once
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * Measures the simulation step of the particles with the compact layout (16 bytes per particle) and with the layout it
+ * replaced (64 bytes), see shaders/particle_bandwidth.comp, and prints the time per step and the effective bandwidth.
+ *
+ * Needs a current OpenGL context. The options are --benchmark-particles N (the largest count, 4194304 by default) and
+ * --benchmark-steps N (the steps measured per count, 100 by default).
+ *
+ * @param 	shaders_path	The directory with the shaders.
+ * @param 	arguments   	The command line arguments.
+ * @return	The exit code of the application.
+ */
+int run_particle_benchmark(const std::filesystem::path& shaders_path, const std::vector<std::string>& arguments);
+
+/**
+ * Measures the CPU simulation (see {@link CpuParticleSimulation}) with 1, 2, 4, ... threads up to the number of cores,
+ * prints the time per step and the throughput in particles per second in total and per thread, and checks that every
+ * thread count produces the same particles as the single thread.
+ *
+ * Does not need any OpenGL context. The options are --benchmark-particles N (1048576 by default), --benchmark-steps N
+ * (100 by default), and --particle-output FILE, which stores the final particles as raw little-endian floats in the
+ * layout of the particle buffer (x, y, z, delay), so they can be compared with a readback of the GPU simulation.
+ *
+ * @param 	arguments	The command line arguments.
+ * @return	The exit code of the application.
+ */
+int run_cpu_particle_benchmark(const std::vector<std::string>& arguments);
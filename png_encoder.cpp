@@ -0,0 +1,271 @@
+#include "png_encoder.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+// ----------------------------------------------------------------------------
+// Checksums
+// ----------------------------------------------------------------------------
+/** @return The CRC-32 used by the PNG chunks. */
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> result{};
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            result[n] = c;
+        }
+        return result;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/** @return The Adler-32 checksum closing the zlib stream. */
+uint32_t adler32(const std::vector<uint8_t>& data) {
+    uint32_t a = 1, b = 0;
+    size_t i = 0;
+    while (i < data.size()) {
+        // 5552 is the largest block for which the sums cannot overflow before the modulo.
+        const size_t end = std::min(data.size(), i + 5552);
+        for (; i < end; i++) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+// ----------------------------------------------------------------------------
+// Deflate
+// ----------------------------------------------------------------------------
+/** Writes bits in the LSB-first order used by deflate. */
+class BitWriter {
+  private:
+    std::vector<uint8_t>& out;
+    uint32_t buffer = 0;
+    int count = 0;
+
+  public:
+    explicit BitWriter(std::vector<uint8_t>& out) : out(out) {}
+
+    void write(uint32_t bits, int bit_count) {
+        buffer |= bits << count;
+        count += bit_count;
+        while (count >= 8) {
+            out.push_back(static_cast<uint8_t>(buffer & 0xFF));
+            buffer >>= 8;
+            count -= 8;
+        }
+    }
+
+    /** Huffman codes are stored starting with their most significant bit. */
+    void write_code(uint32_t code, int bit_count) {
+        uint32_t reversed = 0;
+        for (int i = 0; i < bit_count; i++) {
+            reversed = (reversed << 1) | ((code >> i) & 1);
+        }
+        write(reversed, bit_count);
+    }
+
+    void flush() {
+        if (count > 0) {
+            out.push_back(static_cast<uint8_t>(buffer & 0xFF));
+        }
+        buffer = 0;
+        count = 0;
+    }
+};
+
+constexpr int length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr int distance_base[30] = {1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+                                   193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr int distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+/** Writes a literal/length symbol using the fixed Huffman code. */
+void write_symbol(BitWriter& writer, int symbol) {
+    if (symbol <= 143) {
+        writer.write_code(0x30 + symbol, 8);
+    } else if (symbol <= 255) {
+        writer.write_code(0x190 + symbol - 144, 9);
+    } else if (symbol <= 279) {
+        writer.write_code(symbol - 256, 7);
+    } else {
+        writer.write_code(0xC0 + symbol - 280, 8);
+    }
+}
+
+/** Writes a back-reference. */
+void write_match(BitWriter& writer, int length, int distance) {
+    int l = 28;
+    while (length_base[l] > length) l--;
+    write_symbol(writer, 257 + l);
+    writer.write(length - length_base[l], length_extra[l]);
+
+    int d = 29;
+    while (distance_base[d] > distance) d--;
+    writer.write_code(d, 5);
+    writer.write(distance - distance_base[d], distance_extra[d]);
+}
+
+/** Compresses the data into a zlib stream with a single fixed Huffman block. */
+std::vector<uint8_t> zlib_compress(const std::vector<uint8_t>& data) {
+    constexpr int window_size = 32768;
+    constexpr int max_match = 258;
+    constexpr int max_chain = 32;
+    constexpr int hash_bits = 15;
+
+    std::vector<uint8_t> out = {0x78, 0x01}; // Deflate with 32K window, no dictionary.
+    BitWriter writer(out);
+    writer.write(1, 1); // BFINAL
+    writer.write(1, 2); // BTYPE = fixed Huffman codes
+
+    const size_t size = data.size();
+    std::vector<int> head(1 << hash_bits, -1);
+    std::vector<int> previous(size, -1);
+    const auto hash = [&](size_t i) {
+        return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << hash_bits) - 1);
+    };
+    const auto insert = [&](size_t i) {
+        if (i + 2 < size) {
+            const int h = hash(i);
+            previous[i] = head[h];
+            head[h] = static_cast<int>(i);
+        }
+    };
+
+    size_t i = 0;
+    while (i < size) {
+        int best_length = 0;
+        int best_distance = 0;
+        if (i + 2 < size) {
+            const int max_length = static_cast<int>(std::min<size_t>(max_match, size - i));
+            int candidate = head[hash(i)];
+            for (int chain = 0; candidate >= 0 && static_cast<int>(i) - candidate <= window_size && chain < max_chain; chain++) {
+                int length = 0;
+                while (length < max_length && data[candidate + length] == data[i + length]) length++;
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = static_cast<int>(i) - candidate;
+                    if (length == max_length) break;
+                }
+                candidate = previous[candidate];
+            }
+        }
+
+        if (best_length >= 3) {
+            write_match(writer, best_length, best_distance);
+            for (int k = 0; k < best_length; k++) insert(i + k);
+            i += best_length;
+        } else {
+            write_symbol(writer, data[i]);
+            insert(i);
+            i++;
+        }
+    }
+    write_symbol(writer, 256); // End of block.
+    writer.flush();
+
+    const uint32_t checksum = adler32(data);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(checksum >> shift));
+    }
+    return out;
+}
+
+// ----------------------------------------------------------------------------
+// PNG
+// ----------------------------------------------------------------------------
+void append_u32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void append_chunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+    append_u32(out, static_cast<uint32_t>(data.size()));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    append_u32(out, crc32(out.data() + start, out.size() - start));
+}
+
+/** The Paeth predictor from the PNG specification. */
+uint8_t paeth(int a, int b, int c) {
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return static_cast<uint8_t>(a);
+    if (pb <= pc) return static_cast<uint8_t>(b);
+    return static_cast<uint8_t>(c);
+}
+} // namespace
+
+std::vector<uint8_t> encode_png(const uint8_t* rgba, int width, int height, bool bottom_up) {
+    constexpr int bpp = 3; // RGB8
+    const size_t stride = static_cast<size_t>(width) * bpp;
+
+    // Filters every row, choosing the filter with the smallest sum of absolute (signed) values.
+    std::vector<uint8_t> filtered(static_cast<size_t>(height) * (stride + 1));
+    std::vector<uint8_t> row(stride), previous_row(stride, 0), candidate(stride), best(stride);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* source = rgba + static_cast<size_t>(bottom_up ? height - 1 - y : y) * width * 4;
+        for (int x = 0; x < width; x++) {
+            std::memcpy(&row[static_cast<size_t>(x) * bpp], source + static_cast<size_t>(x) * 4, bpp);
+        }
+
+        uint64_t best_score = UINT64_MAX;
+        uint8_t best_filter = 0;
+        for (uint8_t filter = 0; filter < 5; filter++) {
+            uint64_t score = 0;
+            for (size_t i = 0; i < stride; i++) {
+                const int a = i >= bpp ? row[i - bpp] : 0;
+                const int b = previous_row[i];
+                const int c = i >= bpp ? previous_row[i - bpp] : 0;
+                uint8_t predicted = 0;
+                switch (filter) {
+                case 1: predicted = static_cast<uint8_t>(a); break;
+                case 2: predicted = static_cast<uint8_t>(b); break;
+                case 3: predicted = static_cast<uint8_t>((a + b) / 2); break;
+                case 4: predicted = paeth(a, b, c); break;
+                default: break;
+                }
+                candidate[i] = static_cast<uint8_t>(row[i] - predicted);
+                score += std::abs(static_cast<int8_t>(candidate[i]));
+            }
+            if (score < best_score) {
+                best_score = score;
+                best_filter = filter;
+                best.swap(candidate);
+            }
+        }
+
+        uint8_t* target = &filtered[static_cast<size_t>(y) * (stride + 1)];
+        target[0] = best_filter;
+        std::memcpy(target + 1, best.data(), stride);
+        previous_row.swap(row);
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+
+    std::vector<uint8_t> header;
+    append_u32(header, static_cast<uint32_t>(width));
+    append_u32(header, static_cast<uint32_t>(height));
+    header.insert(header.end(), {8, 2, 0, 0, 0}); // 8-bit RGB, deflate, adaptive filtering, no interlace.
+    append_chunk(png, "IHDR", header);
+    append_chunk(png, "IDAT", zlib_compress(filtered));
+    append_chunk(png, "IEND", {});
+    return png;
+}
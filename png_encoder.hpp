@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/**
+ * Encodes an image read back from OpenGL into a PNG file in memory.
+ *
+ * The encoder is self-contained: every row is filtered with the PNG filter that minimizes the sum of absolute
+ * differences and the result is compressed with a greedy LZ77 matcher and the fixed Huffman codes of deflate. That is
+ * not as tight as zlib's best level, but it is fast and needs no external dependency.
+ *
+ * @param 	rgba	  	The pixels in RGBA8 format, tightly packed. The alpha channel is dropped.
+ * @param 	width	  	The width of the image.
+ * @param 	height	  	The height of the image.
+ * @param 	bottom_up	The flag determining if the first row is the bottom one (the order used by glReadPixels).
+ * @return	The content of the PNG file.
+ */
+std::vector<uint8_t> encode_png(const uint8_t* rgba, int width, int height, bool bottom_up = true);
@@ -0,0 +1,130 @@
+#include "program_binary_cache.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <system_error>
+
+namespace {
+/** The identification of the cache files, bumped when their layout changes. */
+constexpr char magic[8] = {'P', 'V', '2', '2', '7', 'B', 'I', '1'};
+
+std::filesystem::path cache_directory;
+int hits = 0;
+int misses = 0;
+int rejected = 0;
+
+/** The 64-bit FNV-1a hash. */
+uint64_t fnv1a(const std::string& data, uint64_t hash = 14695981039346656037ull) {
+    for (const unsigned char c : data) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string get_gl_string(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? reinterpret_cast<const char*>(value) : "";
+}
+
+std::filesystem::path get_file(const std::string& key) { return cache_directory / (key + ".bin"); }
+} // namespace
+
+namespace ProgramBinaryCache {
+void set_directory(const std::filesystem::path& directory) { cache_directory = directory; }
+
+bool is_enabled() {
+    if (cache_directory.empty()) return false;
+    static const bool supported = []() {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }();
+    return supported;
+}
+
+std::string get_key(const std::vector<std::pair<GLenum, std::string>>& sources) {
+    if (!is_enabled()) return {};
+
+    // The driver strings are part of the key, a binary is only valid for the driver that produced it.
+    static const std::string driver = get_gl_string(GL_VENDOR) + "\n" + get_gl_string(GL_RENDERER) + "\n" + get_gl_string(GL_VERSION);
+    uint64_t hash = fnv1a(driver);
+    for (const auto& [stage, source] : sources) {
+        hash = fnv1a(std::to_string(stage) + "\n", hash);
+        hash = fnv1a(source, hash);
+    }
+
+    char key[17];
+    std::snprintf(key, sizeof(key), "%016llx", static_cast<unsigned long long>(hash));
+    return key;
+}
+
+bool load(GLuint program, const std::string& key) {
+    if (key.empty()) return false;
+    std::ifstream stream(get_file(key), std::ios::binary);
+    if (!stream) {
+        misses++;
+        return false;
+    }
+
+    char file_magic[sizeof(magic)] = {};
+    GLenum format = 0;
+    stream.read(file_magic, sizeof(file_magic));
+    stream.read(reinterpret_cast<char*>(&format), sizeof(format));
+    const std::vector<char> binary((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if (std::memcmp(file_magic, magic, sizeof(magic)) != 0 || binary.empty()) {
+        rejected++;
+        return false;
+    }
+
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // The stale file is overwritten once the program is compiled from the sources.
+        rejected++;
+        return false;
+    }
+    hits++;
+    return true;
+}
+
+void store(GLuint program, const std::string& key) {
+    if (key.empty()) return;
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    // Writes into a temporary file first, so a concurrently starting instance never reads a partial binary.
+    std::error_code error;
+    std::filesystem::create_directories(cache_directory, error);
+    const std::filesystem::path file = get_file(key);
+    // The name is unique per writer, instances storing the same file at once never write into the same temporary file.
+    const std::filesystem::path temporary = file.string() + "." + std::to_string(std::random_device{}()) + ".tmp";
+    {
+        std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+        if (!stream) {
+            std::cerr << "Could not write the program binary " << temporary << "." << std::endl;
+            return;
+        }
+        stream.write(magic, sizeof(magic));
+        stream.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        stream.write(binary.data(), static_cast<std::streamsize>(binary.size()));
+    }
+    std::filesystem::rename(temporary, file, error);
+    if (error) {
+        std::filesystem::remove(temporary, error);
+    }
+}
+
+int get_hit_count() { return hits; }
+int get_miss_count() { return misses; }
+int get_rejected_count() { return rejected; }
+} // namespace ProgramBinaryCache
@@ -0,0 +1,41 @@
+#pragma once
+#include "pv227_application.hpp"
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Stores linked programs on disk with glGetProgramBinary and restores them with glProgramBinary on the next start.
+ *
+ * A binary is keyed by a hash of the preprocessed sources of all its stages and of the vendor, renderer and version
+ * strings of the driver, so an edited shader or an updated driver simply misses the cache. The driver may still reject
+ * a binary (e.g., after an update that kept the version string), {@link load} then returns false and the caller compiles
+ * the program from the sources. The cache is disabled until {@link set_directory} is called with a non-empty path.
+ */
+namespace ProgramBinaryCache {
+/** Sets the directory of the binaries (created when needed), an empty path disables the cache. */
+void set_directory(const std::filesystem::path& directory);
+
+/** @return Whether the cache is enabled and the driver supports at least one program binary format. */
+bool is_enabled();
+
+/**
+ * Computes the key of a program.
+ *
+ * @param 	sources	The stages and their preprocessed sources in the order of attachment.
+ * @return	The key, empty if the cache is disabled.
+ */
+std::string get_key(const std::vector<std::pair<GLenum, std::string>>& sources);
+
+/** @return Whether the binary of the key was found and accepted by the driver, the program is linked if so. */
+bool load(GLuint program, const std::string& key);
+
+/** Stores the binary of the linked program (the program should be created with GL_PROGRAM_BINARY_RETRIEVABLE_HINT). */
+void store(GLuint program, const std::string& key);
+
+/** @return The number of programs restored from the cache, compiled from the sources, and the rejected binaries. */
+int get_hit_count();
+int get_miss_count();
+int get_rejected_count();
+} // namespace ProgramBinaryCache
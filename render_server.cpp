@@ -0,0 +1,481 @@
+#include "render_server.hpp"
+#include "application.hpp"
+#include "command_line.hpp"
+#include "png_encoder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+/** The longest accepted request line, longer ones close the connection. */
+constexpr size_t max_line_length = 65536;
+/** The largest accepted image size. */
+constexpr int max_image_size = 8192;
+/** The largest number of pixels rendered in one batch, it bounds the pixel pack buffer (4 bytes per pixel). */
+constexpr int64_t max_batch_pixels = static_cast<int64_t>(max_image_size) * max_image_size;
+
+/** Parses the whole text as a single value. */
+template <typename T> bool parse(const std::string& text, T& value) {
+    std::istringstream stream(text);
+    return (stream >> value) && (stream >> std::ws).eof();
+}
+
+/** The accepted values of a numeric setting, the range of its control in the UI. */
+struct SettingRange {
+    const char* name; // The name of the setting (see Application::get_settings).
+    bool integer;     // The flag determining if the setting is an integer instead of a float.
+    float min;        // The smallest accepted value.
+    float max;        // The largest accepted value.
+};
+
+/** The ranges of the numeric settings, the other settings are flags (0 or 1). */
+constexpr SettingRange setting_ranges[] = {
+    {"reflections", true, 1.0f, 100.0f},
+    {"shadow_samples", true, 1.0f, 128.0f},
+    {"ambient_occlusion_samples", true, 4.0f, 64.0f},
+    {"particle_count", true, 256.0f, static_cast<float>(max_particle_count)},
+    {"particle_size", false, 0.1f, 2.0f},
+    {"light_sphere_speed", false, 0.0f, 10.0f},
+    {"sphere_light_radius", false, 0.0f, 1.0f},
+    {"extra_spheres", true, 0.0f, 1000000.0f},
+    {"analytic_occlusion_range", false, 1.0f, 40.0f},
+    {"ambient_occlusion_bake_budget", true, 1.0f, static_cast<float>(AmbientOcclusionCache::max_jobs)},
+    {"denoiser_iterations", true, 1.0f, static_cast<float>(Denoiser::max_iterations)},
+    {"accumulation_samples_per_frame", true, 1.0f, 8.0f},
+    {"accumulation_target_samples", true, 16.0f, 1024.0f},
+    {"target_frame_time", false, 4.0f, 100.0f},
+    {"render_scale", false, 0.25f, 1.0f}, // Application::min_render_scale
+};
+
+/** @return Whether the value is valid for the setting, so a request can neither break nor exhaust the renderer. */
+bool is_valid_setting(const std::string& name, const std::string& value) {
+    // The dynamic resolution follows the frame times, so the images would depend on the load of the machine.
+    if (name == "use_dynamic_resolution") {
+        int flag;
+        return parse(value, flag) && flag == 0;
+    }
+    const auto range = std::find_if(std::begin(setting_ranges), std::end(setting_ranges), [&](const SettingRange& r) { return name == r.name; });
+    if (range == std::end(setting_ranges)) {
+        int flag;
+        return parse(value, flag) && (flag == 0 || flag == 1);
+    }
+    float number;
+    if (range->integer) {
+        int integer;
+        if (!parse(value, integer)) return false;
+        number = static_cast<float>(integer);
+    } else if (!parse(value, number)) {
+        return false;
+    }
+    return number >= range->min && number <= range->max;
+}
+
+/** @return The nearest-rank percentile of the sorted values. */
+float percentile(const std::vector<float>& sorted, double fraction) {
+    if (sorted.empty()) return 0.0f;
+    const size_t rank = static_cast<size_t>(std::ceil(fraction * static_cast<double>(sorted.size())));
+    return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Settings
+// ----------------------------------------------------------------------------
+RenderServerSettings RenderServerSettings::from_arguments(const std::vector<std::string>& arguments) {
+    RenderServerSettings settings;
+    settings.enabled = CommandLine::has_flag(arguments, "--serve");
+    settings.socket_path = CommandLine::get_string(arguments, "--socket", settings.socket_path.string());
+    settings.max_batch = std::max(1, CommandLine::get_int(arguments, "--max-batch", settings.max_batch));
+    settings.time_step = CommandLine::get_float(arguments, "--time-step", settings.time_step);
+    settings.encoder_threads = CommandLine::get_int(arguments, "--encoder-threads", settings.encoder_threads);
+    settings.report_interval = std::max(1, CommandLine::get_int(arguments, "--report-interval", settings.report_interval));
+    return settings;
+}
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+RenderServer::RenderServer(Application& application, RenderServerSettings settings)
+    : application(application), settings(std::move(settings)), encoder(this->settings.encoder_threads) {
+#ifdef _WIN32
+    std::cerr << "The render server needs Unix domain sockets, it is not available on this platform." << std::endl;
+#else
+    const std::string path = this->settings.socket_path.string();
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "The socket path " << path << " is too long." << std::endl;
+        return;
+    }
+    std::copy(path.begin(), path.end(), address.sun_path);
+
+    // A socket left behind by a previous server would make the bind fail.
+    unlink(path.c_str());
+    listen_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_socket < 0 || bind(listen_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listen_socket, 64) != 0) {
+        std::cerr << "Could not listen on " << path << "." << std::endl;
+        if (listen_socket >= 0) close(listen_socket);
+        listen_socket = -1;
+        return;
+    }
+    fcntl(listen_socket, F_SETFL, fcntl(listen_socket, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+RenderServer::~RenderServer() {
+#ifndef _WIN32
+    for (auto& [id, client] : clients) {
+        close(client.socket);
+    }
+    if (listen_socket >= 0) {
+        close(listen_socket);
+        unlink(settings.socket_path.string().c_str());
+    }
+#endif
+    glDeleteBuffers(1, &readback_buffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color_renderbuffer);
+    glDeleteRenderbuffers(1, &depth_renderbuffer);
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+int RenderServer::run() {
+    if (listen_socket < 0) {
+        return 1;
+    }
+
+    application.set_setting("use_dynamic_resolution", "0");
+    defaults = application.get_settings();
+    application.finish_loading();
+    application.finish_ambient_occlusion_cache();
+    std::cout << "Serving on " << settings.socket_path.string() << "." << std::endl;
+
+    // The sockets are drained before every batch, so the requests that arrived while rendering join the next batch.
+    while (!stopping) {
+        poll_sockets(queue.empty() ? -1 : 0);
+        if (!queue.empty() && !stopping) {
+            render_batch();
+        }
+    }
+
+    // Gives the clients a moment to receive the last responses.
+    for (int attempt = 0; attempt < 100; attempt++) {
+        const bool pending = std::any_of(clients.begin(), clients.end(), [](const auto& entry) { return !entry.second.output.empty(); });
+        if (!pending) break;
+        poll_sockets(10);
+    }
+
+    // Returns the application to the state it started in.
+    for (const auto& [name, value] : defaults) {
+        application.set_setting(name, value);
+    }
+    application.set_output_framebuffer(0);
+    application.set_scripted_time(std::nullopt);
+    application.set_scripted_eye_position(std::nullopt);
+
+    std::cout << "Render server stopped: " << get_statistics() << std::endl;
+    return 0;
+}
+
+void RenderServer::poll_sockets(int timeout) {
+#ifndef _WIN32
+    std::vector<pollfd> descriptors = {{listen_socket, POLLIN, 0}};
+    std::vector<uint64_t> ids;
+    for (const auto& [id, client] : clients) {
+        const short events = (client.closing ? 0 : POLLIN) | (client.output.empty() ? 0 : POLLOUT);
+        descriptors.push_back({client.socket, events, 0});
+        ids.push_back(id);
+    }
+    if (poll(descriptors.data(), descriptors.size(), timeout) <= 0) {
+        return;
+    }
+
+    if (descriptors[0].revents & POLLIN) {
+        for (int connection; (connection = accept(listen_socket, nullptr, nullptr)) >= 0;) {
+            fcntl(connection, F_SETFL, fcntl(connection, F_GETFL) | O_NONBLOCK);
+            clients[next_client++].socket = connection;
+        }
+    }
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        const short events = descriptors[i + 1].revents;
+        Client& client = clients[ids[i]];
+
+        if (events & POLLIN) {
+            char buffer[65536];
+            ssize_t received;
+            while ((received = recv(client.socket, buffer, sizeof(buffer), 0)) > 0) {
+                client.input.append(buffer, static_cast<size_t>(received));
+            }
+            // The client may close its side once the requests are sent, the responses are still delivered.
+            if (received == 0) {
+                client.closing = true;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                client.broken = true;
+            }
+
+            size_t start = 0;
+            for (size_t end; (end = client.input.find('\n', start)) != std::string::npos; start = end + 1) {
+                std::string line = client.input.substr(start, end - start);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                handle_line(ids[i], line);
+            }
+            client.input.erase(0, start);
+            if (client.input.size() > max_line_length) {
+                respond(ids[i], "status=error message=line_too_long");
+                client.input.clear();
+                client.closing = true;
+            }
+        } else if (events & (POLLERR | POLLHUP | POLLNVAL)) {
+            client.broken = true;
+        }
+
+        if (!client.output.empty() && !client.broken) {
+            const ssize_t sent = send(client.socket, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+            if (sent > 0) {
+                client.output.erase(0, static_cast<size_t>(sent));
+            } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                client.broken = true;
+            }
+        }
+    }
+    close_clients();
+#endif
+}
+
+void RenderServer::close_clients() {
+#ifndef _WIN32
+    for (auto it = clients.begin(); it != clients.end();) {
+        const uint64_t id = it->first;
+        const Client& client = it->second;
+        const bool waiting = std::any_of(queue.begin(), queue.end(), [&](const Request& request) { return request.client == id; });
+        if (client.broken || (client.closing && client.output.empty() && !waiting)) {
+            close(client.socket);
+            queue.erase(std::remove_if(queue.begin(), queue.end(), [&](const Request& request) { return request.client == id; }), queue.end());
+            it = clients.erase(it);
+        } else {
+            ++it;
+        }
+    }
+#endif
+}
+
+void RenderServer::handle_line(uint64_t client, const std::string& line) {
+    if (line.empty()) {
+        return;
+    }
+    if (line == "stats") {
+        respond(client, "status=ok " + get_statistics());
+        return;
+    }
+    if (line == "shutdown") {
+        respond(client, "status=ok");
+        stopping = true;
+        return;
+    }
+
+    Request request;
+    request.client = client;
+    request.received = std::chrono::steady_clock::now();
+    std::map<std::string, std::string> changed_settings;
+    std::string error;
+
+    std::istringstream stream(line);
+    for (std::string pair; error.empty() && stream >> pair;) {
+        const size_t separator = pair.find('=');
+        if (separator == std::string::npos) {
+            error = "expected_name=value";
+            break;
+        }
+        const std::string name = pair.substr(0, separator);
+        const std::string value = pair.substr(separator + 1);
+
+        if (name == "id") {
+            request.id = value;
+        } else if (name == "width" || name == "height") {
+            int& size = name == "width" ? request.width : request.height;
+            if (!parse(value, size) || size < 1 || size > max_image_size) error = "invalid_" + name;
+        } else if (name == "eye") {
+            glm::vec3& eye = request.eye_position;
+            char rest;
+            if (std::sscanf(value.c_str(), "%f,%f,%f%c", &eye.x, &eye.y, &eye.z, &rest) != 3) error = "invalid_eye";
+        } else if (name == "time") {
+            if (!parse(value, request.time)) error = "invalid_time";
+        } else if (std::any_of(defaults.begin(), defaults.end(), [&](const auto& setting) { return setting.first == name; })) {
+            if (!is_valid_setting(name, value)) error = "invalid_" + name;
+            changed_settings[name] = value;
+        } else {
+            error = "unknown_name_" + name;
+        }
+    }
+
+    const std::string id = "id=" + (request.id.empty() ? std::string("-") : request.id) + " ";
+    if (!error.empty()) {
+        respond(client, id + "status=error message=" + error);
+        return;
+    }
+
+    // The map sorts the settings, so the requests with the same settings compare equal in any order.
+    request.settings.assign(changed_settings.begin(), changed_settings.end());
+    if (latencies.empty() && queue.empty() && batch_count == 0) {
+        first_request = request.received;
+    }
+    queue.push_back(std::move(request));
+}
+
+void RenderServer::render_batch() {
+    // The oldest request decides the batch, so no request waits for more than one batch of other settings.
+    const int width = queue.front().width;
+    const int height = queue.front().height;
+    const SettingList batch_settings = queue.front().settings;
+    // The large images are rendered in smaller batches, so the readback never needs more than max_batch_pixels.
+    const int64_t frame_pixels = static_cast<int64_t>(width) * height;
+    const int max_frames = static_cast<int>(std::clamp<int64_t>(max_batch_pixels / frame_pixels, 1, settings.max_batch));
+    std::vector<Request> batch;
+    for (auto it = queue.begin(); it != queue.end() && static_cast<int>(batch.size()) < max_frames;) {
+        if (it->width == width && it->height == height && it->settings == batch_settings) {
+            batch.push_back(std::move(*it));
+            it = queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const auto& [name, value] : defaults) {
+        application.set_setting(name, value);
+    }
+    for (const auto& [name, value] : batch_settings) {
+        application.set_setting(name, value);
+    }
+    // The cache is complete before every batch, otherwise the images would depend on the batches rendered before.
+    application.finish_ambient_occlusion_cache();
+    prepare_framebuffer(width, height);
+    application.set_output_framebuffer(framebuffer);
+
+    const GLsizeiptr frame_size = static_cast<GLsizeiptr>(width) * height * 4;
+    const GLsizeiptr batch_size = frame_size * static_cast<GLsizeiptr>(batch.size());
+    if (batch_size > readback_size) {
+        glDeleteBuffers(1, &readback_buffer);
+        glCreateBuffers(1, &readback_buffer);
+        glNamedBufferStorage(readback_buffer, batch_size, nullptr, GL_MAP_READ_BIT);
+        readback_size = batch_size;
+    }
+
+    // The frames are rendered back to back, the readbacks only wait for the GPU once at the end.
+    for (size_t i = 0; i < batch.size(); i++) {
+        application.reset_simulation_state();
+        application.set_scripted_time(batch[i].time);
+        application.set_scripted_eye_position(batch[i].eye_position);
+        application.update(settings.time_step);
+        application.render();
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffer);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<void*>(frame_size * static_cast<GLsizeiptr>(i)));
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    }
+    const GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GLenum status = GL_TIMEOUT_EXPIRED;
+    while (status == GL_TIMEOUT_EXPIRED) {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1 s
+    }
+    glDeleteSync(fence);
+
+    std::vector<std::vector<uint8_t>> images(batch.size());
+    if (const auto* pixels = static_cast<const uint8_t*>(glMapNamedBufferRange(readback_buffer, 0, batch_size, GL_MAP_READ_BIT))) {
+        encoder.parallel_for(static_cast<int>(batch.size()), [&](int i, int) {
+            images[i] = encode_png(pixels + frame_size * static_cast<GLsizeiptr>(i), width, height);
+        });
+        glUnmapNamedBuffer(readback_buffer);
+    }
+    batch_count++;
+
+    const auto encoded = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < batch.size(); i++) {
+        const Request& request = batch[i];
+        const std::string id = "id=" + (request.id.empty() ? std::string("-") : request.id) + " ";
+        if (status == GL_WAIT_FAILED || images[i].empty()) {
+            respond(request.client, id + "status=error message=render_failed");
+            continue;
+        }
+
+        const float latency = std::chrono::duration<float, std::milli>(encoded - request.received).count();
+        latencies.push_back(latency);
+        std::ostringstream header;
+        header << id << "status=ok width=" << width << " height=" << height << " latency_ms=" << latency << " bytes=" << images[i].size();
+        respond(request.client, header.str(), images[i]);
+
+        if (latencies.size() % settings.report_interval == 0) {
+            std::cout << get_statistics() << std::endl;
+        }
+    }
+}
+
+void RenderServer::prepare_framebuffer(int width, int height) {
+    if (framebuffer_size.x == width && framebuffer_size.y == height) {
+        return;
+    }
+    framebuffer_size = glm::ivec2(width, height);
+
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &color_renderbuffer);
+    glDeleteRenderbuffers(1, &depth_renderbuffer);
+
+    glCreateRenderbuffers(1, &color_renderbuffer);
+    glNamedRenderbufferStorage(color_renderbuffer, GL_RGBA8, width, height);
+    glCreateRenderbuffers(1, &depth_renderbuffer);
+    glNamedRenderbufferStorage(depth_renderbuffer, GL_DEPTH_COMPONENT24, width, height);
+
+    glCreateFramebuffers(1, &framebuffer);
+    glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_renderbuffer);
+    glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_renderbuffer);
+    glNamedFramebufferDrawBuffer(framebuffer, GL_COLOR_ATTACHMENT0);
+    glNamedFramebufferReadBuffer(framebuffer, GL_COLOR_ATTACHMENT0);
+    if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "The offscreen framebuffer is incomplete." << std::endl;
+    }
+
+    // The textures of the application (the accumulation, the visibility buffer, ...) follow the size of the images.
+    application.on_resize(width, height);
+}
+
+void RenderServer::respond(uint64_t client, const std::string& header, const std::vector<uint8_t>& data) {
+    const auto it = clients.find(client);
+    if (it == clients.end()) {
+        return;
+    }
+    std::string& output = it->second.output;
+    output += header;
+    output += '\n';
+    output.append(data.begin(), data.end());
+}
+
+std::string RenderServer::get_statistics() const {
+    std::vector<float> sorted = latencies;
+    std::sort(sorted.begin(), sorted.end());
+    const double seconds = latencies.empty() ? 0.0 : std::chrono::duration<double>(std::chrono::steady_clock::now() - first_request).count();
+
+    std::ostringstream statistics;
+    statistics << "requests=" << latencies.size() << " batches=" << batch_count
+               << " mean_batch=" << (batch_count > 0 ? static_cast<double>(latencies.size()) / batch_count : 0.0)
+               << " throughput=" << (seconds > 0.0 ? static_cast<double>(latencies.size()) / seconds : 0.0)
+               << " latency_p50_ms=" << percentile(sorted, 0.50) << " latency_p95_ms=" << percentile(sorted, 0.95)
+               << " latency_p99_ms=" << percentile(sorted, 0.99) << " queued=" << queue.size();
+    return statistics.str();
+}
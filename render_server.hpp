@@ -0,0 +1,172 @@
+#pragma once
+#include "pv227_application.hpp"
+#include "scene_capture.hpp"
+#include "task_scheduler.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+class Application;
+
+/** The settings of the render server. */
+struct RenderServerSettings {
+    bool enabled = false;                                  // The flag determining if the application should serve requests.
+    std::filesystem::path socket_path = "pv227-render.sock"; // The path of the Unix socket.
+    int max_batch = 16;                                    // The maximum number of requests rendered in one batch.
+    float time_step = 1000.0f / 60.0f;                     // The time step of the single frame of a request (in ms).
+    int encoder_threads = 0;                               // The number of PNG encoding threads, zero selects the number of cores.
+    int report_interval = 1000;                            // The number of requests between the printed statistics.
+
+    /**
+     * Reads the settings from the command line.
+     *
+     * --serve, --socket PATH, --max-batch N, --time-step MS, --encoder-threads N, --report-interval N
+     */
+    static RenderServerSettings from_arguments(const std::vector<std::string>& arguments);
+};
+
+/**
+ * Renders images on request for other processes, so the startup and the shader compilation are paid only once.
+ *
+ * The server listens on a local Unix socket. A request is a single line of space-separated name=value pairs:
+ *
+ *     id=42 width=640 height=360 eye=10,5,20 time=1500 reflections=3 shadow_samples=16 use_ambient_occlusion=1
+ *
+ * The id is echoed in the response, eye is the position of the camera and time the scene time (in ms) that places the
+ * lights. Any other name is a setting of the application (see Application::get_settings), unset settings keep the values
+ * the server started with, and the values outside the range of their UI control are rejected with message=invalid_<name>.
+ * The dynamic resolution is off and cannot be enabled, since it depends on the frame times.
+ * The response is a line "id=42 status=ok width=640 height=360 latency_ms=12.5 bytes=N" followed by N bytes of a PNG
+ * file, or a line "id=42 status=error message=..." without any data. The line "stats" returns the statistics below as a
+ * single line, and "shutdown" stops the server.
+ *
+ * The requests are queued and the oldest one is rendered together with the other queued requests that have the same
+ * size and settings, so the batch keeps the shader variant, the textures, and the buffers of the application. Every
+ * request renders the first frame after Application::reset_simulation_state with a fully baked ambient occlusion cache
+ * (see Application::finish_ambient_occlusion_cache), so its image only depends on the request. The frames of a batch are
+ * read into one pixel pack buffer with a single fence and encoded in parallel. The server reports the throughput and the
+ * percentiles of the latency (from the arrival of a request until its image is encoded).
+ */
+class RenderServer {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  private:
+    /** A connected client. */
+    struct Client {
+        int socket = -1;      // The socket of the connection.
+        std::string input;    // The received data that does not form a complete line yet.
+        std::string output;   // The responses that have not been sent yet.
+        bool closing = false; // The flag determining if the connection is closed once the output is sent.
+        bool broken = false;  // The flag determining if the connection failed, it is closed right away.
+    };
+
+    /** A queued request. */
+    struct Request {
+        uint64_t client;                                     // The client the response goes to.
+        std::string id;                                      // The id echoed in the response.
+        int width = 1280;                                    // The width of the image.
+        int height = 720;                                    // The height of the image.
+        glm::vec3 eye_position = glm::vec3(0.0f, 0.0f, 25.0f); // The position of the camera.
+        double time = 0.0;                                   // The scene time (in ms).
+        SettingList settings;                                // The settings sorted by their names.
+        std::chrono::steady_clock::time_point received;      // The time the request arrived.
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  private:
+    /** The application that renders the frames. */
+    Application& application;
+    /** The settings. */
+    RenderServerSettings settings;
+    /** The settings the application started with, every batch starts from them. */
+    SettingList defaults;
+
+    /** The listening socket. */
+    int listen_socket = -1;
+    /** The connected clients by their ids, the ids are never reused unlike the sockets. */
+    std::map<uint64_t, Client> clients;
+    /** The id of the next client. */
+    uint64_t next_client = 0;
+    /** The requests waiting for a batch. */
+    std::deque<Request> queue;
+    /** The flag determining if the server should stop. */
+    bool stopping = false;
+    /** The scheduler encoding the images of a batch. */
+    TaskScheduler encoder;
+
+    /** The offscreen framebuffer. */
+    GLuint framebuffer = 0;
+    /** The color buffer of the offscreen framebuffer. */
+    GLuint color_renderbuffer = 0;
+    /** The depth buffer of the offscreen framebuffer. */
+    GLuint depth_renderbuffer = 0;
+    /** The size of the offscreen framebuffer. */
+    glm::ivec2 framebuffer_size = glm::ivec2(0, 0);
+    /** The pixel pack buffer with the frames of a batch. */
+    GLuint readback_buffer = 0;
+    /** The size of {@link readback_buffer} (in bytes). */
+    GLsizeiptr readback_size = 0;
+
+    /** The time the first request arrived. */
+    std::chrono::steady_clock::time_point first_request;
+    /** The latencies of all the answered requests (in ms). */
+    std::vector<float> latencies;
+    /** The number of rendered batches. */
+    int batch_count = 0;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    RenderServer(Application& application, RenderServerSettings settings);
+
+    /** Closes the sockets and releases the OpenGL objects. */
+    ~RenderServer();
+
+    RenderServer(const RenderServer&) = delete;
+    RenderServer& operator=(const RenderServer&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Serves the requests until a shutdown request arrives.
+     *
+     * @return	The process exit code, zero on success.
+     */
+    int run();
+
+  private:
+    /**
+     * Accepts the new clients, receives the requests, and sends the pending responses.
+     *
+     * @param 	timeout	The time to wait for any of the sockets (in ms), -1 waits until there is anything to do.
+     */
+    void poll_sockets(int timeout);
+
+    /** Parses a received line and queues the request or answers it right away. */
+    void handle_line(uint64_t client, const std::string& line);
+
+    /** Takes the oldest request and the compatible ones from the queue, renders them, and queues the responses. */
+    void render_batch();
+
+    /** Recreates the offscreen framebuffer and resizes the application if the size differs. */
+    void prepare_framebuffer(int width, int height);
+
+    /** Closes the connections that are finished or broken and drops their queued requests. */
+    void close_clients();
+
+    /** Queues a response for the client, the responses of closed clients are dropped. */
+    void respond(uint64_t client, const std::string& header, const std::vector<uint8_t>& data = {});
+
+    /** @return The statistics of the answered requests as name=value pairs. */
+    std::string get_statistics() const;
+};
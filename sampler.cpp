@@ -0,0 +1,199 @@
+#include "sampler.hpp"
+#include "utils.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+/** The permutation of Laine and Karras with the constants by Burley, it only lets the bits influence the higher ones. */
+uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+    x ^= x * 0x3d20adeau;
+    x += seed;
+    x *= (seed >> 16) | 1u;
+    x ^= x * 0x05526c56u;
+    x ^= x * 0x53a22864u;
+    return x;
+}
+
+/** Mixes the value into the seed. */
+uint32_t hash_combine(uint32_t seed, uint32_t value) { return seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2)); }
+
+/** Returns the unscrambled Sobol value of the index in the first (van der Corput) or the second dimension. */
+uint32_t sobol(uint32_t index, int dimension) {
+    if (dimension == 0) {
+        return Sampling::reverse_bits(index);
+    }
+    // The direction numbers of the second dimension (primitive polynomial x + 1).
+    uint32_t result = 0;
+    uint32_t direction = 1u << 31;
+    for (; index != 0; index >>= 1) {
+        if (index & 1u) result ^= direction;
+        direction ^= direction >> 1;
+    }
+    return result;
+}
+
+/** Converts the bits to a float in [0, 1), only the 24 bits representable exactly are used. */
+float to_unit_float(uint32_t value) { return static_cast<float>(value >> 8) * (1.0f / 16777216.0f); }
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Sampling
+// ----------------------------------------------------------------------------
+uint32_t Sampling::reverse_bits(uint32_t value) {
+    value = ((value >> 1) & 0x55555555u) | ((value & 0x55555555u) << 1);
+    value = ((value >> 2) & 0x33333333u) | ((value & 0x33333333u) << 2);
+    value = ((value >> 4) & 0x0f0f0f0fu) | ((value & 0x0f0f0f0fu) << 4);
+    value = ((value >> 8) & 0x00ff00ffu) | ((value & 0x00ff00ffu) << 8);
+    return (value >> 16) | (value << 16);
+}
+
+uint32_t Sampling::owen_scramble(uint32_t value, uint32_t seed) {
+    return reverse_bits(laine_karras_permutation(reverse_bits(value), seed));
+}
+
+glm::vec2 Sampling::sobol_owen(uint32_t index, uint32_t seed) {
+    const uint32_t shuffled = owen_scramble(index, seed);
+    return glm::vec2(to_unit_float(owen_scramble(sobol(shuffled, 0), hash_combine(seed, 0))),
+                     to_unit_float(owen_scramble(sobol(shuffled, 1), hash_combine(seed, 1))));
+}
+
+std::vector<float> Sampling::blue_noise(int size, uint32_t seed) {
+    const int count = size * size;
+    const float sigma = 1.9f;
+
+    // The Gaussian energy kernel for all toroidal offsets, so the texture tiles without seams.
+    std::vector<float> kernel(count);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            const float dx = static_cast<float>(std::min(x, size - x));
+            const float dy = static_cast<float>(std::min(y, size - y));
+            kernel[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+        }
+    }
+
+    std::vector<uint8_t> pattern(count, 0);
+    std::vector<float> energy(count, 0.0f);
+    const auto update = [&](std::vector<uint8_t>& target_pattern, std::vector<float>& target_energy, int pixel, bool set) {
+        target_pattern[pixel] = set ? 1 : 0;
+        const float sign = set ? 1.0f : -1.0f;
+        const int px = pixel % size, py = pixel / size;
+        for (int y = 0; y < size; y++) {
+            const int ky = (y - py + size) % size;
+            for (int x = 0; x < size; x++) {
+                target_energy[y * size + x] += sign * kernel[ky * size + (x - px + size) % size];
+            }
+        }
+    };
+    // The tightest cluster is the set pixel with the highest energy, the largest void the empty one with the lowest.
+    const auto tightest_cluster = [&](const std::vector<uint8_t>& target_pattern, const std::vector<float>& target_energy) {
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (target_pattern[i] && (best < 0 || target_energy[i] > target_energy[best])) best = i;
+        }
+        return best;
+    };
+    const auto largest_void = [&](const std::vector<uint8_t>& target_pattern, const std::vector<float>& target_energy) {
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (!target_pattern[i] && (best < 0 || target_energy[i] < target_energy[best])) best = i;
+        }
+        return best;
+    };
+
+    // The initial binary pattern: random pixels moved from the clusters to the voids until it is uniform.
+    std::mt19937 generator(seed);
+    const int initial_count = std::max(1, count / 10);
+    for (int set = 0; set < initial_count;) {
+        const int pixel = static_cast<int>(generator() % static_cast<uint32_t>(count));
+        if (!pattern[pixel]) {
+            update(pattern, energy, pixel, true);
+            set++;
+        }
+    }
+    for (int iteration = 0; iteration < count; iteration++) {
+        const int cluster = tightest_cluster(pattern, energy);
+        update(pattern, energy, cluster, false);
+        const int gap = largest_void(pattern, energy);
+        update(pattern, energy, gap, true);
+        if (gap == cluster) break;
+    }
+
+    std::vector<int> ranks(count, 0);
+
+    // Ranks the initial pixels by removing the tightest clusters first.
+    std::vector<uint8_t> removal_pattern = pattern;
+    std::vector<float> removal_energy = energy;
+    for (int rank = initial_count - 1; rank >= 0; rank--) {
+        const int cluster = tightest_cluster(removal_pattern, removal_energy);
+        update(removal_pattern, removal_energy, cluster, false);
+        ranks[cluster] = rank;
+    }
+
+    // Ranks the remaining pixels by filling the largest voids first.
+    for (int rank = initial_count; rank < count; rank++) {
+        const int gap = largest_void(pattern, energy);
+        update(pattern, energy, gap, true);
+        ranks[gap] = rank;
+    }
+
+    std::vector<float> values(count);
+    for (int i = 0; i < count; i++) {
+        values[i] = (static_cast<float>(ranks[i]) + 0.5f) / static_cast<float>(count);
+    }
+    return values;
+}
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+Sampler::Sampler() {
+    std::vector<glm::vec2> sequences;
+    sequences.reserve(static_cast<size_t>(sequence_length) * dimension_count);
+    for (int dimension = 0; dimension < dimension_count; dimension++) {
+        const std::vector<glm::vec2> sequence = generate_sequence(dimension);
+        sequences.insert(sequences.end(), sequence.begin(), sequence.end());
+    }
+    glCreateTextures(GL_TEXTURE_2D, 1, &sequence_texture);
+    glTextureStorage2D(sequence_texture, 1, GL_RG32F, sequence_length, dimension_count);
+    glTextureSubImage2D(sequence_texture, 0, 0, 0, sequence_length, dimension_count, GL_RG, GL_FLOAT, sequences.data());
+    TextureUtils::set_texture_2d_parameters(sequence_texture, GL_REPEAT, GL_REPEAT, GL_NEAREST, GL_NEAREST);
+
+    const std::vector<glm::vec2> noise = generate_blue_noise();
+    glCreateTextures(GL_TEXTURE_2D, 1, &blue_noise_texture);
+    glTextureStorage2D(blue_noise_texture, 1, GL_RG32F, blue_noise_size, blue_noise_size);
+    glTextureSubImage2D(blue_noise_texture, 0, 0, 0, blue_noise_size, blue_noise_size, GL_RG, GL_FLOAT, noise.data());
+    TextureUtils::set_texture_2d_parameters(blue_noise_texture, GL_REPEAT, GL_REPEAT, GL_NEAREST, GL_NEAREST);
+}
+
+Sampler::~Sampler() {
+    glDeleteTextures(1, &sequence_texture);
+    glDeleteTextures(1, &blue_noise_texture);
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+std::vector<glm::vec2> Sampler::generate_sequence(int dimension) {
+    const uint32_t seed = hash_combine(0x5eed5eedu, static_cast<uint32_t>(dimension));
+    std::vector<glm::vec2> sequence(sequence_length);
+    for (int i = 0; i < sequence_length; i++) {
+        sequence[i] = Sampling::sobol_owen(static_cast<uint32_t>(i), seed);
+    }
+    return sequence;
+}
+
+std::vector<glm::vec2> Sampler::generate_blue_noise() {
+    const std::vector<float> first = Sampling::blue_noise(blue_noise_size, 1);
+    const std::vector<float> second = Sampling::blue_noise(blue_noise_size, 2);
+    std::vector<glm::vec2> noise(first.size());
+    for (size_t i = 0; i < noise.size(); i++) {
+        noise[i] = glm::vec2(first[i], second[i]);
+    }
+    return noise;
+}
+
+void Sampler::bind(GLuint sequence_unit, GLuint blue_noise_unit) const {
+    glBindTextureUnit(sequence_unit, sequence_texture);
+    glBindTextureUnit(blue_noise_unit, blue_noise_texture);
+}
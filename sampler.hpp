@@ -0,0 +1,92 @@
+#pragma once
+#include "pv227_application.hpp"
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+/**
+ * The generators of the sample patterns used by the stochastic estimators (soft shadows and ambient occlusion).
+ *
+ * The 2D points come from the Sobol sequence with hash-based Owen scrambling (Burley, "Practical Hash-based Owen
+ * Scrambling", 2020), which keeps every prefix of the sequence well stratified, so progressively accumulated samples
+ * stay stratified as well. The decorrelation between pixels comes from blue noise generated with the void-and-cluster
+ * method (Ulichney, 1993): the error of neighboring pixels is then spread to high frequencies, which the eye and the
+ * upscale filter average out.
+ */
+namespace Sampling {
+/** @return The bits of the value in reversed order. */
+uint32_t reverse_bits(uint32_t value);
+
+/** @return The value with a nested uniform (Owen) scramble of its bits, the most significant bit is the first level. */
+uint32_t owen_scramble(uint32_t value, uint32_t seed);
+
+/**
+ * Returns a point of the Owen-scrambled 2D Sobol sequence.
+ *
+ * @param 	index	The index of the point, the index is shuffled as well so different seeds give independent sequences.
+ * @param 	seed 	The seed of the scrambling.
+ * @return	The point in [0, 1)^2.
+ */
+glm::vec2 sobol_owen(uint32_t index, uint32_t seed);
+
+/**
+ * Generates a tileable blue noise texture with the void-and-cluster method.
+ *
+ * @param 	size	The width and height of the texture.
+ * @param 	seed	The seed of the initial pattern.
+ * @return	The row-major values, every value in [0, 1) occurs exactly once.
+ */
+std::vector<float> blue_noise(int size, uint32_t seed);
+} // namespace Sampling
+
+/**
+ * The sample patterns uploaded into textures, generated once at startup.
+ *
+ * The sequence texture holds one independent Owen-scrambled Sobol sequence per row, i.e., per sampled dimension (the
+ * ambient occlusion and the shadows of each light). The blue noise texture holds two independent channels used to
+ * rotate the sequences per pixel (Cranley-Patterson rotation).
+ */
+class Sampler {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The number of points of every sequence, the sample index wraps around after it. */
+    static constexpr int sequence_length = 4096;
+    /** The number of independent sequences: the ambient occlusion and the shadows of three lights. */
+    static constexpr int dimension_count = 4;
+    /** The width and height of the blue noise texture. */
+    static constexpr int blue_noise_size = 64;
+
+  private:
+    /** The RG32F texture with the sequences, sequence_length x dimension_count texels. */
+    GLuint sequence_texture = 0;
+    /** The RG32F texture with the blue noise, blue_noise_size x blue_noise_size texels. */
+    GLuint blue_noise_texture = 0;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    /** Generates the patterns and uploads them into the textures. */
+    Sampler();
+
+    /** Releases the textures. */
+    ~Sampler();
+
+    Sampler(const Sampler&) = delete;
+    Sampler& operator=(const Sampler&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** @return The points of the sequence of the given dimension. */
+    static std::vector<glm::vec2> generate_sequence(int dimension);
+
+    /** @return The two channels of the blue noise texture. */
+    static std::vector<glm::vec2> generate_blue_noise();
+
+    /** Binds the sequence texture and the blue noise texture to the given texture units. */
+    void bind(GLuint sequence_unit, GLuint blue_noise_unit) const;
+};
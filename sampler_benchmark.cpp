@@ -0,0 +1,155 @@
+#include "sampler_benchmark.hpp"
+#include "command_line.hpp"
+#include "sampler.hpp"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+namespace {
+constexpr float PI = 3.14159265359f;
+
+/** The hash of ray_tracing.frag. */
+float random(float x, float y) {
+    const float value = std::sin(x * 12.9898f + y * 78.233f) * 43758.5453f;
+    return value - std::floor(value);
+}
+
+/** The point of the sequence rotated by the blue noise of the pixel, see SequenceSample() in ray_tracing.frag. */
+glm::vec2 sequence_sample(const std::vector<glm::vec2>& sequence, const std::vector<glm::vec2>& noise, int index, int x, int y) {
+    const glm::vec2 point = sequence[index % Sampler::sequence_length];
+    const glm::vec2 rotation = noise[(y % Sampler::blue_noise_size) * Sampler::blue_noise_size + x % Sampler::blue_noise_size];
+    return glm::fract(point + rotation);
+}
+
+/** Returns the visible fraction of a unit disk behind an edge at the signed distance t from its center. */
+float visible_disk_fraction(float t) {
+    t = std::clamp(t, -1.0f, 1.0f);
+    return (std::acos(t) - t * std::sqrt(1.0f - t * t)) / PI;
+}
+
+/** The soft shadow: the edge crosses the light at a distance given by the column and at an angle given by the row. */
+struct ShadowIntegrand {
+    int size;
+
+    float offset(int x) const { return 2.0f * (static_cast<float>(x) + 0.5f) / static_cast<float>(size) - 1.0f; }
+    float angle(int y) const { return PI * static_cast<float>(y) / static_cast<float>(size); }
+
+    /** The visibility of a sample on the light, the sample is given as in the shader (angle and radius on the disk). */
+    float visibility(int x, int y, float disk_angle, float disk_radius) const {
+        const float projection = disk_radius * std::cos(disk_angle - angle(y));
+        return projection > offset(x) ? 1.0f : 0.0f;
+    }
+
+    float reference(int x, int) const { return visible_disk_fraction(offset(x)); }
+};
+
+/** The ambient occlusion: a cap of the hemisphere with a radius given by the column and a tilt given by the row. */
+struct OcclusionIntegrand {
+    int size;
+
+    float cap_angle(int x) const { return 0.5f * PI * (static_cast<float>(x) + 0.5f) / static_cast<float>(size); }
+    glm::vec3 cap_axis(int y) const {
+        const float tilt = 0.5f * PI * static_cast<float>(y) / static_cast<float>(size);
+        return glm::vec3(std::sin(tilt), std::cos(tilt), 0.0f);
+    }
+
+    /** The unoccluded fraction of a sample, the sample is given as in the shader (phi and theta). */
+    float visibility(int x, int y, float phi, float theta) const {
+        const glm::vec3 direction(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+        return glm::dot(direction, cap_axis(y)) > std::cos(cap_angle(x)) ? 0.0f : 1.0f;
+    }
+
+    /** The shader samples phi and theta uniformly, so the reference is the area of the occluded region in that domain. */
+    float reference(int x, int y) const {
+        constexpr int grid = 256;
+        double sum = 0.0;
+        for (int i = 0; i < grid; i++) {
+            for (int j = 0; j < grid; j++) {
+                sum += visibility(x, y, 2.0f * PI * (i + 0.5f) / grid, 0.5f * PI * (j + 0.5f) / grid);
+            }
+        }
+        return static_cast<float>(sum / (grid * grid));
+    }
+};
+
+/** @return The root mean square error of the per-pixel estimates over the grid. */
+double rmse(int size, const std::vector<float>& references, const std::function<float(int, int)>& estimate) {
+    double error = 0.0;
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            const double difference = estimate(x, y) - references[y * size + x];
+            error += difference * difference;
+        }
+    }
+    return std::sqrt(error / (static_cast<double>(size) * size));
+}
+} // namespace
+
+int run_sampler_benchmark(const std::vector<std::string>& arguments) {
+    const int size = std::clamp(CommandLine::get_int(arguments, "--benchmark-size", 64), 8, 512);
+    const ShadowIntegrand shadow{size};
+    const OcclusionIntegrand occlusion{size};
+
+    std::vector<float> shadow_references(static_cast<size_t>(size) * size), occlusion_references(static_cast<size_t>(size) * size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            shadow_references[y * size + x] = shadow.reference(x, y);
+            occlusion_references[y * size + x] = occlusion.reference(x, y);
+        }
+    }
+
+    // The same tables as uploaded by the Sampler (dimension 0 is the ambient occlusion, 1 the shadows of the first light).
+    const std::vector<glm::vec2> occlusion_sequence = Sampler::generate_sequence(0);
+    const std::vector<glm::vec2> shadow_sequence = Sampler::generate_sequence(1);
+    const std::vector<glm::vec2> noise = Sampler::generate_blue_noise();
+
+    std::cout << "Root mean square error over " << size << " x " << size << " pixels" << std::endl;
+    std::cout << std::setw(8) << "samples" << std::setw(14) << "shadow hash" << std::setw(14) << "shadow seq" << std::setw(14) << "ao hash"
+              << std::setw(14) << "ao seq" << std::endl;
+    for (int samples = 1; samples <= 128; samples *= 2) {
+        // The shadow samples of the shader: one hash value for both the angle and the radius.
+        const double shadow_hash = rmse(size, shadow_references, [&](int x, int y) {
+            float sum = 0.0f;
+            for (int k = 0; k < samples; k++) {
+                const float v = static_cast<float>(k + 1) * 0.152f;
+                const float random_value = random((x + 0.5f) * v, (y + 0.5f) * v);
+                sum += shadow.visibility(x, y, 2.0f * PI * random_value, std::sqrt(random_value));
+            }
+            return sum / samples;
+        });
+        const double shadow_sequence_error = rmse(size, shadow_references, [&](int x, int y) {
+            float sum = 0.0f;
+            for (int k = 0; k < samples; k++) {
+                const glm::vec2 u = sequence_sample(shadow_sequence, noise, k, x, y);
+                sum += shadow.visibility(x, y, 2.0f * PI * u.x, std::sqrt(u.y));
+            }
+            return sum / samples;
+        });
+
+        // The ambient occlusion samples of the shader are seeded by the hit position, the pixels stand in for it.
+        const double occlusion_hash = rmse(size, occlusion_references, [&](int x, int y) {
+            const float px = 0.05f * x, py = 0.05f * y, pz = 0.05f * (x + y);
+            float sum = 0.0f;
+            for (int i = 0; i < samples; i++) {
+                const float phi = random(px, py + static_cast<float>(i)) * 2.0f * PI;
+                const float theta = random(py, pz + static_cast<float>(i)) * 0.5f * PI;
+                sum += occlusion.visibility(x, y, phi, theta);
+            }
+            return sum / samples;
+        });
+        const double occlusion_sequence_error = rmse(size, occlusion_references, [&](int x, int y) {
+            float sum = 0.0f;
+            for (int i = 0; i < samples; i++) {
+                const glm::vec2 u = sequence_sample(occlusion_sequence, noise, i, x, y);
+                sum += occlusion.visibility(x, y, u.x * 2.0f * PI, u.y * 0.5f * PI);
+            }
+            return sum / samples;
+        });
+
+        std::cout << std::setw(8) << samples << std::fixed << std::setprecision(5) << std::setw(14) << shadow_hash << std::setw(14)
+                  << shadow_sequence_error << std::setw(14) << occlusion_hash << std::setw(14) << occlusion_sequence_error << std::endl;
+    }
+    return 0;
+}
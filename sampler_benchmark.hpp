@@ -0,0 +1,18 @@
+#pragma once
+#include <string>
+#include <vector>
+
+/**
+ * Compares the variance of the shadow and ambient occlusion estimators with the hash-based random numbers of
+ * ray_tracing.frag and with the Owen-scrambled Sobol sequences rotated by blue noise (see {@link Sampler}).
+ *
+ * The estimators run on the CPU with the same sample mappings as the shader on synthetic integrands with known
+ * references: a spherical light partially covered by an occluder edge (the penumbra of a soft shadow) and a hemisphere
+ * partially covered by a spherical cap (the ambient occlusion next to a sphere). The occluder changes smoothly over a
+ * grid of pixels, the root mean square error over the grid is printed for every sample count.
+ *
+ * --sampler-benchmark, --benchmark-size N (the grid is N x N pixels)
+ *
+ * @return	The exit code of the application.
+ */
+int run_sampler_benchmark(const std::vector<std::string>& arguments);
@@ -0,0 +1,76 @@
+#include "scene_capture.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void SceneCapture::add_frame(double time, const glm::vec3& eye_position, const SettingList& settings) {
+    CaptureFrame frame{time, eye_position, {}};
+    for (const auto& setting : settings) {
+        const auto it = std::find_if(last_settings.begin(), last_settings.end(), [&](const auto& last) { return last.first == setting.first; });
+        if (it == last_settings.end() || it->second != setting.second) {
+            frame.changed_settings.push_back(setting);
+        }
+    }
+    last_settings = settings;
+    frames.push_back(std::move(frame));
+}
+
+bool SceneCapture::save(const std::filesystem::path& path) const {
+    std::ofstream file(path);
+    if (!file) {
+        return false;
+    }
+    file << "# PV227 scene capture" << "\n";
+    file << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (const CaptureFrame& frame : frames) {
+        for (const auto& [name, value] : frame.changed_settings) {
+            file << "set " << name << " " << value << "\n";
+        }
+        file << "frame " << frame.time << " " << frame.eye_position.x << " " << frame.eye_position.y << " " << frame.eye_position.z << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+std::optional<SceneCapture> SceneCapture::load(const std::filesystem::path& path) {
+    std::ifstream file(path);
+    if (!file) {
+        return std::nullopt;
+    }
+
+    SceneCapture capture;
+    SettingList pending;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream stream(line);
+        std::string keyword;
+        stream >> keyword;
+        if (keyword == "set") {
+            std::string name, value;
+            stream >> name >> value;
+            pending.emplace_back(name, value);
+        } else if (keyword == "frame") {
+            CaptureFrame frame{0.0, glm::vec3(0.0f), std::move(pending)};
+            stream >> frame.time >> frame.eye_position.x >> frame.eye_position.y >> frame.eye_position.z;
+            if (!stream) {
+                std::cerr << path << ":" << line_number << ": malformed frame." << std::endl;
+                return std::nullopt;
+            }
+            capture.frames.push_back(std::move(frame));
+            pending.clear();
+        } else {
+            std::cerr << path << ":" << line_number << ": unknown entry '" << keyword << "'." << std::endl;
+            return std::nullopt;
+        }
+    }
+    return capture;
+}
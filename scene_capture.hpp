@@ -0,0 +1,49 @@
+#pragma once
+#include "pv227_application.hpp"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+/** The settings of the UI by their names, the values are formatted as text (see Application::get_settings). */
+using SettingList = std::vector<std::pair<std::string, std::string>>;
+
+/** A recorded frame. */
+struct CaptureFrame {
+    double time;                 // The scene time (in ms), drives the lights.
+    glm::vec3 eye_position;      // The position of the camera.
+    SettingList changed_settings; // The settings changed since the previous frame (all of them in the first frame).
+};
+
+/**
+ * A recorded session that can be replayed frame by frame.
+ *
+ * The file is plain text, one line per entry: "set NAME VALUE" lines change the settings and a "frame TIME X Y Z" line
+ * ends a frame. The settings lines apply to the frame that follows them.
+ */
+class SceneCapture {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The recorded frames. */
+    std::vector<CaptureFrame> frames;
+
+  private:
+    /** The settings of the last recorded frame. */
+    SettingList last_settings;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** Records a frame, only the settings that differ from the previous frame are stored. */
+    void add_frame(double time, const glm::vec3& eye_position, const SettingList& settings);
+
+    /** @return True if the capture was written. */
+    bool save(const std::filesystem::path& path) const;
+
+    /** @return The capture read from the file or std::nullopt if the file could not be read. */
+    static std::optional<SceneCapture> load(const std::filesystem::path& path);
+};
@@ -0,0 +1,172 @@
+#include "scene_file.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+constexpr char magic[8] = {'P', 'V', '2', '2', '7', 'S', 'C', '1'};
+
+/** The alignment of the sections, a multiple of the page size on all the common platforms. */
+constexpr uint64_t section_alignment = 4096;
+
+uint64_t align(uint64_t offset) { return (offset + section_alignment - 1) / section_alignment * section_alignment; }
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+SceneFile::SceneFile(SceneFile&& other) noexcept { *this = std::move(other); }
+
+SceneFile& SceneFile::operator=(SceneFile&& other) noexcept {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+#ifdef _WIN32
+    std::swap(mapping, other.mapping);
+#endif
+    return *this;
+}
+
+SceneFile::~SceneFile() {
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mapping) CloseHandle(mapping);
+#else
+    if (data) munmap(data, size);
+#endif
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+std::optional<SceneFile> SceneFile::open(const std::filesystem::path& path) {
+    SceneFile scene;
+#ifdef _WIN32
+    const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return std::nullopt;
+    }
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart >= static_cast<LONGLONG>(sizeof(SceneFileHeader))) {
+        scene.size = static_cast<size_t>(file_size.QuadPart);
+        scene.mapping = CreateFileMappingW(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+        if (scene.mapping) {
+            scene.data = static_cast<uint8_t*>(MapViewOfFile(scene.mapping, FILE_MAP_COPY, 0, 0, 0));
+        }
+    }
+    CloseHandle(file); // The mapping keeps the file open.
+#else
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return std::nullopt;
+    }
+    struct stat status;
+    if (fstat(file, &status) == 0 && status.st_size >= static_cast<off_t>(sizeof(SceneFileHeader))) {
+        scene.size = static_cast<size_t>(status.st_size);
+        void* mapped = mmap(nullptr, scene.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+        if (mapped != MAP_FAILED) {
+            scene.data = static_cast<uint8_t*>(mapped);
+            // The sections are read front to back by the upload.
+            madvise(mapped, scene.size, MADV_SEQUENTIAL);
+        }
+    }
+    close(file); // The mapping keeps the file open.
+#endif
+
+    if (!scene.data) {
+        std::cerr << "Could not map the scene " << path << "." << std::endl;
+        return std::nullopt;
+    }
+    if (!scene.validate()) {
+        std::cerr << "The file " << path << " is not a valid scene of version " << version << "." << std::endl;
+        return std::nullopt;
+    }
+    return scene;
+}
+
+bool SceneFile::write(const std::filesystem::path& path, const glm::vec4* spheres, const PBRMaterialData* materials, int sphere_count,
+                      int static_count, const SphereBVH& bvh) {
+    SceneFileHeader header = {};
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.sphere_count = static_cast<uint32_t>(sphere_count);
+    header.static_count = static_cast<uint32_t>(static_count);
+    header.node_count = static_cast<uint32_t>(bvh.get_nodes().size());
+    header.index_count = static_cast<uint32_t>(bvh.get_sphere_indices().size());
+    header.material_size = sizeof(PBRMaterialData);
+    header.spheres_offset = align(sizeof(SceneFileHeader));
+    header.materials_offset = align(header.spheres_offset + sizeof(glm::vec4) * header.sphere_count);
+    header.nodes_offset = align(header.materials_offset + sizeof(PBRMaterialData) * header.sphere_count);
+    header.indices_offset = align(header.nodes_offset + sizeof(BVHNode) * header.node_count);
+
+    // The file is written next to the destination and renamed, so a mapped scene is never changed underneath.
+    const std::filesystem::path temporary = path.string() + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary);
+        const auto write_section = [&](uint64_t offset, const void* section, size_t length) {
+            const std::vector<char> padding(offset - static_cast<uint64_t>(file.tellp()), 0);
+            file.write(padding.data(), padding.size());
+            file.write(static_cast<const char*>(section), length);
+        };
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        write_section(header.spheres_offset, spheres, sizeof(glm::vec4) * header.sphere_count);
+        write_section(header.materials_offset, materials, sizeof(PBRMaterialData) * header.sphere_count);
+        write_section(header.nodes_offset, bvh.get_nodes().data(), sizeof(BVHNode) * header.node_count);
+        write_section(header.indices_offset, bvh.get_sphere_indices().data(), sizeof(int32_t) * header.index_count);
+        if (!file) {
+            std::filesystem::remove(temporary);
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+void SceneFile::release(const void* begin, size_t length) const {
+    const uint8_t* first = static_cast<const uint8_t*>(begin);
+    if (first < data || first + length > data + size) {
+        return; // Not a part of the mapping, e.g., a generated scene.
+    }
+#ifdef _WIN32
+    // Windows trims the clean pages of the mapping under memory pressure on its own.
+#else
+    // Only the whole pages inside the range are released, the neighboring sections may still be in use.
+    const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t start = (reinterpret_cast<uintptr_t>(first) + page - 1) / page * page;
+    const uintptr_t end = (reinterpret_cast<uintptr_t>(first) + length) / page * page;
+    if (start < end) {
+        madvise(reinterpret_cast<void*>(start), end - start, MADV_DONTNEED);
+    }
+#endif
+}
+
+bool SceneFile::validate() const {
+    const SceneFileHeader& header = get_header();
+    if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version || header.material_size != sizeof(PBRMaterialData) ||
+        header.static_count > header.sphere_count) {
+        return false;
+    }
+    const auto fits = [&](uint64_t offset, uint64_t element_size, uint64_t count) {
+        return offset % section_alignment == 0 && offset <= size && count <= (size - offset) / element_size;
+    };
+    return fits(header.spheres_offset, sizeof(glm::vec4), header.sphere_count) &&
+           fits(header.materials_offset, sizeof(PBRMaterialData), header.sphere_count) &&
+           fits(header.nodes_offset, sizeof(BVHNode), header.node_count) && fits(header.indices_offset, sizeof(int32_t), header.index_count);
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "pbr_material_ubo.hpp"
+#include "sphere_bvh.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+/**
+ * The header of a binary scene file.
+ *
+ * The header is followed by four sections in the layout of the SSBOs: the spheres (vec4, the static spheres followed by
+ * the slots of the dynamic ones), their materials (PBRMaterialData), the BVH nodes, and the sphere indices referenced by
+ * the leaves. Every section starts at a page boundary, so it can be uploaded and released page by page.
+ */
+struct SceneFileHeader {
+    char magic[8];             // "PV227SC1"
+    uint32_t version;          // The version of the layout, see SceneFile::version.
+    uint32_t sphere_count;     // The number of all the spheres.
+    uint32_t static_count;     // The number of static spheres, the rest are placeholders of the dynamic ones.
+    uint32_t node_count;       // The number of BVH nodes.
+    uint32_t index_count;      // The number of sphere indices of the BVH leaves.
+    uint32_t material_size;    // sizeof(PBRMaterialData) of the writer.
+    uint64_t spheres_offset;   // The offset of the spheres (in bytes).
+    uint64_t materials_offset; // The offset of the materials (in bytes).
+    uint64_t nodes_offset;     // The offset of the BVH nodes (in bytes).
+    uint64_t indices_offset;   // The offset of the sphere indices (in bytes).
+};
+
+/**
+ * A scene file mapped into memory.
+ *
+ * The file is mapped copy-on-write: the arrays are used in place, writing into them (e.g., moving the light spheres)
+ * copies only the touched pages and never changes the file. The pages that are not needed on the CPU after the upload
+ * can be released with {@link release}, they are read again from the file if they are touched later.
+ */
+class SceneFile {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The version of the layout written by {@link write}. */
+    static constexpr uint32_t version = 1;
+
+  private:
+    /** The mapped file. */
+    uint8_t* data = nullptr;
+    /** The size of the mapped file (in bytes). */
+    size_t size = 0;
+#ifdef _WIN32
+    /** The file mapping object. */
+    void* mapping = nullptr;
+#endif
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    SceneFile() = default;
+    SceneFile(SceneFile&& other) noexcept;
+    SceneFile& operator=(SceneFile&& other) noexcept;
+    SceneFile(const SceneFile&) = delete;
+    SceneFile& operator=(const SceneFile&) = delete;
+
+    /** Unmaps the file, the pointers returned by the getters become invalid. */
+    ~SceneFile();
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** @return The mapped scene or std::nullopt if the file could not be mapped or is not a valid scene. */
+    static std::optional<SceneFile> open(const std::filesystem::path& path);
+
+    /**
+     * Writes a scene file.
+     *
+     * @param 	path		  	The path of the file.
+     * @param 	spheres		  	The spheres (xyz = center, w = radius).
+     * @param 	materials	  	The materials of the spheres.
+     * @param 	sphere_count	The number of the spheres and the materials.
+     * @param 	static_count	The number of static spheres at the beginning of the arrays.
+     * @param 	bvh			  	The hierarchy built over the spheres.
+     * @return	True if the file was written.
+     */
+    static bool write(const std::filesystem::path& path, const glm::vec4* spheres, const PBRMaterialData* materials, int sphere_count,
+                      int static_count, const SphereBVH& bvh);
+
+    /** Releases the whole pages of the range, they are read from the file again when touched (discarding any changes). */
+    void release(const void* begin, size_t length) const;
+
+    /** @return The header of the file. */
+    const SceneFileHeader& get_header() const { return *reinterpret_cast<const SceneFileHeader*>(data); }
+
+    /** @return The spheres, writable (copy-on-write). */
+    glm::vec4* get_spheres() const { return reinterpret_cast<glm::vec4*>(data + get_header().spheres_offset); }
+
+    /** @return The materials, writable (copy-on-write). */
+    PBRMaterialData* get_materials() const { return reinterpret_cast<PBRMaterialData*>(data + get_header().materials_offset); }
+
+    /** @return The BVH nodes. */
+    const BVHNode* get_nodes() const { return reinterpret_cast<const BVHNode*>(data + get_header().nodes_offset); }
+
+    /** @return The sphere indices of the BVH leaves. */
+    const int32_t* get_sphere_indices() const { return reinterpret_cast<const int32_t*>(data + get_header().indices_offset); }
+
+  private:
+    /** @return True if the header describes sections that lie within the file. */
+    bool validate() const;
+};
@@ -0,0 +1,46 @@
+#include "shader_variant_cache.hpp"
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void ShaderVariantCache::reset(const std::vector<std::filesystem::path>& new_files) {
+    files = new_files;
+    entries.clear();
+    index.clear();
+    built_variants = 0;
+}
+
+GpuProgram* ShaderVariantCache::get(const ShaderDefines& defines) {
+    std::string key;
+    for (const auto& [name, value] : defines) {
+        key += name + "=" + value + ";";
+    }
+
+    const auto it = index.find(key);
+    if (it != index.end()) {
+        entries.splice(entries.begin(), entries, it->second);
+        GpuProgram& program = *it->second->program;
+        return program.is_ready() && program.is_valid() ? &program : nullptr;
+    }
+
+    if (get_pending_count() >= max_pending) {
+        return nullptr;
+    }
+    entries.push_front(Entry{key, std::make_unique<GpuProgram>(files, defines)});
+    index[key] = entries.begin();
+    built_variants++;
+
+    while (entries.size() > capacity) {
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+    return nullptr;
+}
+
+int ShaderVariantCache::get_pending_count() {
+    int pending = 0;
+    for (Entry& entry : entries) {
+        if (!entry.program->is_ready()) pending++;
+    }
+    return pending;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "gpu_program.hpp"
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A least recently used cache of programs specialized by compile-time definitions.
+ *
+ * {@link get} returns the program of the requested definitions once it has been linked, until then it starts its build
+ * in the background (see {@link GpuProgram}) and returns nullptr, so the caller keeps using the generic program. At most
+ * {@link max_pending} builds run at once, which keeps a dragged slider from flooding the driver with variants that are
+ * evicted before they are ever used.
+ *
+ * Usage:
+ *     GpuProgram* program = cache.get({{"ITERATIONS", "3"}});
+ *     if (program) { program->use(); ... } else { generic_program.use(); ... }
+ */
+class ShaderVariantCache {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  private:
+    /** A cached variant. */
+    struct Entry {
+        std::string key;                     // The definitions in the form of NAME=VALUE;...
+        std::unique_ptr<GpuProgram> program; // The program, possibly still being built.
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The maximum number of variants built at the same time. */
+    static constexpr int max_pending = 2;
+
+  private:
+    /** The shader files of every variant. */
+    std::vector<std::filesystem::path> files;
+    /** The maximum number of cached variants. */
+    size_t capacity;
+    /** The variants, the most recently used first. */
+    std::list<Entry> entries;
+    /** The variants by their keys. */
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    /** The number of variants built so far. */
+    int built_variants = 0;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Creates an empty cache.
+     *
+     * @param 	capacity	The maximum number of cached variants, the least recently used are released first.
+     */
+    explicit ShaderVariantCache(size_t capacity = 8) : capacity(capacity) {}
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** Releases all the variants and sets the shader files of the new ones (e.g., after the shaders are reloaded). */
+    void reset(const std::vector<std::filesystem::path>& new_files);
+
+    /**
+     * Returns the linked program of the definitions or starts building it.
+     *
+     * @param 	defines	The definitions, the same values in the same order select the same variant.
+     * @return	The program or nullptr if it is not ready yet or failed to link.
+     */
+    GpuProgram* get(const ShaderDefines& defines);
+
+    /** @return The number of cached variants. */
+    size_t size() const { return entries.size(); }
+
+    /** @return The number of variants that are still being built (polls their status). */
+    int get_pending_count();
+
+    /** @return The number of variants built since the last reset. */
+    int get_built_count() const { return built_variants; }
+};
@@ -0,0 +1,99 @@
+// ----------------------------------------------------------------------------
+// Analytic Visibility
+// ----------------------------------------------------------------------------
+// The analytic soft shadows and ambient occlusion shared by ray_tracing.frag and wavefront_ray_tracing.comp, included
+// after their scene buffers, uniforms, and ray intersections.
+
+// Checks whether the box is closer to the center than the radius.
+bool BoxBallIntersection(vec3 aabb_min, vec3 aabb_max, vec3 center, float radius) {
+	vec3 offset = clamp(center, aabb_min, aabb_max) - center;
+	return dot(offset, offset) <= radius * radius;
+}
+
+// Approximates the solid angle of the intersection of two spherical caps given by their angular radii and the angle
+// between their centers (Oat and Sander, "Ambient Aperture Lighting", 2007).
+float CapIntersection(float radius1, float radius2, float separation) {
+	float smaller = min(radius1, radius2);
+	float cap = 2.0 * PI * (1.0 - cos(smaller));
+	if (separation <= abs(radius1 - radius2)) return cap;  // One cap contains the other.
+	if (separation >= radius1 + radius2) return 0.0;        // The caps are disjoint.
+
+	float overlap = 1.0 - (separation - abs(radius1 - radius2)) / (radius1 + radius2 - abs(radius1 - radius2));
+	return smoothstep(0.0, 1.0, overlap) * cap;
+}
+
+// Returns the unoccluded fraction of a spherical light: every sphere in front of it covers a part of the cap of the
+// light, the parts are combined as if they were independent. No sampling, one loop over the occluders near the cone.
+float AnalyticVisibility(vec3 position, vec3 L, float distance_from_light) {
+	float light_angle = asin(min(sphere_light_radius / distance_from_light, 1.0));
+	float light_solid_angle = 2.0 * PI * (1.0 - cos(light_angle));
+	float visibility = 1.0;
+
+	// The cone towards the light is never wider than the light, so the boxes inflated by its radius are conservative.
+	Ray ray = Ray(position, L);
+	vec3 inv_direction = 1.0 / L;
+	int node_index = bvh_static_root;
+	while (node_index != -1 && node_index != bvh_static_end) {
+		BVHNode node = nodes[node_index];
+		if (!RayBoxIntersection(ray, inv_direction, node.aabb_min - sphere_light_radius, node.aabb_max + sphere_light_radius, distance_from_light)) {
+			node_index = node.miss_index;
+			continue;
+		}
+		if (node.spheres == 0) {
+			node_index++;
+			continue;
+		}
+
+		int first = node.spheres >> 4;
+		int count = node.spheres & 15;
+		for (int k = first; k < first + count; k++) {
+			vec4 sphere = spheres[sphere_indices[k]];
+			vec3 to_sphere = sphere.xyz - position;
+			float sphere_distance = length(to_sphere);
+			float along = dot(to_sphere, L);
+			if (sphere_distance <= sphere.w || along <= 0.0 || along - sphere.w > distance_from_light) continue;
+
+			float sphere_angle = asin(sphere.w / sphere_distance);
+			float separation = acos(clamp(along / sphere_distance, -1.0, 1.0));
+			visibility *= 1.0 - min(CapIntersection(light_angle, sphere_angle, separation) / light_solid_angle, 1.0);
+		}
+		node_index = node.miss_index;
+	}
+	return visibility;
+}
+
+// Returns the unoccluded fraction of the hemisphere: the ground plane covers the part below the horizon, every sphere
+// in range the solid angle of its cap clipped by the horizon.
+float AnalyticOcclusion(Hit hit) {
+	float visibility = acos(clamp(-hit.normal.y, -1.0, 1.0)) / PI;
+
+	vec3 position = hit.intersection;
+	int node_index = bvh_static_root;
+	while (node_index != -1 && node_index != bvh_static_end) {
+		BVHNode node = nodes[node_index];
+		if (!BoxBallIntersection(node.aabb_min, node.aabb_max, position, analytic_occlusion_range)) {
+			node_index = node.miss_index;
+			continue;
+		}
+		if (node.spheres == 0) {
+			node_index++;
+			continue;
+		}
+
+		int first = node.spheres >> 4;
+		int count = node.spheres & 15;
+		for (int k = first; k < first + count; k++) {
+			vec4 sphere = spheres[sphere_indices[k]];
+			vec3 to_sphere = sphere.xyz - position;
+			float sphere_distance = length(to_sphere);
+			if (sphere_distance <= sphere.w + 1e-2) continue; // The sphere the point lies on.
+
+			float sphere_angle = asin(min(sphere.w / sphere_distance, 1.0));
+			float elevation = asin(clamp(dot(hit.normal, to_sphere / sphere_distance), -1.0, 1.0));
+			float above_horizon = clamp((elevation + sphere_angle) / (2.0 * sphere_angle), 0.0, 1.0);
+			visibility *= 1.0 - (1.0 - cos(sphere_angle)) * above_horizon;
+		}
+		node_index = node.miss_index;
+	}
+	return visibility;
+}
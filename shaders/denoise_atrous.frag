@@ -0,0 +1,74 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec2 tex_coord;
+} in_data;
+
+// The visibility to filter (rgb = shadows, a = ambient occlusion).
+layout (binding = 0) uniform sampler2D input_visibility;
+// The guide of the frame (xyz = normal, w = distance to the primary hit, 0 if nothing was hit).
+layout (binding = 1) uniform sampler2D guide;
+
+// The size of the traced image (in texels).
+uniform vec2 resolution;
+// The distance between the taps of the kernel (in texels), it doubles with every pass.
+uniform int step_size = 1;
+
+// The exponent of the cosine between the normals, higher values keep the creases sharper.
+uniform float normal_phi = 64.0;
+// The relative difference of the distances (per step) at which the weight falls to 1/e.
+uniform float depth_phi = 0.03;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The filtered visibility.
+layout (location = 0) out vec4 filtered_visibility;
+
+// ----------------------------------------------------------------------------
+// Local Variables
+// ----------------------------------------------------------------------------
+// The B3-spline kernel of the a-trous wavelet transform.
+const float kernel[3] = float[3](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 center = texelFetch(input_visibility, pixel, 0);
+	vec4 center_guide = texelFetch(guide, pixel, 0);
+	if (center_guide.w <= 0.0) {
+		filtered_visibility = center;
+		return;
+	}
+
+	// The taps are weighted by the kernel and by the similarity of their surface to the surface of the center.
+	vec4 sum = vec4(0.0);
+	float weight_sum = 0.0;
+	float depth_scale = depth_phi * float(step_size) * center_guide.w;
+	for (int y = -2; y <= 2; y++) {
+		for (int x = -2; x <= 2; x++) {
+			ivec2 texel = pixel + ivec2(x, y) * step_size;
+			if (any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel, ivec2(resolution)))) continue;
+
+			vec4 tap_guide = texelFetch(guide, texel, 0);
+			if (tap_guide.w <= 0.0) continue;
+
+			float normal_weight = pow(max(dot(center_guide.xyz, tap_guide.xyz), 0.0), normal_phi);
+			float depth_weight = exp(-abs(center_guide.w - tap_guide.w) / depth_scale);
+			float weight = kernel[abs(x)] * kernel[abs(y)] * normal_weight * depth_weight;
+
+			sum += weight * texelFetch(input_visibility, texel, 0);
+			weight_sum += weight;
+		}
+	}
+
+	// The center always has the weight of the kernel, so the sum is never zero.
+	filtered_visibility = sum / weight_sum;
+}
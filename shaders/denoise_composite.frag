@@ -0,0 +1,35 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec2 tex_coord;
+} in_data;
+
+// The color traced without the direct light of the primary hits (the reflections and the visible lights).
+layout (binding = 0) uniform sampler2D color_texture;
+// The direct light of the primary hits without the shadows and the ambient occlusion.
+layout (binding = 1) uniform sampler2D unshadowed_texture;
+// The denoised visibility (rgb = shadows, a = ambient occlusion).
+layout (binding = 2) uniform sampler2D visibility_texture;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The final output color.
+layout (location = 0) out vec4 final_color;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec3 color = texelFetch(color_texture, pixel, 0).rgb;
+	vec3 unshadowed = texelFetch(unshadowed_texture, pixel, 0).rgb;
+	vec4 visibility = texelFetch(visibility_texture, pixel, 0);
+
+	final_color = vec4(color + unshadowed * visibility.rgb * visibility.a, 1.0);
+}
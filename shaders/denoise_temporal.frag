@@ -0,0 +1,152 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec2 tex_coord;
+} in_data;
+
+// The UBO with camera data.
+layout (std140, binding = 0) uniform CameraBuffer
+{
+	mat4 projection;	  // The projection matrix.
+	mat4 projection_inv;  // The inverse of the projection matrix.
+	mat4 view;			  // The view matrix
+	mat4 view_inv;		  // The inverse of the view matrix.
+	mat3 view_it;		  // The inverse of the transpose of the top-left part 3x3 of the view matrix
+	vec3 eye_position;	  // The position of the eye in world space.
+};
+
+// The structure holding the information about a single Phong light.
+struct PhongLight
+{
+	vec4 position;                   // The position of the light. Note that position.w should be one for point lights and spot lights, and zero for directional lights.
+	vec3 ambient;                    // The ambient part of the color of the light.
+	vec3 diffuse;                    // The diffuse part of the color of the light.
+	vec3 specular;                   // The specular part of the color of the light.
+	vec3 spot_direction;             // The direction of the spot light, irrelevant for point lights and directional lights.
+	float spot_exponent;             // The spot exponent of the spot light, irrelevant for point lights and directional lights.
+	float spot_cos_cutoff;           // The cosine of the spot light's cutoff angle, -1 point lights, irrelevant for directional lights.
+	float atten_constant;            // The constant attenuation of spot lights and point lights, irrelevant for directional lights. For no attenuation, set this to 1.
+	float atten_linear;              // The linear attenuation of spot lights and point lights, irrelevant for directional lights.  For no attenuation, set this to 0.
+	float atten_quadratic;           // The quadratic attenuation of spot lights and point lights, irrelevant for directional lights. For no attenuation, set this to 0.
+};
+
+// The UBO with light data.
+layout (std140, binding = 2) uniform PhongLightsBuffer
+{
+	vec3 global_ambient_color;		// The global ambient color.
+	int lights_count;				// The number of lights in the buffer.
+	PhongLight lights[3];			// The array with actual lights.
+};
+
+// The noisy visibility of the frame (rgb = shadows, a = ambient occlusion).
+layout (binding = 0) uniform sampler2D current_visibility;
+// The guide of the frame (xyz = normal, w = distance to the primary hit, 0 if nothing was hit).
+layout (binding = 1) uniform sampler2D current_guide;
+// The integrated visibility of the previous frame.
+layout (binding = 2) uniform sampler2D history_visibility;
+// The guide of the previous frame.
+layout (binding = 3) uniform sampler2D history_guide;
+// The number of frames integrated in the history.
+layout (binding = 4) uniform sampler2D history_length;
+
+// The size of the traced image (in texels).
+uniform vec2 resolution;
+// The flag determining if the history comes from the previous frame, false after a reset.
+uniform bool history_valid;
+// The projection matrix multiplied by the view matrix of the previous frame.
+uniform mat4 previous_view_projection;
+// The position of the eye in the previous frame.
+uniform vec3 previous_eye_position;
+// The positions of the lights in the previous frame.
+uniform vec3 previous_light_positions[3];
+// The radius of the light spheres.
+uniform float light_radius;
+
+// The minimum weight of the new samples, i.e., the history covers at most about 1 / min_alpha frames.
+uniform float min_alpha = 0.1;
+// The relative difference of the distances above which a texel of the history belongs to another surface.
+uniform float depth_tolerance = 0.05;
+// The cosine of the angle between the normals above which a texel of the history belongs to the same surface.
+uniform float normal_tolerance = 0.9;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The integrated visibility.
+layout (location = 0) out vec4 integrated_visibility;
+// The number of the integrated frames.
+layout (location = 1) out float integrated_length;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	vec4 current = texelFetch(current_visibility, pixel, 0);
+	vec4 guide = texelFetch(current_guide, pixel, 0);
+	if (!history_valid || guide.w <= 0.0) {
+		integrated_visibility = current;
+		integrated_length = guide.w <= 0.0 ? 0.0 : 1.0;
+		return;
+	}
+
+	// The same primary ray as ray_tracing.frag, the hit is at the stored distance along it.
+	vec2 uv = 2.0 * gl_FragCoord.xy / resolution - 1.0;
+	vec3 P = vec3(view_inv * projection_inv * vec4(uv, -1.0, 1.0));
+	vec3 position = eye_position + guide.w * normalize(P - eye_position);
+
+	// The scene is static, so the camera motion alone gives the position of the hit in the previous frame.
+	vec4 previous_clip = previous_view_projection * vec4(position, 1.0);
+	vec2 previous_texel = (previous_clip.xy / previous_clip.w * 0.5 + 0.5) * resolution - 0.5;
+	float expected_distance = distance(position, previous_eye_position);
+
+	// Bilinear reprojection, the texels of other surfaces are left out.
+	ivec2 base = ivec2(floor(previous_texel));
+	vec2 f = previous_texel - vec2(base);
+	vec4 history = vec4(0.0);
+	float length_sum = 0.0;
+	float weight_sum = 0.0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			ivec2 texel = base + ivec2(x, y);
+			if (previous_clip.w <= 0.0 || any(lessThan(texel, ivec2(0))) || any(greaterThanEqual(texel, ivec2(resolution)))) continue;
+
+			vec4 previous_guide = texelFetch(history_guide, texel, 0);
+			if (previous_guide.w <= 0.0 || abs(previous_guide.w - expected_distance) > depth_tolerance * expected_distance) continue;
+			if (dot(previous_guide.xyz, guide.xyz) < normal_tolerance) continue;
+
+			float weight = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+			history += weight * texelFetch(history_visibility, texel, 0);
+			length_sum += weight * texelFetch(history_length, texel, 0).r;
+			weight_sum += weight;
+		}
+	}
+	if (weight_sum < 1e-3) {
+		integrated_visibility = current;
+		integrated_length = 1.0;
+		return;
+	}
+	history /= weight_sum;
+	float frames = min(length_sum / weight_sum + 1.0, 1.0 / min_alpha);
+	float alpha = 1.0 / frames;
+
+	// A moving light shifts the shadows, the history is kept while the shift stays small compared to the penumbra,
+	// i.e., to the angular radius of the light.
+	float stable = 1.0;
+	for (int j = 0; j < lights_count; j++) {
+		vec3 to_light = lights[j].position.xyz - position;
+		vec3 to_previous_light = previous_light_positions[j] - position;
+		float angle = acos(clamp(dot(normalize(to_light), normalize(to_previous_light)), -1.0, 1.0));
+		float angular_radius = max(light_radius / length(to_light), 1e-3);
+		stable = min(stable, clamp(1.0 - angle / angular_radius, 0.0, 1.0));
+	}
+	float shadow_alpha = mix(1.0, alpha, stable);
+
+	integrated_visibility = vec4(mix(history.rgb, current.rgb, shadow_alpha), mix(history.a, current.a, alpha));
+	integrated_length = frames;
+}
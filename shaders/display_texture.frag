@@ -0,0 +1,32 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec2 tex_coord;
+} in_data;
+
+// The texture with the colors that should be displayed.
+layout (binding = 0) uniform sampler2D color_texture;
+// The texture with the depth of the displayed image (in the form of gl_FragDepth).
+layout (binding = 1) uniform sampler2D depth_texture;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The final output color.
+layout (location = 0) out vec4 final_color;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	// The textures have the same size as the window, so we can fetch the texels directly.
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+
+	gl_FragDepth = texelFetch(depth_texture, texel, 0).r;
+	final_color = vec4(texelFetch(color_texture, texel, 0).rgb, 1.0);
+}
@@ -0,0 +1,48 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+layout (location = 0) in vec3 position;  // The vertex position on the unit sphere (equal to its normal).
+layout (location = 1) in uint sphere_id; // The index of the sphere, fetched per instance from the list written by sphere_cull.comp.
+
+// The UBO with camera data.	
+layout (std140, binding = 0) uniform CameraBuffer
+{
+	mat4 projection;	  // The projection matrix.
+	mat4 projection_inv;  // The inverse of the projection matrix.
+	mat4 view;			  // The view matrix
+	mat4 view_inv;		  // The inverse of the view matrix.
+	mat3 view_it;		  // The inverse of the transpose of the top-left part 3x3 of the view matrix
+	vec3 eye_position;	  // The position of the eye in world space.
+};
+
+// The SSBO with the spheres in the scene.
+layout (std430, binding = 4) readonly buffer SphereBuffer
+{
+	vec4 spheres[]; // The spheres in the scene (xyz = center, w = radius).
+};
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+out VertexData
+{
+	vec3 position_ws;	  // The vertex position in world space.
+	vec3 normal_ws;		  // The vertex normal in world space.
+	flat uint sphere_id;  // The index of the sphere.
+} out_data;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	vec4 sphere = spheres[sphere_id];
+
+	out_data.position_ws = sphere.xyz + sphere.w * position;
+	out_data.normal_ws = position;
+	out_data.sphere_id = sphere_id;
+
+	gl_Position = projection * view * vec4(out_data.position_ws, 1.0);
+}
@@ -1,5 +1,23 @@
 #version 450 core
 
+// ----------------------------------------------------------------------------
+// Local Variables
+// ----------------------------------------------------------------------------
+// The texture coorinates for the vertices of the quad (a triangle strip).
+const vec2 quad_tex_coords[4] = vec2[4](
+	vec2(0.0, 1.0),
+	vec2(0.0, 0.0),
+	vec2(1.0, 1.0),
+	vec2(1.0, 0.0)
+);
+// The position offsets for the vertices of the quad.
+const vec4 quad_offsets[4] = vec4[4](
+	vec4(-0.5, +0.5, 0.0, 0.0),
+	vec4(-0.5, -0.5, 0.0, 0.0),
+	vec4(+0.5, +0.5, 0.0, 0.0),
+	vec4(+0.5, -0.5, 0.0, 0.0)
+);
+
 // ----------------------------------------------------------------------------
 // Input Variables
 // ----------------------------------------------------------------------------
@@ -38,24 +56,27 @@ layout (std140, binding = 2) uniform PhongLightsBuffer
 	PhongLight lights[3];			// The array with actual lights.
 };
 
-uniform float t_delta;	// The current time.
-uniform vec3 gravity = vec3(0.0, -9.81, 0.0);  // Gravity in the Y direction
-uniform float light_radius; // The radius of the light source
-
+// The velocity, the lifetime, the light and the color are functions of the index and the age of the particle (see
+// particle_simulate.comp), only the position and the remaining time are stored (16 bytes instead of 64).
 struct Particle {
-	vec4 position;	// The position of the particle.
-	vec3 velocity;	// The velocity of the particle.
-	int light_id;	// The id of the light that should be used for this particle.
-	vec3 color;		// The color of the particle.
-	float delay;	// The delay before the particle should start moving.
-	float lifetime; // The lifetime of the particle.
+	vec3 position;	// The position of the particle.
+	float delay;	// The time before the particle respawns, negative for a particle waiting for its first spawn.
 };
 
-layout (std430, binding = 3) buffer ParticleBuffer
+layout (std430, binding = 3) readonly buffer ParticleBuffer
 {
 	Particle particles[]; // The array with particles.
 };
 
+// The size of a particle in view space.
+uniform float particle_size_vs;
+
+// The indices of the visible particles, filled by particle_compact.comp.
+layout (std430, binding = 8) readonly buffer VisibleParticleBuffer
+{
+	uint visible_particles[];
+};
+
 // Function to generate a random number based on input (simple hash function)
 float random(float p)
 {
@@ -65,22 +86,13 @@ float random(float p)
     return fract(p);
 }
 
-vec3 random_direction(float min, float max)
-{
-    return vec3(
-        random(gl_VertexID + 1) * (max - min) + min, // X component
-        random(gl_VertexID + 2) * (max - min) + min, // Y component
-        random(gl_VertexID + 3) * (max - min) + min  // Z component
-    );
-}
-
 // ----------------------------------------------------------------------------
 // Output Variables
 // ----------------------------------------------------------------------------
 out VertexData
 {
 	vec3 color;	       // The particle color.
-	vec4 position_vs;  // The particle position in view space.
+	vec2 tex_coord;    // The texture coordinates for the particle.
 	float lifetime;    // The lifetime of the particle.
 	float delay;	   // The delay of the particle.
 } out_data;
@@ -91,36 +103,19 @@ out VertexData
 // ----------------------------------------------------------------------------
 void main()
 {
-	Particle particle = particles[gl_VertexID];
-
-	vec4 light_position = lights[particle.light_id].position;
-	vec3 color = lights[particle.light_id].diffuse;
-
-    if(particle.delay < 0 || particle.position.w == 0.0f || particle.position.y < 0){
-	    particle.light_id = int(mod(float(gl_VertexID), float(lights_count))); // evenly distribute based on lights_count
-
-		vec3 rand_dir = random_direction(-1,1);
-		rand_dir = normalize(rand_dir);
-		particle.position = vec4(light_position.xyz + rand_dir * light_radius, 1);
-
-		particle.velocity = rand_dir * 1.5;
-		particle.lifetime = random(gl_VertexID);
-		particle.delay = particle.lifetime;
-		particle.color = color;
-	}
-
-	particle.delay -= t_delta;
-
-	// Update the particle's position based on its velocity
-	particle.position += vec4(particle.velocity, 0) * t_delta + 0.5f * vec4(gravity, 0) * t_delta * t_delta;
-	particle.velocity += gravity * t_delta;
-
-    // Set the particle's position back into the buffer
-    particles[gl_VertexID] = particle;
-
-    // Output gl_Position for the current particle
-	out_data.color = particle.color;
-    out_data.position_vs = view * particle.position;
-	out_data.lifetime = particle.lifetime;
+	// Every visible particle is an instance of a quad, the vertices pull the particle from the buffer themselves
+	// instead of being expanded from a point by a geometry shader.
+	int id = int(visible_particles[gl_InstanceID]);
+	Particle particle = particles[id];
+
+	// The color and the lifetime are derived as in particle_simulate.comp.
+	float lifetime = random(id);
+	out_data.color = lights[id % lights_count].diffuse;
+	out_data.tex_coord = quad_tex_coords[gl_VertexID];
+	out_data.lifetime = lifetime;
 	out_data.delay = particle.delay;
+
+	// The quad is scaled by the fading factor in view space, so it always faces the camera.
+	vec4 position_vs = view * vec4(particle.position, 1.0);
+	gl_Position = projection * (position_vs + particle_size_vs * quad_offsets[gl_VertexID] * (particle.delay / lifetime));
 }
\ No newline at end of file
@@ -50,43 +50,177 @@ struct PBRMaterialData
    vec3 f0;          // The Fresnel reflection at 0.
 };
 
-// The UBO with Model and Material Data
-layout (std140, binding = 3) uniform ModelBuffer
+// The SSBO with the spheres in the scene, the static spheres are followed by the light spheres.
+layout (std430, binding = 4) readonly buffer SphereBuffer
 {
-	vec4 spheres[13]; // The spheres in the scene.
-	PBRMaterialData materials[13]; // The materials of the spheres.
+	vec4 spheres[]; // The spheres in the scene (xyz = center, w = radius).
 };
 
+// The SSBO with the materials of the spheres.
+layout (std430, binding = 5) readonly buffer MaterialBuffer
+{
+	PBRMaterialData materials[]; // The materials of the spheres.
+};
+
+// A node of the bounding volume hierarchy over the spheres, see sphere_bvh.hpp.
+struct BVHNode
+{
+	vec3 aabb_min;  // The minimum corner of the bounding box.
+	int miss_index; // The node to continue with when the box is missed (or after a leaf), -1 ends the traversal.
+	vec3 aabb_max;  // The maximum corner of the bounding box.
+	int spheres;    // (first << 4) | count for leaves (the range in the sphere index buffer), 0 for inner nodes.
+};
+
+// The SSBO with the nodes of the hierarchy in depth-first order.
+layout (std430, binding = 6) readonly buffer BVHBuffer
+{
+	BVHNode nodes[];
+};
+
+// The SSBO with the indices of the spheres referenced by the leaves.
+layout (std430, binding = 7) readonly buffer SphereIndexBuffer
+{
+	int sphere_indices[];
+};
+
+// The settings marked by #ifdef are either uniforms or, in the variants built by the ShaderVariantCache, constants
+// defined at compile time, so the compiler can unroll the loops and remove the disabled branches.
+
 // The resolution of the screen.
 uniform vec2 resolution;
 
-// The number of spheres to render.
-uniform int spheres_count;
+// The number of static spheres, the spheres after them are lights.
+#ifdef STATIC_SPHERES_COUNT
+const int static_spheres_count = STATIC_SPHERES_COUNT;
+#else
+uniform int static_spheres_count;
+#endif
+
+// The root of the subtree with the static spheres.
+uniform int bvh_static_root;
+
+// The first node after the static subtree (-1 if there are no lights).
+uniform int bvh_static_end;
 
 // The number of iterations.
+#ifdef ITERATIONS
+const int iterations = ITERATIONS;
+#else
 uniform int iterations;
+#endif
 
 // The light sphere radius
 uniform float sphere_light_radius;
 
 // The number of shadow samples.
+#ifdef SHADOW_SAMPLES
+const int shadow_samples = SHADOW_SAMPLES;
+#else
 uniform int shadow_samples;
+#endif
 
 // Time variable
 uniform float time;
 
 // Use ambient occlusion
+#ifdef USE_AMBIENT_OCCLUSION
+const bool use_ambient_occlusion = USE_AMBIENT_OCCLUSION;
+#else
 uniform bool use_ambient_occlusion;
+#endif
 
 // Ambient occlusion samples
+#ifdef AMBIENT_OCCLUSION_SAMPLES
+const int ambient_occlusion_samples = AMBIENT_OCCLUSION_SAMPLES;
+#else
 uniform int ambient_occlusion_samples;
+#endif
+
+// The index of the first shadow sample, frames accumulated progressively continue where the previous ones ended.
+uniform int shadow_sample_offset = 0;
+
+// The index of the first ambient occlusion sample.
+uniform int ambient_occlusion_sample_offset = 0;
+
+// The Owen-scrambled Sobol sequences, one row per sampled dimension (0 = ambient occlusion, 1 + j = shadows of the light j).
+layout (binding = 2) uniform sampler2D sample_sequences;
+
+// The blue noise rotating the sequences per pixel.
+layout (binding = 3) uniform sampler2D blue_noise;
+
+// The flag determining if the sequences should be used instead of the hash-based random numbers.
+#ifdef USE_SAMPLE_SEQUENCES
+const bool use_sample_sequences = USE_SAMPLE_SEQUENCES;
+#else
+uniform bool use_sample_sequences = false;
+#endif
+
+// The frame the rotations are offset by, it only changes when the accumulation restarts so the samples stay stratified.
+uniform int sample_frame = 0;
+
+// The flag determining if the soft shadows and the ambient occlusion should be evaluated analytically instead of sampled.
+#ifdef USE_ANALYTIC_VISIBILITY
+const bool use_analytic_visibility = USE_ANALYTIC_VISIBILITY;
+#else
+uniform bool use_analytic_visibility = false;
+#endif
+
+// The distance up to which the spheres contribute to the analytic and the cached ambient occlusion.
+uniform float analytic_occlusion_range = 8.0;
+
+// The flag determining if the ambient occlusion of the static geometry should be read from the baked cache.
+uniform bool use_ambient_occlusion_cache = false;
+
+// The baked ambient occlusion of the static spheres, an octahedral tile per sphere (r = unoccluded fraction, g = baked).
+layout (binding = 5) uniform sampler2D ambient_occlusion_atlas;
+
+// The baked ambient occlusion of the ground plane over [-40, 40] in x and z (r = unoccluded fraction, g = baked).
+layout (binding = 6) uniform sampler2D ambient_occlusion_ground;
+
+// The number of spheres with a tile in the atlas, see AmbientOcclusionCache.
+uniform int ambient_occlusion_cache_capacity = 0;
+
+// The number of tiles in a row of the atlas.
+uniform int ambient_occlusion_tiles_per_row = 64;
+
+// The flag determining if the primary hits should be read from the visibility buffer instead of traced.
+#ifdef USE_VISIBILITY_BUFFER
+const bool use_visibility_buffer = USE_VISIBILITY_BUFFER;
+#else
+uniform bool use_visibility_buffer = false;
+#endif
+
+// The sphere visible in every pixel, written by the impostors of sphere_visibility.frag.
+layout (binding = 4) uniform usampler2D visibility_buffer;
+
+// The value of the visibility buffer where no sphere is visible.
+const uint no_sphere = 0xFFFFFFFFu;
+
+// The flag determining if the guide of the denoiser should be written.
+#ifdef USE_DENOISER
+const bool use_denoiser = USE_DENOISER;
+#else
+uniform bool use_denoiser = false;
+#endif
+
+// The flag determining if the direct light of the primary hits should be written apart from its visibility, so the
+// accumulation averages the shadows and the ambient occlusion separately and the denoiser filters them.
+uniform bool use_split_visibility = false;
 
 // ----------------------------------------------------------------------------
 // Output Variables
 // ----------------------------------------------------------------------------
-// The final output color.
+// The final output color, without the direct light of the primary hit if the visibility is split.
 layout (location = 0) out vec4 final_color;
 
+// The outputs of the split visibility, see denoiser.hpp.
+// The direct light of the primary hit without the shadows and the ambient occlusion.
+layout (location = 1) out vec4 denoise_unshadowed;
+// The visibility of the direct light of the primary hit (rgb = the shadowed fraction per channel, a = ambient occlusion).
+layout (location = 2) out vec4 denoise_visibility;
+// The guide of the filter (xyz = normal, w = distance to the primary hit, 0 if nothing was hit).
+layout (location = 3) out vec4 denoise_guide;
+
 // ----------------------------------------------------------------------------
 // Ray Tracing Structures
 // ----------------------------------------------------------------------------
@@ -102,8 +236,9 @@ struct Hit {
     vec3 normal;              // The surface normal at the interesection point.
 	PBRMaterialData material; // The material of the object at the intersection point.
 	bool isLight;             // The flag determining whether the object is a light source.
+	int sphere;               // The index of the sphere, -1 for the ground plane (and a miss).
 };
-const Hit miss = Hit(1e20, vec3(0.0), vec3(0.0), PBRMaterialData(vec3(0),0,vec3(0)), false);
+const Hit miss = Hit(1e20, vec3(0.0), vec3(0.0), PBRMaterialData(vec3(0),0,vec3(0)), false, -1);
 
 const float PI = 3.14159265359;
 
@@ -137,7 +272,7 @@ Hit RaySphereIntersection(Ray ray, vec3 center, float radius, int i, bool isLigh
 
 	vec3 intersection = ray.origin + t * ray.direction;
 	vec3 normal = normalize(intersection - center);
-    return Hit(t, intersection, normal, materials[i], isLight);
+    return Hit(t, intersection, normal, materials[i], isLight, i);
 }
 
 // Computes an intersection between a ray and a plane defined by its normal and one point inside the plane.
@@ -154,58 +289,153 @@ Hit RayPlaneIntersection(Ray ray, vec3 normal, vec3 point) {
 
 	if(intersection.x > 40 || intersection.x < -40 || intersection.z > 40 || intersection.z < -40) return miss;
 
-    return Hit(t, intersection, normal, materials[0], false);
+    return Hit(t, intersection, normal, materials[0], false, -1);
+}
+
+// Computes the distance to the intersection between a ray and a sphere, 1e20 if there is none.
+float RaySphereDistance(Ray ray, vec4 sphere) {
+	vec3 oc = ray.origin - sphere.xyz;
+	float b = dot(ray.direction, oc);
+	float c = dot(oc, oc) - (sphere.w*sphere.w);
+
+	float det = b*b - c;
+	if (det < 0.0) return 1e20;
+
+	float t = -b - sqrt(det);
+	if (t < 0.0) t = -b + sqrt(det);
+	return t < 0.0 ? 1e20 : t;
+}
+
+// Checks whether the ray hits the box closer than max_t.
+bool RayBoxIntersection(Ray ray, vec3 inv_direction, vec3 aabb_min, vec3 aabb_max, float max_t) {
+	vec3 t0 = (aabb_min - ray.origin) * inv_direction;
+	vec3 t1 = (aabb_max - ray.origin) * inv_direction;
+	vec3 t_near = min(t0, t1);
+	vec3 t_far = max(t0, t1);
+	float t_enter = max(max(t_near.x, t_near.y), max(t_near.z, 0.0));
+	float t_exit = min(min(t_far.x, t_far.y), min(t_far.z, max_t));
+	return t_enter <= t_exit;
 }
 
 // Evaluates the intersections of the ray with the scene objects and returns the closes hit.
 Hit Evaluate(Ray ray){
 	// Sets the closes hit either to miss or to an intersection with the plane representing the ground.
 	Hit closest_hit = RayPlaneIntersection(ray, vec3(0, 1, 0), vec3(0));
-	
-	for(int i = 0; i < spheres_count; i++){
-		vec3 center = spheres[i].xyz;
+	float closest_t = closest_hit.t;
+	int closest_sphere = -1;
+
+	// Stackless traversal of the whole hierarchy, the boxes farther than the closest hit are skipped.
+	vec3 inv_direction = 1.0 / ray.direction;
+	int node_index = 0;
+	while (node_index != -1) {
+		BVHNode node = nodes[node_index];
+		if (!RayBoxIntersection(ray, inv_direction, node.aabb_min, node.aabb_max, closest_t)) {
+			node_index = node.miss_index;
+			continue;
+		}
+		if (node.spheres == 0) {
+			node_index++; // The first child follows its parent.
+			continue;
+		}
 
-		if (spheres[i].w == 0) break; // Fix artifacts on hitting 0 radius light spheres
+		int first = node.spheres >> 4;
+		int count = node.spheres & 15;
+		for (int k = first; k < first + count; k++) {
+			int i = sphere_indices[k];
+			if (spheres[i].w == 0) continue; // Fix artifacts on hitting 0 radius light spheres
 
-		Hit intersection = RaySphereIntersection(ray, center, spheres[i].w, i, i >= 10);
-		if(intersection.t < closest_hit.t){
-			closest_hit = intersection;
+			float t = RaySphereDistance(ray, spheres[i]);
+			if (t < closest_t) {
+				closest_t = t;
+				closest_sphere = i;
+			}
 		}
+		node_index = node.miss_index;
 	}
 
+	if (closest_sphere >= 0) {
+		int i = closest_sphere;
+		closest_hit = RaySphereIntersection(ray, spheres[i].xyz, spheres[i].w, i, i >= static_spheres_count);
+	}
     return closest_hit;
 }
 
-// Evaluates the intersections of the ray with the scene objects and returns the closes hit excluding light sources.
-Hit EvaluateExcludeLight(Ray ray){
-	// Sets the closes hit either to miss or to an intersection with the plane representing the ground.
-	Hit closest_hit = RayPlaneIntersection(ray, vec3(0, 1, 0), vec3(0));
-	
-	for(int i = 0; i < spheres_count - lights_count; i++){
-		vec3 center = spheres[i].xyz;
+// Returns the primary hit of the pixel: the sphere stored in the visibility buffer or the ground plane in front of it.
+// The rasterization already resolved the visibility, so only one sphere is intersected instead of traversing the BVH.
+Hit VisibleHit(Ray ray) {
+	Hit hit = RayPlaneIntersection(ray, vec3(0, 1, 0), vec3(0));
+	uint i = texelFetch(visibility_buffer, ivec2(gl_FragCoord.xy), 0).r;
+	if (i != no_sphere) {
+		Hit sphere_hit = RaySphereIntersection(ray, spheres[i].xyz, spheres[i].w, int(i), int(i) >= static_spheres_count);
+		if (sphere_hit.t < hit.t) hit = sphere_hit;
+	}
+	return hit;
+}
 
-		Hit intersection = RaySphereIntersection(ray, center, spheres[i].w, i, i >= 10);
-		if(intersection.t < closest_hit.t){
-			closest_hit = intersection;
+// Checks whether the ray hits any object closer than max_t, light sources are excluded.
+bool Occluded(Ray ray, float max_t){
+	if (RayPlaneIntersection(ray, vec3(0, 1, 0), vec3(0)).t < max_t) return true;
+
+	// Traverses only the static subtree and stops at the first hit.
+	vec3 inv_direction = 1.0 / ray.direction;
+	int node_index = bvh_static_root;
+	while (node_index != -1 && node_index != bvh_static_end) {
+		BVHNode node = nodes[node_index];
+		if (!RayBoxIntersection(ray, inv_direction, node.aabb_min, node.aabb_max, max_t)) {
+			node_index = node.miss_index;
+			continue;
+		}
+		if (node.spheres == 0) {
+			node_index++;
+			continue;
 		}
-	}
 
-    return closest_hit;
+		int first = node.spheres >> 4;
+		int count = node.spheres & 15;
+		for (int k = first; k < first + count; k++) {
+			if (RaySphereDistance(ray, spheres[sphere_indices[k]]) < max_t) return true;
+		}
+		node_index = node.miss_index;
+	}
+    return false;
 }
 
+#include "analytic_visibility.glsl"
+
 float random(vec2 p) {
 	return fract(sin(dot(p, vec2(12.9898, 78.233))) * 43758.5453); // From ShaderToy (https://www.shadertoy.com/view/4djSRW)
 }
 
-float SphereOcclusion(Hit hit) {
+// Returns the point of the sequence of the dimension, rotated by the blue noise of the pixel (Cranley-Patterson rotation).
+vec2 SequenceSample(int index, int dimension, vec2 frag_coord, int bounce) {
+	vec2 point = texelFetch(sample_sequences, ivec2(index % textureSize(sample_sequences, 0).x, dimension), 0).rg;
+
+	// The dimensions and the bounces read the noise with different offsets, so their rotations are independent.
+	ivec2 texel = (ivec2(frag_coord) + ivec2(17, 41) * dimension + ivec2(29, 7) * bounce) % textureSize(blue_noise, 0);
+	vec2 rotation = texelFetch(blue_noise, texel, 0).rg;
+
+	// The R2 sequence shifts the rotations of consecutive frames by well distributed amounts.
+	rotation = fract(rotation + float(sample_frame % 4096) * vec2(0.7548776662, 0.5698402910));
+	return fract(point + rotation);
+}
+
+float SphereOcclusion(Hit hit, vec2 frag_coord, int bounce) {
     float occlusion = 0.0;
 	float epsilon = 1e-2;
 
     // Randomly distribute rays in a hemisphere above the hit point
     for (int i = 0; i < ambient_occlusion_samples; ++i) {
         // Generate a random point in a hemisphere using spherical coordinates
-        float phi = random(vec2(hit.intersection.x, hit.intersection.y + float(i))) * 2.0 * PI;
-        float theta = random(vec2(hit.intersection.y, hit.intersection.z + float(i))) * 0.5 * PI;
+        float sample_index = float(i + ambient_occlusion_sample_offset);
+        float phi, theta;
+        if (use_sample_sequences) {
+            vec2 u = SequenceSample(i + ambient_occlusion_sample_offset, 0, frag_coord, bounce);
+            phi = u.x * 2.0 * PI;
+            theta = u.y * 0.5 * PI;
+        } else {
+            phi = random(vec2(hit.intersection.x, hit.intersection.y + sample_index)) * 2.0 * PI;
+            theta = random(vec2(hit.intersection.y, hit.intersection.z + sample_index)) * 0.5 * PI;
+        }
 
         // Convert spherical coordinates to Cartesian coordinates
         vec3 sample_direction = vec3(
@@ -217,11 +447,9 @@ float SphereOcclusion(Hit hit) {
         // Direction of the ray to test occlusion
         Ray sample_ray = Ray(hit.intersection + epsilon * hit.normal, sample_direction);  // Slightly offset from surface
 
-        // Evaluate if the ray hits any objects in the scene (excluding light sources)
-        Hit occlusion_hit = EvaluateExcludeLight(sample_ray);
-
-        // If the ray intersects another object, increase occlusion
-        if (occlusion_hit != miss) {
+        // If the ray intersects another object in the scene (excluding light sources), increase occlusion. With the cache,
+        // the rays end at the range of the baked tiles, so the sampled and the cached surfaces match.
+        if (Occluded(sample_ray, use_ambient_occlusion_cache ? analytic_occlusion_range : 1e20)) {
             occlusion += 1.0;
         }
     }
@@ -230,15 +458,52 @@ float SphereOcclusion(Hit hit) {
     return 1.0 - (occlusion / ambient_occlusion_samples);
 }
 
-vec3 Trace(Ray ray) {
+// Returns the point of the octahedral map in [-1, 1]^2 of the direction.
+vec2 OctahedralEncode(vec3 n) {
+	vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+	if (n.z < 0.0) p = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+	return p;
+}
+
+// Reads the ambient occlusion of the hit from the baked cache, returns false if the point is not cached (yet).
+bool CachedOcclusion(Hit hit, out float ao) {
+	ao = 1.0;
+	if (!use_ambient_occlusion_cache) return false;
+
+	vec4 cached;
+	if (hit.sphere == -1) {
+		cached = textureLod(ambient_occlusion_ground, hit.intersection.xz / 80.0 + 0.5, 0.0);
+	} else {
+		if (hit.sphere >= ambient_occlusion_cache_capacity || hit.sphere >= static_spheres_count) return false;
+
+		// The texels stay inside the tile, so the filtering never mixes in the neighboring spheres.
+		const float tile_size = 16.0;
+		vec2 tile = vec2(hit.sphere % ambient_occlusion_tiles_per_row, hit.sphere / ambient_occlusion_tiles_per_row) * tile_size;
+		vec2 local = clamp((OctahedralEncode(hit.normal) * 0.5 + 0.5) * tile_size, vec2(0.5), vec2(tile_size - 0.5));
+		cached = textureLod(ambient_occlusion_atlas, (tile + local) / vec2(textureSize(ambient_occlusion_atlas, 0)), 0.0);
+	}
+
+	// A partially baked footprint (e.g., a tile invalidated by a moved sphere) falls back to the estimators.
+	if (cached.g < 0.999) return false;
+	ao = cached.r;
+	return true;
+}
+
+// Traces the ray and its reflections, the first hit is given by the caller. If the visibility is split, the direct light
+// of the first hit is returned in unshadowed and visibility instead of being added to the color.
+vec3 Trace(Ray ray, Hit first_hit, out vec3 unshadowed, out vec4 visibility) {
 
 	vec3 color = vec3(0.0);
 	vec3 attenuation = vec3(1.0);
 	float epsilon = 1e-2;
 
+	unshadowed = vec3(0.0);
+	visibility = vec4(1.0);
+	vec3 shadowed = vec3(0.0);
+
 	for (int i = 0; i < iterations; ++i) {
-		Hit hit = Evaluate(ray);
-		if (hit == miss) return color;
+		Hit hit = i == 0 ? first_hit : Evaluate(ray);
+		if (hit == miss) break;
 
 		vec3 V = -ray.direction;
 		vec3 fresnel = FresnelSchlick(hit.material.f0, V, hit.normal);
@@ -249,8 +514,8 @@ vec3 Trace(Ray ray) {
 		}
 
 		float ao = 1.0;
-		if (use_ambient_occlusion) {
-			ao = SphereOcclusion(hit);
+		if (use_ambient_occlusion && !CachedOcclusion(hit, ao)) {
+			ao = use_analytic_visibility ? AnalyticOcclusion(hit) : SphereOcclusion(hit, gl_FragCoord.xy, i);
 		}
 
 		for (int j = 0; j < lights_count; j++) {
@@ -266,26 +531,49 @@ vec3 Trace(Ray ray) {
 			float radius = sphere_light_radius / distance_from_light;
 			float atten_factor = 1.0 / (1 + 0.5 * distance_from_light);
             
-			vec3 color_t = vec3(0.0);
-
-			for (int k = 0; k < shadow_samples; k++) {
-				float v = float(k+1)*.152;
-				float random_value = random(vec2(gl_FragCoord.x, gl_FragCoord.y + j) * v);
-				float random_angle = 2 * PI * random_value;
-				float random_radius = radius * sqrt(random_value);
-
-				vec2 point_on_disk = vec2(cos(random_angle), sin(random_angle)) * random_radius;
-
-				vec3 shadow_ray_direction = L + point_on_disk.x * T + point_on_disk.y * B;
-
-				Ray shadow_ray = Ray(hit.intersection + epsilon * L, shadow_ray_direction);
-				Hit shadow_hit = EvaluateExcludeLight(shadow_ray);
-				if (shadow_hit == miss || shadow_hit.t >= distance_from_light) {
-					color_t += max(dot(hit.normal, L), 0.0) * lights[j].diffuse * hit.material.diffuse * (1.0 - fresnel) * atten_factor * attenuation * ao; 
+			vec3 light = max(dot(hit.normal, L), 0.0) * lights[j].diffuse * hit.material.diffuse * (1.0 - fresnel) * atten_factor * attenuation;
+			float light_visibility = 0.0;
+			if (use_analytic_visibility) {
+				light_visibility = AnalyticVisibility(hit.intersection + epsilon * L, L, distance_from_light);
+			} else {
+				for (int k = 0; k < shadow_samples; k++) {
+					float random_angle, random_radius;
+					if (use_sample_sequences) {
+						// Two independent coordinates, the hash below uses one value for both and places the samples on a spiral.
+						vec2 u = SequenceSample(k + shadow_sample_offset, 1 + j, gl_FragCoord.xy, i);
+						random_angle = 2 * PI * u.x;
+						random_radius = radius * sqrt(u.y);
+					} else {
+						float v = float(k + shadow_sample_offset + 1)*.152;
+						float random_value = random(vec2(gl_FragCoord.x, gl_FragCoord.y + j) * v);
+						random_angle = 2 * PI * random_value;
+						random_radius = radius * sqrt(random_value);
+					}
+
+					vec2 point_on_disk = vec2(cos(random_angle), sin(random_angle)) * random_radius;
+
+					// Normalized, the intersection distances are compared with the distance to the light.
+					vec3 shadow_ray_direction = normalize(L + point_on_disk.x * T + point_on_disk.y * B);
+
+					Ray shadow_ray = Ray(hit.intersection + epsilon * L, shadow_ray_direction);
+					if (!Occluded(shadow_ray, distance_from_light)) {
+						light_visibility += 1.0;
+					}
 				}
+				light_visibility /= shadow_samples;
 			}
 
-			color += color_t / shadow_samples;
+			if (use_split_visibility && i == 0) {
+				unshadowed += light;
+				shadowed += light * light_visibility;
+			} else {
+				color += light * ao * light_visibility;
+			}
+		}
+
+		if (use_split_visibility && i == 0) {
+			// The shadowed fraction per channel, the lights have different colors.
+			visibility = vec4(mix(vec3(1.0), shadowed / max(unshadowed, vec3(1e-6)), greaterThan(unshadowed, vec3(1e-6))), ao);
 		}
 
 		attenuation *= hit.material.diffuse * fresnel;
@@ -298,11 +586,6 @@ vec3 Trace(Ray ray) {
 	return color;
 }
 
-float TraceDepth(Ray ray) {
-	Hit hit = Evaluate(ray);
-	return hit.t;
-}
-
 // ----------------------------------------------------------------------------
 // Main Method
 // ----------------------------------------------------------------------------
@@ -316,16 +599,33 @@ void main()
 	vec3 direction = normalize(P - eye_position);
 	Ray ray = Ray(eye_position, direction);
 
-	// We pass the ray to the trace function.
-	vec3 color = Trace(ray);
-
-	// Calculate depth based on the real_distance using the equation
-    float near = 1.0;
-    float far = 1000.0;
-	float real_distance = TraceDepth(ray);
-    float depth = (1.0 / real_distance - 1.0 / near) / (1.0 / far - 1.0 / near);
+	// The primary hit is found once and used for both the color and the depth.
+	Hit primary_hit = use_visibility_buffer ? VisibleHit(ray) : Evaluate(ray);
+	vec3 unshadowed;
+	vec4 visibility;
+	vec3 color = Trace(ray, primary_hit, unshadowed, visibility);
+
+	float depth;
+	if (use_visibility_buffer) {
+		// The same depth as the rasterized impostors, so the particles are tested against the exact surface.
+		vec4 clip = projection * view * vec4(primary_hit.intersection, 1.0);
+		depth = primary_hit == miss ? 1.0 : 0.5 * clip.z / clip.w + 0.5;
+	} else {
+		// Calculate depth based on the real_distance using the equation
+		float near = 1.0;
+		float far = 1000.0;
+		float real_distance = primary_hit.t;
+		depth = (1.0 / real_distance - 1.0 / near) / (1.0 / far - 1.0 / near);
+	}
 
     // Set the fragment depth
     gl_FragDepth = depth;
 	final_color = vec4(color, 1.0);
+	if (use_split_visibility) {
+		denoise_unshadowed = vec4(unshadowed, 1.0);
+		denoise_visibility = visibility;
+	}
+	if (use_denoiser) {
+		denoise_guide = primary_hit == miss ? vec4(0.0) : vec4(primary_hit.normal, primary_hit.t);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+layout (location = 0) in vec3 position;  // The corner of the impostor quad (xy in [-1, 1]).
+layout (location = 1) in uint sphere_id; // The index of the sphere, fetched per instance from the list written by sphere_cull.comp.
+
+// The UBO with camera data.	
+layout (std140, binding = 0) uniform CameraBuffer
+{
+	mat4 projection;	  // The projection matrix.
+	mat4 projection_inv;  // The inverse of the projection matrix.
+	mat4 view;			  // The view matrix
+	mat4 view_inv;		  // The inverse of the view matrix.
+	mat3 view_it;		  // The inverse of the transpose of the top-left part 3x3 of the view matrix
+	vec3 eye_position;	  // The position of the eye in world space.
+};
+
+// The SSBO with the spheres in the scene.
+layout (std430, binding = 4) readonly buffer SphereBuffer
+{
+	vec4 spheres[]; // The spheres in the scene (xyz = center, w = radius).
+};
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+out VertexData
+{
+	vec3 position_ws;	  // The position on the quad in world space, the ray from the eye through it is intersected with the sphere.
+	flat uint sphere_id;  // The index of the sphere.
+} out_data;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	vec4 sphere = spheres[sphere_id];
+	out_data.sphere_id = sphere_id;
+
+	vec3 axis = sphere.xyz - eye_position;
+	float distance = length(axis);
+
+	// The eye is inside the sphere, the quad covers the whole screen at the near plane.
+	if (distance <= sphere.w * 1.001)
+	{
+		vec4 near_point = view_inv * projection_inv * vec4(position.xy, -1.0, 1.0);
+		out_data.position_ws = near_point.xyz / near_point.w;
+		gl_Position = vec4(position.xy, -1.0, 1.0);
+		return;
+	}
+
+	// The quad is perpendicular to the axis of the cone tangent to the sphere and covers the circle where the cone
+	// intersects its plane through the center.
+	vec3 direction = axis / distance;
+	vec3 up = abs(direction.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+	vec3 right = normalize(cross(direction, up));
+	up = cross(right, direction);
+	float cone_radius = sphere.w * distance / sqrt(distance * distance - sphere.w * sphere.w);
+	vec3 corner = sphere.xyz + cone_radius * (position.x * right + position.y * up);
+
+	// Moves the quad along the rays from the eye to the front of the sphere, so it covers the same pixels and every
+	// fragment lies in front of the surface it represents (see depth_greater in sphere_visibility.frag).
+	out_data.position_ws = eye_position + (corner - eye_position) * ((distance - sphere.w) / distance);
+	gl_Position = projection * view * vec4(out_data.position_ws, 1.0);
+}
@@ -0,0 +1,58 @@
+#version 450 core
+
+//----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec3 position_ws;	  // The position on the quad in world space.
+	flat uint sphere_id;  // The index of the sphere.
+} in_data;
+
+// The UBO with camera data.	
+layout (std140, binding = 0) uniform CameraBuffer
+{
+	mat4 projection;	  // The projection matrix.
+	mat4 projection_inv;  // The inverse of the projection matrix.
+	mat4 view;			  // The view matrix
+	mat4 view_inv;		  // The inverse of the view matrix.
+	mat3 view_it;		  // The inverse of the transpose of the top-left part 3x3 of the view matrix
+	vec3 eye_position;	  // The position of the eye in world space.
+};
+
+// The SSBO with the spheres in the scene.
+layout (std430, binding = 4) readonly buffer SphereBuffer
+{
+	vec4 spheres[]; // The spheres in the scene (xyz = center, w = radius).
+};
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The quads lie in front of their spheres, so the depth only grows and the early depth test stays enabled.
+layout (depth_greater) out float gl_FragDepth;
+
+// The index of the visible sphere, the normal and the position follow from it and the ray of the pixel.
+layout (location = 0) out uint visible_sphere;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	vec4 sphere = spheres[in_data.sphere_id];
+	vec3 direction = normalize(in_data.position_ws - eye_position);
+
+	// Intersects the ray of the pixel with the sphere, the corners of the quad miss it.
+	vec3 oc = eye_position - sphere.xyz;
+	float b = dot(direction, oc);
+	float det = b * b - (dot(oc, oc) - sphere.w * sphere.w);
+	if (det < 0.0) discard;
+
+	float t = -b - sqrt(det);
+	if (t < 0.0) t = -b + sqrt(det); // The eye is inside the sphere.
+
+	vec4 clip = projection * view * vec4(eye_position + t * direction, 1.0);
+	gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+	visible_sphere = in_data.sphere_id;
+}
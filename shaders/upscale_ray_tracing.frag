@@ -0,0 +1,97 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec2 tex_coord;
+} in_data;
+
+// The texture with the ray traced colors, only the bottom-left source_size texels are used.
+layout (binding = 0) uniform sampler2D color_texture;
+// The texture with the ray traced depth (in the form of gl_FragDepth).
+layout (binding = 1) uniform sampler2D depth_texture;
+// The direct light of the primary hits without the shadows and the ambient occlusion, see use_split_visibility.
+layout (binding = 2) uniform sampler2D unshadowed_texture;
+// The averaged visibility of the direct light of the primary hits (rgb = shadows, a = ambient occlusion).
+layout (binding = 3) uniform sampler2D visibility_texture;
+
+// The flag determining if the direct light of the primary hits should be added to the color, i.e., the color texture
+// was traced with the split visibility instead of being composited already (e.g., by the denoiser).
+uniform bool use_split_visibility = false;
+
+// The size of the ray traced image (in texels).
+uniform vec2 source_size;
+// The ratio between the size of the ray traced image and the size of the window.
+uniform vec2 scale;
+// The relative difference of the distances above which two texels are considered to lie on different surfaces.
+uniform float depth_tolerance = 0.05;
+
+// The near and far planes used by ray_tracing.frag to compute the depth.
+const float near = 1.0;
+const float far = 1000.0;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The final output color.
+layout (location = 0) out vec4 final_color;
+
+// ----------------------------------------------------------------------------
+// Local Methods
+// ----------------------------------------------------------------------------
+// Converts the depth written by ray_tracing.frag back to the distance along the ray.
+float LinearDistance(float depth) {
+	return 1.0 / (1.0 / near + depth * (1.0 / far - 1.0 / near));
+}
+
+// Returns the color of the texel of the ray traced image.
+vec3 TexelColor(ivec2 texel) {
+	vec3 color = texelFetch(color_texture, texel, 0).rgb;
+	if (use_split_visibility) {
+		vec4 visibility = texelFetch(visibility_texture, texel, 0);
+		color += texelFetch(unshadowed_texture, texel, 0).rgb * visibility.rgb * visibility.a;
+	}
+	return color;
+}
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	// The position of the pixel center in the ray traced image (in texels).
+	vec2 position = gl_FragCoord.xy * scale - 0.5;
+	ivec2 base = ivec2(floor(position));
+	vec2 f = position - vec2(base);
+
+	// The nearest texel defines the surface of the pixel, its depth is kept as is so the silhouettes stay sharp.
+	ivec2 nearest = clamp(ivec2(round(position)), ivec2(0), ivec2(source_size) - 1);
+	float nearest_depth = texelFetch(depth_texture, nearest, 0).r;
+	float nearest_distance = LinearDistance(nearest_depth);
+
+	// Bilinear filtering, the texels of other surfaces are left out (joint bilateral weights).
+	vec3 color = vec3(0.0);
+	float weight_sum = 0.0;
+	for (int y = 0; y < 2; y++) {
+		for (int x = 0; x < 2; x++) {
+			ivec2 texel = clamp(base + ivec2(x, y), ivec2(0), ivec2(source_size) - 1);
+			float distance = LinearDistance(texelFetch(depth_texture, texel, 0).r);
+			float bilinear = (x == 0 ? 1.0 - f.x : f.x) * (y == 0 ? 1.0 - f.y : f.y);
+			float similarity = abs(distance - nearest_distance) <= depth_tolerance * nearest_distance ? 1.0 : 0.0;
+			float weight = bilinear * similarity;
+
+			color += weight * TexelColor(texel);
+			weight_sum += weight;
+		}
+	}
+	if (weight_sum < 1e-4) {
+		color = TexelColor(nearest);
+	} else {
+		color /= weight_sum;
+	}
+
+	gl_FragDepth = nearest_depth;
+	final_color = vec4(color, 1.0);
+}
@@ -0,0 +1,56 @@
+#version 450 core
+
+// ----------------------------------------------------------------------------
+// Input Variables
+// ----------------------------------------------------------------------------
+in VertexData
+{
+	vec2 tex_coord;
+} in_data;
+
+// A pixel traced by wavefront_ray_tracing.comp.
+struct TracedPixel {
+	vec4 color;      // rgb = the color without the direct light of the primary hit, w = the distance to the primary hit.
+	vec4 unshadowed; // rgb = the direct light of the primary hit without the shadows and the occlusion, w = the ambient occlusion.
+	vec4 shadowed;   // rgb = the direct light of the primary hit with the shadows but without the occlusion.
+};
+
+// The image traced by wavefront_ray_tracing.comp.
+layout (std430, binding = 14) readonly buffer PixelBuffer
+{
+	TracedPixel pixels[];
+};
+
+// The resolution of the traced image (the viewport has the same size).
+uniform vec2 resolution;
+
+// ----------------------------------------------------------------------------
+// Output Variables
+// ----------------------------------------------------------------------------
+// The color without the direct light of the primary hit, the outputs match the split visibility of ray_tracing.frag.
+layout (location = 0) out vec4 final_color;
+// The direct light of the primary hit without the shadows and the ambient occlusion.
+layout (location = 1) out vec4 split_unshadowed;
+// The visibility of the direct light of the primary hit (rgb = the shadowed fraction per channel, a = ambient occlusion).
+layout (location = 2) out vec4 split_visibility;
+
+// ----------------------------------------------------------------------------
+// Main Method
+// ----------------------------------------------------------------------------
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	TracedPixel pixel = pixels[texel.y * int(resolution.x) + texel.x];
+
+	// The same depth as written by ray_tracing.frag.
+    float near = 1.0;
+    float far = 1000.0;
+    float depth = (1.0 / pixel.color.w - 1.0 / near) / (1.0 / far - 1.0 / near);
+
+    gl_FragDepth = depth;
+	final_color = vec4(pixel.color.rgb, 1.0);
+
+	vec3 unshadowed = pixel.unshadowed.rgb;
+	split_unshadowed = vec4(unshadowed, 1.0);
+	split_visibility = vec4(mix(vec3(1.0), pixel.shadowed.rgb / max(unshadowed, vec3(1e-6)), greaterThan(unshadowed, vec3(1e-6))), pixel.unshadowed.w);
+}
@@ -0,0 +1,193 @@
+#pragma once
+// A thin wrapper over the SIMD registers used by the CPU back-ends.
+//
+// The width is selected at compile time: 8 lanes when the compiler targets AVX2 (the CMake option
+// PV227_PROJECT_2024_02_AVX2 adds -mavx2 or /arch:AVX2), 4 lanes with SSE2 (always available on x86-64), and a single
+// scalar lane elsewhere. The kernels are written against vfloat and vmask only, so the same code runs on all three.
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SIMD_SSE2 1
+#endif
+
+#include <cmath>
+
+namespace simd {
+
+#if defined(SIMD_AVX2)
+/** The number of lanes in vfloat. */
+constexpr int width = 8;
+
+/** The lane mask, all bits set in the active lanes. */
+struct vmask {
+    __m256 v;
+};
+
+/** A register with {@link width} floats. */
+struct vfloat {
+    __m256 v;
+
+    vfloat() : v(_mm256_setzero_ps()) {}
+    vfloat(__m256 v) : v(v) {}
+    vfloat(float s) : v(_mm256_set1_ps(s)) {}
+
+    static vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat sqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+inline vfloat floor(vfloat a) { return _mm256_floor_ps(a.v); }
+inline vfloat min(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+inline vfloat max(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+
+// Ordered comparisons, a NaN operand yields false just like in GLSL.
+inline vmask operator<(vfloat a, vfloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline vmask operator>(vfloat a, vfloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+inline vmask operator==(vfloat a, vfloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ)}; }
+
+inline vmask operator&(vmask a, vmask b) { return {_mm256_and_ps(a.v, b.v)}; }
+inline vmask operator|(vmask a, vmask b) { return {_mm256_or_ps(a.v, b.v)}; }
+/** @return The lanes of a that are not set in b. */
+inline vmask and_not(vmask a, vmask b) { return {_mm256_andnot_ps(b.v, a.v)}; }
+inline vmask all_lanes() { return {_mm256_castsi256_ps(_mm256_set1_epi32(-1))}; }
+inline vmask no_lanes() { return {_mm256_setzero_ps()}; }
+inline bool any(vmask m) { return _mm256_movemask_ps(m.v) != 0; }
+inline int bits(vmask m) { return _mm256_movemask_ps(m.v); }
+/** @return The lanes of a where the mask is set and the lanes of b elsewhere. */
+inline vfloat select(vmask m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+
+#elif defined(SIMD_SSE2)
+/** The number of lanes in vfloat. */
+constexpr int width = 4;
+
+/** The lane mask, all bits set in the active lanes. */
+struct vmask {
+    __m128 v;
+};
+
+/** A register with {@link width} floats. */
+struct vfloat {
+    __m128 v;
+
+    vfloat() : v(_mm_setzero_ps()) {}
+    vfloat(__m128 v) : v(v) {}
+    vfloat(float s) : v(_mm_set1_ps(s)) {}
+
+    static vfloat load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+inline vfloat sqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+/** SSE2 has no rounding, the truncation is moved one down for the negative values (valid below 2^31). */
+inline vfloat floor(vfloat a) {
+    const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.v), _mm_set1_ps(1.0f)));
+}
+inline vfloat min(vfloat a, vfloat b) { return _mm_min_ps(a.v, b.v); }
+inline vfloat max(vfloat a, vfloat b) { return _mm_max_ps(a.v, b.v); }
+
+inline vmask operator<(vfloat a, vfloat b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline vmask operator>(vfloat a, vfloat b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline vmask operator==(vfloat a, vfloat b) { return {_mm_cmpeq_ps(a.v, b.v)}; }
+
+inline vmask operator&(vmask a, vmask b) { return {_mm_and_ps(a.v, b.v)}; }
+inline vmask operator|(vmask a, vmask b) { return {_mm_or_ps(a.v, b.v)}; }
+/** @return The lanes of a that are not set in b. */
+inline vmask and_not(vmask a, vmask b) { return {_mm_andnot_ps(b.v, a.v)}; }
+inline vmask all_lanes() { return {_mm_castsi128_ps(_mm_set1_epi32(-1))}; }
+inline vmask no_lanes() { return {_mm_setzero_ps()}; }
+inline bool any(vmask m) { return _mm_movemask_ps(m.v) != 0; }
+inline int bits(vmask m) { return _mm_movemask_ps(m.v); }
+/** @return The lanes of a where the mask is set and the lanes of b elsewhere. */
+inline vfloat select(vmask m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+
+#else
+/** The number of lanes in vfloat. */
+constexpr int width = 1;
+
+/** The lane mask. */
+struct vmask {
+    bool v;
+};
+
+/** A single float behaving like a one-lane register. */
+struct vfloat {
+    float v;
+
+    vfloat() : v(0.0f) {}
+    vfloat(float s) : v(s) {}
+
+    static vfloat load(const float* p) { return *p; }
+    void store(float* p) const { *p = v; }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return a.v + b.v; }
+inline vfloat operator-(vfloat a, vfloat b) { return a.v - b.v; }
+inline vfloat operator*(vfloat a, vfloat b) { return a.v * b.v; }
+inline vfloat operator/(vfloat a, vfloat b) { return a.v / b.v; }
+inline vfloat sqrt(vfloat a) { return std::sqrt(a.v); }
+inline vfloat floor(vfloat a) { return std::floor(a.v); }
+inline vfloat min(vfloat a, vfloat b) { return b.v < a.v ? b.v : a.v; }
+inline vfloat max(vfloat a, vfloat b) { return b.v > a.v ? b.v : a.v; }
+
+inline vmask operator<(vfloat a, vfloat b) { return {a.v < b.v}; }
+inline vmask operator>(vfloat a, vfloat b) { return {a.v > b.v}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {a.v >= b.v}; }
+inline vmask operator==(vfloat a, vfloat b) { return {a.v == b.v}; }
+
+inline vmask operator&(vmask a, vmask b) { return {a.v && b.v}; }
+inline vmask operator|(vmask a, vmask b) { return {a.v || b.v}; }
+/** @return The lanes of a that are not set in b. */
+inline vmask and_not(vmask a, vmask b) { return {a.v && !b.v}; }
+inline vmask all_lanes() { return {true}; }
+inline vmask no_lanes() { return {false}; }
+inline bool any(vmask m) { return m.v; }
+inline int bits(vmask m) { return m.v ? 1 : 0; }
+/** @return a where the mask is set, b otherwise. */
+inline vfloat select(vmask m, vfloat a, vfloat b) { return m.v ? a : b; }
+#endif
+
+inline vfloat& operator+=(vfloat& a, vfloat b) { return a = a + b; }
+inline vfloat& operator*=(vfloat& a, vfloat b) { return a = a * b; }
+inline vfloat operator-(vfloat a) { return vfloat(0.0f) - a; }
+/** @return The fractional part like fract() in GLSL. */
+inline vfloat fract(vfloat a) { return a - floor(a); }
+
+/** @return Whether the lane is set in the mask. */
+inline bool lane(vmask m, int i) { return (bits(m) >> i) & 1; }
+
+/** A vector of three registers, i.e., {@link width} 3D vectors in SoA layout. */
+struct vvec3 {
+    vfloat x, y, z;
+
+    vvec3() {}
+    vvec3(vfloat x, vfloat y, vfloat z) : x(x), y(y), z(z) {}
+};
+
+inline vvec3 operator+(const vvec3& a, const vvec3& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+inline vvec3 operator-(const vvec3& a, const vvec3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline vvec3 operator*(const vvec3& a, const vvec3& b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+inline vvec3 operator*(const vvec3& a, vfloat s) { return {a.x * s, a.y * s, a.z * s}; }
+inline vvec3 operator*(vfloat s, const vvec3& a) { return {a.x * s, a.y * s, a.z * s}; }
+inline vfloat dot(const vvec3& a, const vvec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline vfloat length(const vvec3& a) { return sqrt(dot(a, a)); }
+inline vvec3 normalize(const vvec3& a) { return a * (vfloat(1.0f) / length(a)); }
+inline vvec3 cross(const vvec3& a, const vvec3& b) {
+    return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+inline vvec3 select(vmask m, const vvec3& a, const vvec3& b) { return {select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z)}; }
+
+} // namespace simd
@@ -0,0 +1,261 @@
+#include "sphere_bvh.hpp"
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+namespace {
+/** An axis-aligned bounding box used during the build. */
+struct Bounds {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    void grow(const glm::vec3& point) {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(const Bounds& other) {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    void grow_sphere(const glm::vec4& sphere) {
+        min = glm::min(min, glm::vec3(sphere) - glm::vec3(sphere.w));
+        max = glm::max(max, glm::vec3(sphere) + glm::vec3(sphere.w));
+    }
+
+    bool empty() const { return min.x > max.x; }
+
+    /** @return The half of the surface area, the constant factor does not matter for the SAH. */
+    float half_area() const {
+        if (empty()) return 0.0f;
+        const glm::vec3 extent = max - min;
+        return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+    }
+};
+
+/** A bin of the SAH evaluation. */
+struct Bin {
+    Bounds bounds;
+    int count = 0;
+};
+} // namespace
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void SphereBVH::build(const glm::vec4* spheres, int sphere_count, int static_count) {
+    static_count = std::clamp(static_count, 0, sphere_count);
+
+    nodes.clear();
+    parents.clear();
+    right_children.clear();
+    nodes.reserve(2 * static_cast<size_t>(sphere_count) / min_split_size + 2);
+    sphere_indices.resize(sphere_count);
+    std::iota(sphere_indices.begin(), sphere_indices.end(), 0);
+    leaf_of_sphere.assign(sphere_count, -1);
+
+    if (static_count > 0 && static_count < sphere_count) {
+        // The root separates the static and the dynamic spheres.
+        const int root = add_node(-1);
+        static_root = build_recursive(spheres, 0, static_count, root);
+        dynamic_root = build_recursive(spheres, static_count, sphere_count, root);
+        right_children[root] = dynamic_root;
+    } else {
+        static_root = build_recursive(spheres, 0, sphere_count, -1);
+        dynamic_root = -1;
+    }
+
+    link(0, -1);
+    for (int node = static_cast<int>(nodes.size()) - 1; node >= 0; node--) {
+        update_bounds(spheres, node);
+    }
+}
+
+bool SphereBVH::assign(const BVHNode* new_nodes, int node_count, const int32_t* new_sphere_indices, int sphere_count, int static_count) {
+    if (node_count <= 0) return false;
+    nodes.assign(new_nodes, new_nodes + node_count);
+    sphere_indices.assign(new_sphere_indices, new_sphere_indices + sphere_count);
+    parents.assign(node_count, -1);
+    right_children.assign(node_count, -1);
+    leaf_of_sphere.assign(sphere_count, -1);
+
+    // The first child of an inner node follows it and misses into the second child. Every miss link points forward, so
+    // the stackless traversal always terminates.
+    for (int node = 0; node < node_count; node++) {
+        const BVHNode& current = nodes[node];
+        if (current.miss_index != -1 && (current.miss_index <= node || current.miss_index >= node_count)) return false;
+        if (current.spheres != 0) {
+            const int first = current.spheres >> 4;
+            const int count = current.spheres & 15;
+            if (count == 0 || first < 0 || first + count > sphere_count) return false;
+            for (int i = first; i < first + count; i++) {
+                const int sphere = sphere_indices[i];
+                if (sphere < 0 || sphere >= sphere_count || leaf_of_sphere[sphere] != -1) return false;
+                leaf_of_sphere[sphere] = node;
+            }
+        } else {
+            if (node + 1 >= node_count) return false;
+            const int right = nodes[node + 1].miss_index;
+            if (right <= node + 1) return false;
+            parents[node + 1] = node;
+            parents[right] = node;
+            right_children[node] = right;
+        }
+    }
+
+    // The root separates the static and the dynamic spheres whenever both exist, see build.
+    if (static_count > 0 && static_count < sphere_count) {
+        if (right_children[0] == -1) return false;
+        static_root = 1;
+        dynamic_root = right_children[0];
+    } else {
+        static_root = 0;
+        dynamic_root = -1;
+    }
+    return true;
+}
+
+std::vector<int> SphereBVH::refit(const glm::vec4* spheres, const std::vector<int>& moved) {
+    std::vector<int> changed;
+    for (const int sphere : moved) {
+        for (int node = leaf_of_sphere[sphere]; node != -1; node = parents[node]) {
+            changed.push_back(node);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+    // The children are always stored after their parents, so going backwards updates them first.
+    for (auto it = changed.rbegin(); it != changed.rend(); ++it) {
+        update_bounds(spheres, *it);
+    }
+    return changed;
+}
+
+int SphereBVH::build_recursive(const glm::vec4* spheres, int begin, int end, int parent) {
+    const int node = add_node(parent);
+    const int count = end - begin;
+
+    Bounds bounds, centroid_bounds;
+    for (int i = begin; i < end; i++) {
+        const glm::vec4& sphere = spheres[sphere_indices[i]];
+        bounds.grow_sphere(sphere);
+        centroid_bounds.grow(glm::vec3(sphere));
+    }
+
+    const auto make_leaf = [&]() {
+        nodes[node].spheres = (begin << 4) | count;
+        for (int i = begin; i < end; i++) {
+            leaf_of_sphere[sphere_indices[i]] = node;
+        }
+        return node;
+    };
+    if (count <= min_split_size) {
+        return make_leaf();
+    }
+
+    // Evaluates the binned SAH along all three axes.
+    const glm::vec3 extent = centroid_bounds.max - centroid_bounds.min;
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1;
+    int best_split = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (extent[axis] <= 0.0f) continue;
+
+        Bin bins[bin_count];
+        const float scale = bin_count / extent[axis];
+        for (int i = begin; i < end; i++) {
+            const glm::vec4& sphere = spheres[sphere_indices[i]];
+            const int bin = std::min(bin_count - 1, static_cast<int>((sphere[axis] - centroid_bounds.min[axis]) * scale));
+            bins[bin].count++;
+            bins[bin].bounds.grow_sphere(sphere);
+        }
+
+        // Sweeps from the right to get the costs of all the right halves, then from the left.
+        float right_costs[bin_count];
+        Bounds right_bounds;
+        int right_count = 0;
+        for (int split = bin_count - 1; split > 0; split--) {
+            right_bounds.grow(bins[split].bounds);
+            right_count += bins[split].count;
+            right_costs[split] = right_bounds.half_area() * static_cast<float>(right_count);
+        }
+        Bounds left_bounds;
+        int left_count = 0;
+        for (int split = 1; split < bin_count; split++) {
+            left_bounds.grow(bins[split - 1].bounds);
+            left_count += bins[split - 1].count;
+            const float cost = left_bounds.half_area() * static_cast<float>(left_count) + right_costs[split];
+            if (left_count > 0 && left_count < count && cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = split;
+            }
+        }
+    }
+
+    const float leaf_cost = bounds.half_area() * static_cast<float>(count);
+    if (count <= max_leaf_size && (best_axis < 0 || best_cost >= leaf_cost)) {
+        return make_leaf();
+    }
+
+    int middle;
+    if (best_axis >= 0) {
+        const float scale = bin_count / extent[best_axis];
+        const float min = centroid_bounds.min[best_axis];
+        middle = static_cast<int>(
+            std::partition(sphere_indices.begin() + begin, sphere_indices.begin() + end,
+                           [&](int32_t sphere) {
+                               const int bin = std::min(bin_count - 1, static_cast<int>((spheres[sphere][best_axis] - min) * scale));
+                               return bin < best_split;
+                           }) -
+            sphere_indices.begin());
+    } else {
+        // All the centers coincide, the spheres are simply halved.
+        middle = begin + count / 2;
+    }
+
+    build_recursive(spheres, begin, middle, node);
+    right_children[node] = build_recursive(spheres, middle, end, node);
+    return node;
+}
+
+int SphereBVH::add_node(int parent) {
+    nodes.push_back(BVHNode{glm::vec3(0.0f), -1, glm::vec3(0.0f), 0});
+    parents.push_back(parent);
+    right_children.push_back(-1);
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+void SphereBVH::link(int node, int miss_index) {
+    // Iterative, degenerate scenes may produce deep trees.
+    std::vector<std::pair<int, int>> stack = {{node, miss_index}};
+    while (!stack.empty()) {
+        const auto [current, miss] = stack.back();
+        stack.pop_back();
+        nodes[current].miss_index = miss;
+        if (right_children[current] != -1) {
+            stack.emplace_back(right_children[current], miss);
+            stack.emplace_back(current + 1, right_children[current]);
+        }
+    }
+}
+
+void SphereBVH::update_bounds(const glm::vec4* spheres, int node) {
+    Bounds bounds;
+    if (right_children[node] == -1) {
+        const int first = nodes[node].spheres >> 4;
+        const int count = nodes[node].spheres & 15;
+        for (int i = first; i < first + count; i++) {
+            bounds.grow_sphere(spheres[sphere_indices[i]]);
+        }
+    } else {
+        const BVHNode& left = nodes[node + 1];
+        const BVHNode& right = nodes[right_children[node]];
+        bounds.min = glm::min(left.aabb_min, right.aabb_min);
+        bounds.max = glm::max(left.aabb_max, right.aabb_max);
+    }
+    nodes[node].aabb_min = bounds.min;
+    nodes[node].aabb_max = bounds.max;
+}
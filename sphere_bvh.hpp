@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+/**
+ * A node of the BVH as stored in the BVHBuffer SSBO (std430).
+ *
+ * The nodes are stored in depth-first order, so the first child of an inner node directly follows it. The miss index
+ * points to the node where the traversal continues when the box is missed or after a leaf has been processed, which
+ * allows the shader to traverse the tree without a stack.
+ */
+struct BVHNode {
+    glm::vec3 aabb_min;   // The minimum corner of the bounding box.
+    int32_t miss_index;   // The node to continue with when the box is missed (or after a leaf), -1 ends the traversal.
+    glm::vec3 aabb_max;   // The maximum corner of the bounding box.
+    int32_t spheres;      // (first << 4) | count for leaves (the range in the sphere index buffer), 0 for inner nodes.
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode must match the std430 layout in the shaders.");
+
+/**
+ * A bounding volume hierarchy over spheres built with the binned surface area heuristic.
+ *
+ * The spheres are split into a static part (the first static_count spheres) and a dynamic part (the rest, e.g., the
+ * light spheres). Each part gets its own subtree under the root, so moving the dynamic spheres only requires refitting
+ * their small subtree and the root, and rays ignoring the lights can traverse the static subtree alone.
+ */
+class SphereBVH {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The maximum number of spheres in a leaf, limited by the 4 bits of the count in {@link BVHNode::spheres}. */
+    static constexpr int max_leaf_size = 15;
+    /** Nodes with at most this many spheres are never split. */
+    static constexpr int min_split_size = 2;
+    /** The number of bins used to evaluate the SAH. */
+    static constexpr int bin_count = 16;
+
+  private:
+    /** The nodes in depth-first order. */
+    std::vector<BVHNode> nodes;
+    /** The indices of the spheres referenced by the leaves. */
+    std::vector<int32_t> sphere_indices;
+    /** The parent of every node, -1 for the root. */
+    std::vector<int32_t> parents;
+    /** The second child of every inner node, -1 for leaves. */
+    std::vector<int32_t> right_children;
+    /** The leaf containing every sphere. */
+    std::vector<int32_t> leaf_of_sphere;
+
+    /** The root of the static subtree. */
+    int static_root = 0;
+    /** The root of the dynamic subtree, -1 if there are no dynamic spheres. */
+    int dynamic_root = -1;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Builds the hierarchy.
+     *
+     * @param 	spheres	  	The spheres (xyz = center, w = radius).
+     * @param 	static_count	The number of static spheres at the beginning of the array.
+     */
+    void build(const std::vector<glm::vec4>& spheres, int static_count) { build(spheres.data(), static_cast<int>(spheres.size()), static_count); }
+
+    /** @copydoc build */
+    void build(const glm::vec4* spheres, int sphere_count, int static_count);
+
+    /**
+     * Takes over a hierarchy built earlier (e.g., stored in a scene file), the links needed by {@link refit} are
+     * restored from the miss indices.
+     *
+     * @param 	nodes		  	The nodes in depth-first order.
+     * @param 	node_count	  	The number of nodes.
+     * @param 	sphere_indices	The sphere indices referenced by the leaves, one per sphere.
+     * @param 	sphere_count  	The number of spheres.
+     * @param 	static_count  	The number of static spheres at the beginning of the array.
+     * @return	False if the nodes do not form a valid hierarchy over the spheres.
+     */
+    bool assign(const BVHNode* nodes, int node_count, const int32_t* sphere_indices, int sphere_count, int static_count);
+
+    /**
+     * Updates the bounding boxes after some spheres have moved.
+     *
+     * @param 	spheres	The spheres with the new positions.
+     * @param 	moved  	The indices of the spheres that have moved.
+     * @return	The sorted indices of the nodes that have changed.
+     */
+    std::vector<int> refit(const glm::vec4* spheres, const std::vector<int>& moved);
+
+    /** @return The nodes. */
+    const std::vector<BVHNode>& get_nodes() const { return nodes; }
+
+    /** @return The sphere indices referenced by the leaves. */
+    const std::vector<int32_t>& get_sphere_indices() const { return sphere_indices; }
+
+    /** @return The root of the subtree with the static spheres. */
+    int get_static_root() const { return static_root; }
+
+    /** @return The first node after the static subtree, i.e., where the traversal of the static spheres ends (-1 if none). */
+    int get_static_end() const { return dynamic_root; }
+
+  private:
+    /** Builds the subtree over sphere_indices[begin, end) and returns the index of its root. */
+    int build_recursive(const glm::vec4* spheres, int begin, int end, int parent);
+
+    /** Creates a new node and returns its index. */
+    int add_node(int parent);
+
+    /** Assigns the miss links of the subtree. */
+    void link(int node, int miss_index);
+
+    /** Recomputes the bounding box of the node from its spheres or children. */
+    void update_bounds(const glm::vec4* spheres, int node);
+};
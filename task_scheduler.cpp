@@ -0,0 +1,114 @@
+#include "task_scheduler.hpp"
+#include <algorithm>
+
+TaskScheduler::TaskScheduler(int worker_count) {
+    if (worker_count <= 0) {
+        worker_count = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    for (int i = 0; i < worker_count; i++) {
+        queues.push_back(std::make_unique<WorkerQueue>());
+    }
+    // The calling thread is the worker 0, the rest runs in the background.
+    for (int i = 1; i < worker_count; i++) {
+        threads.emplace_back(&TaskScheduler::worker_loop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        stopping = true;
+    }
+    job_started.notify_all();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+void TaskScheduler::parallel_for(int task_count, const TaskFunction& function) {
+    if (task_count <= 0) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> parallel_for_lock(parallel_for_mutex);
+
+    // Publishes the job before any of its tasks becomes visible.
+    job = &function;
+    pending_tasks = task_count;
+
+    // Deals the tasks round-robin so that neighbouring tasks (e.g., neighbouring tiles) start on different workers.
+    const int worker_count = get_worker_count();
+    for (int worker = 0; worker < worker_count; worker++) {
+        std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+        for (int task = worker; task < task_count; task += worker_count) {
+            queues[worker]->tasks.push_back(task);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(job_mutex);
+        job_generation++;
+    }
+    job_started.notify_all();
+
+    // The calling thread helps and then waits for the tasks that are still running elsewhere.
+    run_tasks(0);
+
+    std::unique_lock<std::mutex> lock(job_mutex);
+    job_finished.wait(lock, [this] { return pending_tasks.load() == 0; });
+    job = nullptr;
+}
+
+void TaskScheduler::worker_loop(int worker) {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(job_mutex);
+            job_started.wait(lock, [&] { return stopping || job_generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = job_generation;
+        }
+        run_tasks(worker);
+    }
+}
+
+void TaskScheduler::run_tasks(int worker) {
+    int task;
+    while ((task = acquire_task(worker)) >= 0) {
+        (*job.load())(task, worker);
+
+        if (pending_tasks.fetch_sub(1) == 1) {
+            // Takes the lock so that the notification cannot slip between the predicate check and the wait.
+            std::lock_guard<std::mutex> lock(job_mutex);
+            job_finished.notify_all();
+        }
+    }
+}
+
+int TaskScheduler::acquire_task(int worker) {
+    {
+        WorkerQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            const int task = own.tasks.back();
+            own.tasks.pop_back();
+            return task;
+        }
+    }
+
+    // Steals from the other workers, starting with the next one to spread the contention.
+    const int worker_count = get_worker_count();
+    for (int offset = 1; offset < worker_count; offset++) {
+        WorkerQueue& victim = *queues[(worker + offset) % worker_count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            const int task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return task;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A small work-stealing scheduler used by the CPU back-ends.
+ *
+ * Every worker (including the calling thread) owns a queue of task indices. A worker pops tasks from the back of its own
+ * queue and, once the queue is empty, steals from the front of the queues of the other workers. The scheduler runs one
+ * parallel loop at a time; {@link parallel_for} blocks until every task of the loop has finished.
+ */
+class TaskScheduler {
+    // ----------------------------------------------------------------------------
+    // Type Definitions
+    // ----------------------------------------------------------------------------
+  public:
+    /** The task callback, receives the index of the task and the index of the worker running it. */
+    using TaskFunction = std::function<void(int task, int worker)>;
+
+  private:
+    /** The queue of tasks owned by a single worker. */
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  private:
+    /** The background threads, the calling thread acts as the worker with index 0. */
+    std::vector<std::thread> threads;
+    /** The task queues, one per worker. */
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    /** The guard for the job state below. */
+    std::mutex job_mutex;
+    /** Signals the workers that a new job has been published or that they should stop. */
+    std::condition_variable job_started;
+    /** Signals the calling thread that the last task of the job has finished. */
+    std::condition_variable job_finished;
+    /** The function executed by the current job. */
+    std::atomic<const TaskFunction*> job = nullptr;
+    /** Incremented every time a job is published. */
+    uint64_t job_generation = 0;
+    /** The number of tasks of the current job that have not finished yet. */
+    std::atomic<int> pending_tasks = 0;
+    /** The flag telling the workers to exit. */
+    bool stopping = false;
+
+    /** Serializes concurrent calls of {@link parallel_for}. */
+    std::mutex parallel_for_mutex;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Creates the scheduler.
+     *
+     * @param 	worker_count	The total number of workers including the calling thread, zero selects the number of cores.
+     */
+    explicit TaskScheduler(int worker_count = 0);
+
+    /** Stops and joins all the workers. */
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** @return The number of workers including the calling thread. */
+    int get_worker_count() const { return static_cast<int>(queues.size()); }
+
+    /**
+     * Runs the tasks [0, task_count) in parallel and waits for all of them.
+     *
+     * @param 	task_count	The number of tasks.
+     * @param 	function  	The function invoked for every task.
+     */
+    void parallel_for(int task_count, const TaskFunction& function);
+
+  private:
+    /** The main loop of the background workers. */
+    void worker_loop(int worker);
+
+    /** Executes tasks until there is nothing left to run or to steal. */
+    void run_tasks(int worker);
+
+    /** Takes a task from the own queue or steals one from another worker, returns -1 if there is none. */
+    int acquire_task(int worker);
+};
@@ -0,0 +1,94 @@
+#include "upload_ring.hpp"
+#include <algorithm>
+#include <cstring>
+
+// ----------------------------------------------------------------------------
+// Constructors
+// ----------------------------------------------------------------------------
+UploadRing::UploadRing(size_t frame_capacity) : frame_capacity(frame_capacity) {
+    // Coherent, so the writes are visible to the copies without explicit flushes.
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const GLsizeiptr size = static_cast<GLsizeiptr>(frame_capacity * frames_in_flight);
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, size, nullptr, flags);
+    mapped = static_cast<uint8_t*>(glMapNamedBufferRange(buffer, 0, size, flags));
+}
+
+UploadRing::~UploadRing() {
+    for (GLsync& fence : fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    glUnmapNamedBuffer(buffer);
+    glDeleteBuffers(1, &buffer);
+}
+
+// ----------------------------------------------------------------------------
+// Methods
+// ----------------------------------------------------------------------------
+void UploadRing::begin_frame() {
+    GLsync& fence = fences[frame_index % frames_in_flight];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            stalled_frames++;
+            while (status == GL_TIMEOUT_EXPIRED) {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000); // 1 s
+            }
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+    write_offset = 0;
+}
+
+void UploadRing::end_frame() {
+    GLsync& fence = fences[frame_index % frames_in_flight];
+    if (fence) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_index++;
+}
+
+void UploadRing::upload(GLuint destination, GLintptr offset, GLsizeiptr size, const void* data) {
+    if (size <= 0) {
+        return;
+    }
+    if (!mapped || write_offset + static_cast<size_t>(size) > frame_capacity) {
+        overflowed_uploads++;
+        glNamedBufferSubData(destination, offset, size, data);
+        return;
+    }
+
+    const size_t source = (frame_index % frames_in_flight) * frame_capacity + write_offset;
+    std::memcpy(mapped + source, data, size);
+    glCopyNamedBufferSubData(buffer, destination, static_cast<GLintptr>(source), offset, size);
+
+    // Keeps the next write aligned, the copies are faster that way.
+    write_offset = (write_offset + static_cast<size_t>(size) + 15) & ~static_cast<size_t>(15);
+}
+
+void UploadRing::upload_changes(GLuint destination, const void* data, size_t size, std::vector<uint8_t>& uploaded, size_t block_size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    if (uploaded.size() != size) {
+        upload(destination, 0, static_cast<GLsizeiptr>(size), data);
+        uploaded.assign(bytes, bytes + size);
+        return;
+    }
+
+    size_t range_begin = 0, range_end = 0; // The pending range of changed blocks.
+    for (size_t block = 0; block < size; block += block_size) {
+        const size_t length = std::min(block_size, size - block);
+        if (std::memcmp(bytes + block, uploaded.data() + block, length) == 0) continue;
+
+        if (range_end != block) {
+            upload(destination, static_cast<GLintptr>(range_begin), static_cast<GLsizeiptr>(range_end - range_begin), bytes + range_begin);
+            range_begin = block;
+        }
+        range_end = block + length;
+    }
+    upload(destination, static_cast<GLintptr>(range_begin), static_cast<GLsizeiptr>(range_end - range_begin), bytes + range_begin);
+    std::memcpy(uploaded.data(), bytes, size);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "pv227_application.hpp"
+#include <cstdint>
+#include <vector>
+
+/**
+ * Streams per-frame data into GPU buffers without implicit synchronization.
+ *
+ * The ring owns a single persistently mapped staging buffer split into {@link frames_in_flight} regions, one per frame.
+ * The data are written into the region of the current frame and copied into the destination buffers on the GPU timeline
+ * (glCopyNamedBufferSubData), so the copies are ordered with the draw calls. A fence guards every region; it is waited
+ * for only when the region is reused, i.e., when the CPU would get more than frames_in_flight - 1 frames ahead.
+ *
+ * Usage:
+ *     ring.begin_frame();
+ *     ring.upload(buffer, offset, size, data);
+ *     ...
+ *     ring.end_frame();
+ */
+class UploadRing {
+    // ----------------------------------------------------------------------------
+    // Variables
+    // ----------------------------------------------------------------------------
+  public:
+    /** The number of frames the CPU may record before waiting for the GPU. */
+    static constexpr int frames_in_flight = 3;
+
+  private:
+    /** The staging buffer. */
+    GLuint buffer = 0;
+    /** The persistent mapping of the staging buffer. */
+    uint8_t* mapped = nullptr;
+    /** The size of the region of a single frame (in bytes). */
+    size_t frame_capacity;
+    /** The fences guarding the regions. */
+    GLsync fences[frames_in_flight] = {};
+    /** The index of the current frame. */
+    uint64_t frame_index = 0;
+    /** The first free byte in the region of the current frame. */
+    size_t write_offset = 0;
+
+    /** The number of frames that had to wait for the GPU to free their region. */
+    int stalled_frames = 0;
+    /** The number of uploads that did not fit into the region and were uploaded synchronously. */
+    int overflowed_uploads = 0;
+
+    // ----------------------------------------------------------------------------
+    // Constructors
+    // ----------------------------------------------------------------------------
+  public:
+    /**
+     * Creates the staging buffer.
+     *
+     * @param 	frame_capacity	The maximum number of bytes uploaded in a single frame.
+     */
+    explicit UploadRing(size_t frame_capacity = 4 << 20);
+
+    /** Releases the staging buffer and the fences. */
+    ~UploadRing();
+
+    UploadRing(const UploadRing&) = delete;
+    UploadRing& operator=(const UploadRing&) = delete;
+
+    // ----------------------------------------------------------------------------
+    // Methods
+    // ----------------------------------------------------------------------------
+  public:
+    /** Waits until the GPU has finished reading the region of the new frame. */
+    void begin_frame();
+
+    /** Fences the region of the current frame. */
+    void end_frame();
+
+    /**
+     * Uploads the data into a range of the destination buffer.
+     *
+     * If the region of the frame is full, the data are uploaded with glNamedBufferSubData instead.
+     */
+    void upload(GLuint destination, GLintptr offset, GLsizeiptr size, const void* data);
+
+    /**
+     * Uploads only the blocks that differ from the previously uploaded copy, consecutive blocks are merged.
+     *
+     * @param 	destination	The destination buffer.
+     * @param 	data	   	The new content of the buffer (starting at offset zero).
+     * @param 	size	   	The size of the data (in bytes).
+     * @param 	uploaded   	The copy of the content uploaded last time, updated by the call (empty uploads everything).
+     * @param 	block_size 	The granularity of the comparison (in bytes).
+     */
+    void upload_changes(GLuint destination, const void* data, size_t size, std::vector<uint8_t>& uploaded, size_t block_size);
+
+    /** @return The number of frames that had to wait for the GPU. */
+    int get_stalled_frames() const { return stalled_frames; }
+
+    /** @return The number of uploads that did not fit into the ring. */
+    int get_overflowed_uploads() const { return overflowed_uploads; }
+};